@@ -0,0 +1,26 @@
+find_path(zlib_INCLUDE_DIRS
+  NAMES zlib.h
+  DOC "zlib include dir"
+  PATH_SUFFIXES zlib/include)
+
+find_library(zlib_LIBRARIES NAMES z DOC "zlib library" PATH_SUFFIXES zlib/lib)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zlib
+  DEFAULT_MSG
+  zlib_INCLUDE_DIRS
+  zlib_LIBRARIES)
+
+mark_as_advanced(zlib_INCLUDE_DIRS zlib_LIBRARIES)
+
+if(Zlib_FOUND)
+  if(NOT TARGET Zlib_lib)
+    add_library(Zlib_lib INTERFACE IMPORTED)
+  endif()
+
+  set_target_properties(Zlib_lib
+    PROPERTIES INTERFACE_INCLUDE_DIRECTORIES
+    "${zlib_INCLUDE_DIRS}"
+    INTERFACE_LINK_LIBRARIES
+    "${zlib_LIBRARIES}")
+endif(Zlib_FOUND)
\ No newline at end of file
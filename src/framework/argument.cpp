@@ -58,6 +58,43 @@ bool CArgument::ParseYaml()
             ScriptDir = fs::current_path().parent_path() / "luascripts";
         }
 
+        if (config["main"]["reuseport"]) {
+            ReusePort = config["main"]["reuseport"].as<bool>();
+        }
+
+        if (config["main"]["backlog"]) {
+            Backlog = config["main"]["backlog"].as<uint32_t>();
+        }
+        if (config["main"]["acceptbatch"]) {
+            AcceptBatch = config["main"]["acceptbatch"].as<uint32_t>();
+        }
+        if (config["main"]["maxconnections"]) {
+            MaxConnections = config["main"]["maxconnections"].as<uint32_t>();
+        }
+
+        if (config["main"]["dispatch"]) {
+            Dispatch = config["main"]["dispatch"].as<std::string>();
+        }
+
+        if (config["main"]["cpuaffinity"] && config["main"]["cpuaffinity"].IsSequence()) {
+            CpuAffinity.clear();
+            for (auto&& v : config["main"]["cpuaffinity"]) {
+                CpuAffinity.push_back(v.as<int32_t>());
+            }
+        }
+        if (config["main"]["numabind"]) {
+            NumaBind = config["main"]["numabind"].as<bool>();
+        }
+        if (config["main"]["statsinterval"]) {
+            StatsInterval = config["main"]["statsinterval"].as<uint32_t>();
+        }
+        if (config["main"]["draintimeout"]) {
+            DrainTimeout = config["main"]["draintimeout"].as<uint32_t>();
+        }
+        if (config["main"]["handoff"]) {
+            Handoff = config["main"]["handoff"].as<std::string>();
+        }
+
         if (config["main"]["hosts"] && config["main"]["hosts"].IsSequence()) {
             auto n = 1;
             if (config["main"] && config["main"].IsMap() && config["main"]["workers"]) {
@@ -141,6 +178,51 @@ bool CArgument::ParseYaml()
         if (config["main"]["web"]["httptimeout"]) {
             HttpTimeout = config["main"]["web"]["httptimeout"].as<uint32_t>();
         }
+        if (config["main"]["web"]["maxbodysize"]) {
+            MaxBodySize = config["main"]["web"]["maxbodysize"].as<uint64_t>();
+        }
+        if (config["main"]["web"]["headertimeout"]) {
+            HeaderTimeout = config["main"]["web"]["headertimeout"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["bodytimeout"]) {
+            BodyTimeout = config["main"]["web"]["bodytimeout"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["keepalivetimeout"]) {
+            KeepAliveTimeout = config["main"]["web"]["keepalivetimeout"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["handlertimeout"]) {
+            HandlerTimeout = config["main"]["web"]["handlertimeout"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["writetimeout"]) {
+            WriteTimeout = config["main"]["web"]["writetimeout"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2streamwindow"]) {
+            H2StreamWindow = config["main"]["web"]["h2streamwindow"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2connwindow"]) {
+            H2ConnWindow = config["main"]["web"]["h2connwindow"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2maxwindow"]) {
+            H2MaxWindow = config["main"]["web"]["h2maxwindow"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2maxstreams"]) {
+            H2MaxStreams = config["main"]["web"]["h2maxstreams"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2maxheaderlist"]) {
+            H2MaxHeaderList = config["main"]["web"]["h2maxheaderlist"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2maxframesize"]) {
+            H2MaxFrameSize = config["main"]["web"]["h2maxframesize"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["h2maxresets"]) {
+            H2MaxResets = config["main"]["web"]["h2maxresets"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["grpccompressmin"]) {
+            GrpcCompressMin = config["main"]["web"]["grpccompressmin"].as<uint32_t>();
+        }
+        if (config["main"]["web"]["grpcmaxratio"]) {
+            GrpcMaxRatio = config["main"]["web"]["grpcmaxratio"].as<uint32_t>();
+        }
     }
 
     if (config["main"] && config["main"].IsMap() && config["main"]["ssl"] && config["main"]["ssl"].IsSequence()) {
@@ -221,6 +303,36 @@ bool CArgument::ParseYaml()
         j["tokenexpire"] = TokenExpire.value();
     if (HttpTimeout)
         j["httptimeout"] = HttpTimeout.value();
+    if (MaxBodySize)
+        j["maxbodysize"] = MaxBodySize.value();
+    if (HeaderTimeout)
+        j["headertimeout"] = HeaderTimeout.value();
+    if (BodyTimeout)
+        j["bodytimeout"] = BodyTimeout.value();
+    if (KeepAliveTimeout)
+        j["keepalivetimeout"] = KeepAliveTimeout.value();
+    if (HandlerTimeout)
+        j["handlertimeout"] = HandlerTimeout.value();
+    if (WriteTimeout)
+        j["writetimeout"] = WriteTimeout.value();
+    if (H2StreamWindow)
+        j["h2streamwindow"] = H2StreamWindow.value();
+    if (H2ConnWindow)
+        j["h2connwindow"] = H2ConnWindow.value();
+    if (H2MaxWindow)
+        j["h2maxwindow"] = H2MaxWindow.value();
+    if (H2MaxStreams)
+        j["h2maxstreams"] = H2MaxStreams.value();
+    if (H2MaxHeaderList)
+        j["h2maxheaderlist"] = H2MaxHeaderList.value();
+    if (H2MaxFrameSize)
+        j["h2maxframesize"] = H2MaxFrameSize.value();
+    if (H2MaxResets)
+        j["h2maxresets"] = H2MaxResets.value();
+    if (GrpcCompressMin)
+        j["grpccompressmin"] = GrpcCompressMin.value();
+    if (GrpcMaxRatio)
+        j["grpcmaxratio"] = GrpcMaxRatio.value();
     if (RedisTTL)
         j["redisttl"] = RedisTTL.value();
     if (Http2Able)
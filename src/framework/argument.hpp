@@ -38,7 +38,32 @@ public:
     std::optional<bool> IsAllowOrigin;
     std::optional<bool> Http2Able;
     std::optional<uint32_t> HttpTimeout;
+    std::optional<uint64_t> MaxBodySize;
+    std::optional<uint32_t> HeaderTimeout;
+    std::optional<uint32_t> BodyTimeout;
+    std::optional<uint32_t> KeepAliveTimeout;
+    std::optional<uint32_t> HandlerTimeout;
+    std::optional<uint32_t> WriteTimeout;
+    std::optional<uint32_t> H2StreamWindow;
+    std::optional<uint32_t> H2ConnWindow;
+    std::optional<uint32_t> H2MaxWindow;
+    std::optional<uint32_t> H2MaxStreams;
+    std::optional<uint32_t> H2MaxHeaderList;
+    std::optional<uint32_t> H2MaxFrameSize;
+    std::optional<uint32_t> H2MaxResets;
+    std::optional<uint32_t> GrpcCompressMin;
+    std::optional<uint32_t> GrpcMaxRatio;
     std::vector<Worker> Workers;
+    std::optional<bool> ReusePort;
+    std::optional<uint32_t> Backlog;
+    std::optional<uint32_t> AcceptBatch;
+    std::optional<uint32_t> MaxConnections;
+    std::optional<std::string> Dispatch;
+    std::vector<int32_t> CpuAffinity;
+    std::optional<bool> NumaBind;
+    std::optional<uint32_t> StatsInterval;
+    std::optional<uint32_t> DrainTimeout;
+    std::optional<std::string> Handoff;
     std::vector<std::string> RouteConf;
     std::optional<uint32_t> Interval;
     std::vector<std::string> RedisUrl;
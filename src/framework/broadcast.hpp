@@ -0,0 +1,160 @@
+#pragma once
+
+#include "common.hpp"
+#include "contex.hpp"
+#include "doorbell.hpp"
+#include "object.hpp"
+#include "utils.hpp"
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Append only log of immutable, refcounted message batches shared by every reader.
+// One thread, the one owning the log, subscribes and publishes, copying the payload once. Each reader walks the
+// log with its own cursor on its own thread and only shares ownership of the entries. Entries are freed once the
+// slowest reader passed them, a reader that stops for good unsubscribes so it does not hold them forever.
+class CBroadcastLog : public CObject {
+public:
+    struct Message {
+        std::uint8_t type;
+        std::string data;
+    };
+    using Messages = std::vector<Message>;
+
+private:
+    struct Entry {
+        Entry(std::shared_ptr<std::atomic<size_t>> retained)
+            : retained(std::move(retained))
+        {
+            this->retained->fetch_add(1, std::memory_order_relaxed);
+        }
+        ~Entry() { retained->fetch_sub(1, std::memory_order_relaxed); }
+        Messages msgs;
+        // written once by the publisher before ready is released
+        std::shared_ptr<Entry> next;
+        std::atomic<bool> ready = { false };
+        // entries alive, shared with the log which may go before its readers
+        std::shared_ptr<std::atomic<size_t>> retained;
+    };
+
+public:
+    class Reader : public CObject {
+        friend class CBroadcastLog;
+
+    public:
+        Reader(std::shared_ptr<Entry> cursor)
+            : m_cursor(std::move(cursor))
+        {
+        }
+        ~Reader() { release(); }
+
+        // cb runs on ctx whenever there is something to Read
+        bool Register(CContex& ctx, std::function<void()> cb)
+        {
+            CheckCondition(m_bell.Register(ctx, std::move(cb)), false);
+            // pick up whatever was published before the reader was registered
+            m_bell.Ring();
+            return true;
+        }
+
+        // On the reader's thread once it reads no more, what it did not read is let go at once and the log drops
+        // the reader on its next publish
+        void Unsubscribe()
+        {
+            m_closed.store(true, std::memory_order_release);
+            release();
+        }
+
+        // Visits every message published since the last call, on the reader's thread
+        template <typename F>
+        size_t Read(F&& f)
+        {
+            CheckCondition(m_cursor, 0);
+            size_t n = 0;
+            for (;;) {
+                while (m_cursor->ready.load(std::memory_order_acquire)) {
+                    m_cursor = m_cursor->next;
+                    for (auto& msg : m_cursor->msgs) {
+                        f(msg.type, std::string_view(msg.data));
+                        ++n;
+                    }
+                }
+                m_idle.store(true);
+                // a publisher may have appended before idle was set and skipped the bell
+                if (!m_cursor->ready.load() || !m_idle.exchange(false))
+                    break;
+            }
+            return n;
+        }
+
+    private:
+        void release()
+        {
+            CheckConditionVoid(m_cursor);
+            // unlink iteratively, a long unread tail must not be destroyed recursively
+            auto next = m_cursor->ready.load(std::memory_order_acquire) ? m_cursor->next : nullptr;
+            m_cursor.reset();
+            while (next && next.use_count() == 1) {
+                auto tmp = std::move(next->next);
+                next = std::move(tmp);
+            }
+        }
+
+    private:
+        std::shared_ptr<Entry> m_cursor;
+        std::atomic<bool> m_idle = { true };
+        std::atomic<bool> m_closed = { false };
+        CDoorbell m_bell;
+
+        DISABLE_CLASS_COPYABLE(Reader);
+    };
+
+public:
+    CBroadcastLog()
+        : m_retained(std::make_shared<std::atomic<size_t>>(0))
+        , m_tail(std::make_shared<Entry>(m_retained))
+    {
+    }
+    ~CBroadcastLog() = default;
+
+    // New readers start at the current end of the log
+    std::shared_ptr<Reader> Subscribe()
+    {
+        auto reader = std::make_shared<Reader>(m_tail);
+        CheckCondition(reader->m_bell.Create(), nullptr);
+        m_readers.push_back(reader);
+        return reader;
+    }
+
+    bool Publish(Messages msgs)
+    {
+        CheckCondition(!msgs.empty(), false);
+        auto entry = std::make_shared<Entry>(m_retained);
+        entry->msgs = std::move(msgs);
+        m_tail->next = entry;
+        m_tail->ready.store(true);
+        m_tail = std::move(entry);
+        std::erase_if(m_readers, [](auto& r) { return r->m_closed.load(std::memory_order_acquire); });
+        for (auto& r : m_readers) {
+            if (r->m_idle.exchange(false))
+                r->m_bell.Ring();
+        }
+        return true;
+    }
+
+    bool Publish(const std::uint8_t type, std::string_view data)
+    {
+        return Publish(Messages { Message { type, std::string(data) } });
+    }
+
+    // entries some reader still holds, the last one published stays as the cursor of readers that are done
+    size_t Retained() const { return m_retained->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<size_t>> m_retained;
+    std::shared_ptr<Entry> m_tail;
+    std::vector<std::shared_ptr<Reader>> m_readers;
+
+    DISABLE_CLASS_COPYABLE(CBroadcastLog);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
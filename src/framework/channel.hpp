@@ -2,7 +2,9 @@
 
 #include "common.hpp"
 #include "contex.hpp"
+#include "doorbell.hpp"
 #include "object.hpp"
+#include "ringbuffer.hpp"
 #include "utils.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
@@ -16,57 +18,84 @@ public:
         Binary = 0x03
     };
 
-private:
-#pragma pack(1)
-    struct MsgData {
-        std::uint32_t size;
-        MsgType type;
-        char data[0];
+    // Messages returned by ReadL/ReadR point into the ring (or into a spilled block for large messages)
+    // and stay valid while the batch is alive, whatever order the batches are destroyed in
+    class Batch : public std::vector<std::tuple<std::optional<MsgType>, std::optional<std::string_view>>> {
+    public:
+        Batch(CRingBuffer* ring = nullptr, const uint64_t pos = 0)
+            : m_ring(ring)
+            , m_pos(pos)
+        {
+        }
+        Batch(Batch&& rhs)
+            : vector(std::move(rhs))
+            , m_ring(rhs.m_ring)
+            , m_pos(rhs.m_pos)
+            , m_spilled(std::move(rhs.m_spilled))
+            , m_corrupted(rhs.m_corrupted)
+        {
+            rhs.m_ring = nullptr;
+        }
+        ~Batch()
+        {
+            if (m_ring)
+                m_ring->Release(m_pos);
+        }
+        // frames that were dropped because their type or reference was invalid
+        uint32_t Corrupted() const { return m_corrupted; }
+
+    private:
+        friend class CChannel;
+        CRingBuffer* m_ring = { nullptr };
+        uint64_t m_pos = { 0 };
+        std::vector<std::unique_ptr<std::string>> m_spilled;
+        uint32_t m_corrupted = { 0 };
+        DISABLE_CLASS_COPYABLE(Batch);
     };
-#pragma pack()
 
 public:
-    CChannel()
-    {
-        memset(m_fds, 0, sizeof(m_fds));
-        memset(m_bvs, 0, sizeof(m_bvs));
-    }
+    CChannel() = default;
 
     ~CChannel()
     {
-        if (m_bvs[0])
-            bufferevent_free(m_bvs[0]);
-        if (m_bvs[1])
-            bufferevent_free(m_bvs[1]);
-        memset(m_fds, 0, sizeof(m_fds));
-        memset(m_bvs, 0, sizeof(m_bvs));
+        for (int32_t i = 0; i < 2; ++i) {
+            if (m_retry[i]) {
+                CDEL(m_retry[i]);
+            }
+            // spilled blocks that were never consumed
+            m_rings[i].Peek([](const uint8_t type, std::string_view data) {
+                if (auto p = spilled(type, data); p)
+                    delete p;
+            });
+        }
     }
 
     bool Create()
     {
-        if (0 != evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds))
-            return false;
-
+        for (int32_t i = 0; i < 2; ++i) {
+            if (!m_rings[i].Create(CHANNEL_RING_SIZE) || !m_bells[i].Create())
+                return false;
+        }
         return true;
     }
 
-    bool CreateBvL(CContex& ctx, bufferevent_data_cb rcb, bufferevent_data_cb wcb, bufferevent_event_cb ecb, void* arg)
+    // L reads what R writes on ring 1, R reads what L writes on ring 0
+    bool CreateL(CContex& ctx, std::function<void()> cb)
     {
-        m_bvs[0] = ctx.Bvsocket(m_fds[0], rcb, wcb, ecb, arg, nullptr, false);
-        return m_bvs[0] != nullptr;
+        return m_bells[1].Register(ctx, std::move(cb));
     }
 
-    bool CreateBvR(CContex& ctx, bufferevent_data_cb rcb, bufferevent_data_cb wcb, bufferevent_event_cb ecb, void* arg)
+    bool CreateR(CContex& ctx, std::function<void()> cb)
     {
-        m_bvs[1] = ctx.Bvsocket(m_fds[1], rcb, wcb, ecb, arg, nullptr, false);
-        return m_bvs[1] != nullptr;
+        return m_bells[0].Register(ctx, std::move(cb));
     }
 
     bool IsValid()
     {
-        return m_fds[0] > 0 && m_fds[1] > 0 && m_bvs[0] && m_bvs[1];
+        return m_rings[0].IsValid() && m_rings[1].IsValid() && m_bells[0].IsValid() && m_bells[1].IsValid();
     }
 
+    // Fails on a broken channel or a message of CHANNEL_MAX_MESSAGE_LENGTH or more
     bool WriteR(const MsgType type, std::string_view data)
     {
         CheckCondition(IsValid(), false);
@@ -79,59 +108,141 @@ public:
         return write(true, type, data);
     }
 
-    std::vector<std::tuple<std::optional<MsgType>, std::optional<std::string>>> ReadR()
+    // Large messages are handed over without being copied
+    bool WriteR(const MsgType type, std::string&& data)
+    {
+        CheckCondition(IsValid(), false);
+        return write(false, type, std::move(data));
+    }
+
+    bool WriteL(const MsgType type, std::string&& data)
+    {
+        CheckCondition(IsValid(), false);
+        return write(true, type, std::move(data));
+    }
+
+    Batch ReadR()
     {
         CheckCondition(IsValid(), {});
         return read(false);
     }
 
-    std::vector<std::tuple<std::optional<MsgType>, std::optional<std::string>>> ReadL()
+    Batch ReadL()
     {
         CheckCondition(IsValid(), {});
         return read(true);
     }
 
+    static const uint32_t CHANNEL_MAX_MESSAGE_LENGTH = 64 * 1024 * 1024;
+
 private:
-    evutil_socket_t m_fds[2];
-    bufferevent* m_bvs[2];
-    static const uint16_t CHANNEL_MAX_PACKET_LENGTH = 64 * 1024 - 1;
-
-    std::vector<std::tuple<std::optional<MsgType>, std::optional<std::string>>> read(bool left_or_right)
-    {
-        static thread_local char* srcpackbuf = { nullptr };
-        if (!srcpackbuf)
-            srcpackbuf = CNEW char[CHANNEL_MAX_PACKET_LENGTH];
-        std::vector<std::tuple<std::optional<MsgType>, std::optional<std::string>>> res;
-        struct evbuffer* input = bufferevent_get_input(left_or_right ? m_bvs[0] : m_bvs[1]);
-        size_t len = evbuffer_get_length(input);
-        while (len >= sizeof(MsgData)) {
-            MsgData* msg = (MsgData*)srcpackbuf;
-            evbuffer_copyout(input, msg, sizeof(MsgData));
-            if (len < sizeof(MsgData) + msg->size)
-                break;
-            if (CHANNEL_MAX_PACKET_LENGTH < msg->size + sizeof(MsgData))
-                break;
-
-            evbuffer_remove(input, msg, msg->size + sizeof(MsgData));
-            res.push_back(std::make_tuple(msg->type, std::string(msg->data, msg->size)));
-            len = evbuffer_get_length(input);
-        }
+    // messages above CHANNEL_INLINE_LENGTH are moved to the heap and only their address goes through the ring
+    static const uint32_t CHANNEL_INLINE_LENGTH = 16 * 1024;
+    static const uint32_t CHANNEL_RING_SIZE = 1024 * 1024;
+    static const uint8_t CHANNEL_SPILLED_FLAG = 0x80;
+
+    CRingBuffer m_rings[2];
+    CDoorbell m_bells[2];
+    // producer side overflow when the consumer falls behind a full ring
+    std::list<std::pair<MsgType, std::unique_ptr<std::string>>> m_pending[2];
+    CEvent* m_retry[2] = { nullptr };
+
+    static std::string* spilled(const uint8_t type, std::string_view data)
+    {
+        CheckCondition((type & CHANNEL_SPILLED_FLAG) && data.size() == sizeof(std::string*), nullptr);
+        std::string* p = nullptr;
+        memcpy(&p, data.data(), sizeof(p));
+        return p;
+    }
+
+    static bool isValidType(const uint8_t type)
+    {
+        const auto t = MsgType(type & ~CHANNEL_SPILLED_FLAG);
+        return MsgType::Text == t || MsgType::Json == t || MsgType::Binary == t;
+    }
+
+    Batch read(bool left_or_right)
+    {
+        auto& rb = m_rings[left_or_right ? 1 : 0];
+        Batch res(&rb);
+        res.m_pos = rb.Peek([&res](const uint8_t type, std::string_view data) {
+            if (!isValidType(type)) {
+                res.m_corrupted++;
+                return;
+            }
+            if (!(type & CHANNEL_SPILLED_FLAG)) {
+                res.emplace_back(MsgType(type), data);
+                return;
+            }
+            auto p = spilled(type, data);
+            if (!p) {
+                res.m_corrupted++;
+                return;
+            }
+            res.m_spilled.emplace_back(p);
+            res.emplace_back(MsgType(type & ~CHANNEL_SPILLED_FLAG), std::string_view(*p));
+        });
         return res;
     }
 
-    bool write(bool left_or_right, const MsgType type, std::string_view data)
+    bool push(const int32_t idx, const MsgType type, std::string_view data)
+    {
+        bool wakeup = false;
+        CheckCondition(m_rings[idx].Push((uint8_t)type, data, wakeup), false);
+        if (wakeup)
+            m_bells[idx].Ring();
+        return true;
+    }
+
+    // ownership moves to the consumer once the address is in the ring
+    bool pushSpilled(const int32_t idx, const MsgType type, std::unique_ptr<std::string>& data)
+    {
+        const std::string* p = data.get();
+        CheckCondition(push(idx, MsgType((uint8_t)type | CHANNEL_SPILLED_FLAG), std::string_view((const char*)&p, sizeof(p))), false);
+        data.release();
+        return true;
+    }
+
+    bool push(const int32_t idx, const MsgType type, std::unique_ptr<std::string>& data)
     {
-        static thread_local char* srcbuffer = { nullptr };
-        if (!srcbuffer)
-            srcbuffer = CNEW char[CHANNEL_MAX_PACKET_LENGTH];
-        CheckCondition(data.size() + sizeof(MsgData) < CHANNEL_MAX_PACKET_LENGTH, false);
-        struct evbuffer* output = bufferevent_get_output(left_or_right ? m_bvs[0] : m_bvs[1]);
-        CheckCondition(output, false);
-        MsgData* msg = (MsgData*)srcbuffer;
-        msg->size = data.size();
-        msg->type = type;
-        data.copy(msg->data, data.size());
-        return -1 != evbuffer_add(output, msg, msg->size + sizeof(MsgData));
+        return data->size() > CHANNEL_INLINE_LENGTH ? pushSpilled(idx, type, data) : push(idx, type, *data);
+    }
+
+    void flush(const int32_t idx)
+    {
+        auto& pending = m_pending[idx];
+        while (!pending.empty() && push(idx, pending.front().first, pending.front().second)) {
+            pending.pop_front();
+        }
+        if (!pending.empty())
+            retry(idx);
+    }
+
+    void retry(const int32_t idx)
+    {
+        if (!m_retry[idx])
+            m_retry[idx] = CEvent::Create(-1, 0, [this, idx]() { this->flush(idx); });
+        CheckConditionVoid(m_retry[idx] && !event_pending(m_retry[idx]->Event(), EV_TIMEOUT, nullptr));
+        timeval tv = { 0, 1000 };
+        event_add(m_retry[idx]->Event(), &tv);
+    }
+
+    template <typename T>
+    bool write(bool left_or_right, const MsgType type, T&& data)
+    {
+        CheckCondition(data.size() < CHANNEL_MAX_MESSAGE_LENGTH, false);
+        const int32_t idx = left_or_right ? 0 : 1;
+        // keep ordering behind messages that are still waiting for room
+        if (!m_pending[idx].empty())
+            flush(idx);
+        if (m_pending[idx].empty() && data.size() <= CHANNEL_INLINE_LENGTH && push(idx, type, std::string_view(data)))
+            return true;
+        auto p = std::make_unique<std::string>(std::forward<T>(data));
+        if (m_pending[idx].empty() && push(idx, type, p))
+            return true;
+        m_pending[idx].emplace_back(type, std::move(p));
+        retry(idx);
+        return true;
     }
 
     DISABLE_CLASS_COPYABLE(CChannel);
@@ -36,6 +36,12 @@ public:
         return time_point_cast<microseconds>(now).time_since_epoch().count();
     }
 
+    static int64_t SteadyMs()
+    {
+        steady_clock::time_point now = steady_clock::now();
+        return time_point_cast<milliseconds>(now).time_since_epoch().count();
+    }
+
     static const int64_t ZeroClock()
     {
         std::tm tm = std::tm();
@@ -17,6 +17,7 @@
 #include <string_view>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <filesystem>
 
 #if defined(LINUX_PLATFORMOS) || defined(DARWIN_PLATFORMOS)
@@ -39,6 +39,21 @@ auto CConnection::SplitUri(const std::string& uri)
     return std::make_tuple(scheme, host, port, path);
 }
 
+std::optional<std::string> CConnection::PeerIpByFd(const int32_t fd)
+{
+    struct sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    CheckCondition(fd > 0 && 0 == ::getpeername(fd, (struct sockaddr*)&addr, &len), std::nullopt);
+    char addrbuf[64] = { 0 };
+    if (addr.ss_family == AF_INET) {
+        evutil_inet_ntop(AF_INET, &((struct sockaddr_in*)&addr)->sin_addr, addrbuf, sizeof(addrbuf));
+    } else {
+        evutil_inet_ntop(AF_INET6, &((struct sockaddr_in6*)&addr)->sin6_addr, addrbuf, sizeof(addrbuf));
+    }
+    return addrbuf;
+}
+
 void CConnection::SetStreamTypeBySchema(const std::string& schema)
 {
     static std::map<const std::string, StreamType> STREAMMAP = {
@@ -88,6 +103,26 @@ bool CConnection::SendCmd(const void* data, const uint32_t dlen)
     return -1 != evbuffer_add(output, data, dlen);
 }
 
+bool CConnection::SendCmd(std::string&& data)
+{
+    // small payloads are cheaper to copy than to track as a chain of their own
+    if (data.size() < SEND_REFERENCE_SIZE)
+        return SendCmd(data.data(), data.size());
+    CheckCondition(m_bev, false);
+    struct evbuffer* output = bufferevent_get_output(m_bev);
+    CheckCondition(output, false);
+    auto s = CNEW std::string(std::move(data));
+    auto cleanup = [](const void*, size_t, void* arg) {
+        auto s = (std::string*)arg;
+        CDEL(s);
+    };
+    if (-1 == evbuffer_add_reference(output, s->data(), s->size(), cleanup, s)) {
+        CDEL(s);
+        return false;
+    }
+    return true;
+}
+
 bool CConnection::SendFile(const int32_t fd)
 {
     CheckCondition(m_bev, false);
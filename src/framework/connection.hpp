@@ -3,13 +3,14 @@
 #include "common.hpp"
 #include "contex.hpp"
 #include "object.hpp"
+#include "objectpool.hpp"
 #include "utils.hpp"
 #include "worker.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
 
 class CConnectionHandler;
-class CConnection : public CObject {
+class CConnection : public CObject, public CPooled<CConnection> {
     friend class CConnectionMgr;
     friend class CConnectionHandler;
     friend class CConnectionHandler;
@@ -33,6 +34,8 @@ public:
     virtual bool IsClosing();
     virtual bool Connnect(const std::string host, const uint16_t port, bool ipv4_or_ipv6 /*ipv4 is true or ipv6*/);
     virtual bool SendCmd(const void* data, const uint32_t dlen);
+    // large payloads are queued by reference and freed once written
+    bool SendCmd(std::string&& data);
     bool SendFile(const int32_t fd);
     void SetFlag(const int32_t flag) { CUtils::BitSet::Set(m_flags, flag); }
     bool IsFlag(const int32_t flag) { return CUtils::BitSet::Is(m_flags, flag); }
@@ -49,6 +52,7 @@ public:
     const std::string& Host() { return m_host; }
     const std::string& Schema() { return m_schema; }
     static auto SplitUri(const std::string& uri) -> std::tuple<std::string, std::string, std::string, std::string>;
+    static std::optional<std::string> PeerIpByFd(const int32_t fd);
     bufferevent* GetBufEvent() { return m_bev; }
     constexpr bool IsPassive() { return m_peer_port > 0; }
     const std::string& GetPeerIp() { return m_peer_ip; }
@@ -94,19 +94,59 @@ bool CConnectionHandler::Init(const int32_t fd, const std::string host)
     return CConnectionHandler::init(fd, onRead, onWrite, onError, ssl, fd > 0);
 }
 
+void CConnectionHandler::Close()
+{
+    m_conn->SetFlag(CConnection::ConnectionFlags_Closing);
+    if (auto bev = m_conn->GetBufEvent(); bev && evbuffer_get_length(bufferevent_get_output(bev)) > 0)
+        return;
+    if (m_event_callback) {
+        m_event_callback(EnumConnEventType::EnumConnEventType_Closed);
+        m_event_callback = nullptr;
+    }
+    delete this;
+}
+
+void CConnectionHandler::Abort()
+{
+    m_conn->SetFlag(CConnection::ConnectionFlags_Closing);
+    if (m_event_callback) {
+        m_event_callback(EnumConnEventType::EnumConnEventType_Closed);
+        m_event_callback = nullptr;
+    }
+    delete this;
+}
+
+int64_t CConnectionHandler::Consume(struct evbuffer* input, const CReadCBFunc& cb)
+{
+    evbuffer_iovec vec[READ_IOVEC_SIZE];
+    int64_t total = 0;
+    for (;;) {
+        const int32_t n = std::min<int32_t>(evbuffer_peek(input, -1, nullptr, vec, READ_IOVEC_SIZE), READ_IOVEC_SIZE);
+        CheckCondition(n > 0, total);
+        size_t consumed = 0;
+        bool partial = false;
+        for (int32_t i = 0; i < n && !partial; ++i) {
+            if (0 == vec[i].iov_len)
+                continue;
+            auto readlen = cb(std::string_view((const char*)vec[i].iov_base, vec[i].iov_len));
+            if (readlen < 0)
+                return -1;
+            consumed += readlen;
+            partial = (size_t)readlen < vec[i].iov_len;
+        }
+        evbuffer_drain(input, consumed);
+        total += consumed;
+        if (partial || 0 == consumed)
+            return total;
+    }
+}
+
 void CConnectionHandler::onRead(struct bufferevent* bev, void* arg)
 {
     CConnectionHandler* self = (CConnectionHandler*)arg;
     struct evbuffer* input = bufferevent_get_input(bev);
     if (self->m_read_callback) {
-        auto data = (char*)evbuffer_pullup(input, -1);
-        auto dlen = evbuffer_get_length(input);
-        std::string_view sv(data, dlen);
-        auto readlen = self->m_read_callback(sv);
-        if (readlen > 0) {
-            evbuffer_drain(input, readlen);
-        } else if (readlen == 0) {
-        } else {
+        if (Consume(input, self->m_read_callback) < 0) {
             if (self->m_event_callback) {
                 self->m_event_callback(EnumConnEventType::EnumConnEventType_Closed);
                 self->m_event_callback = nullptr;
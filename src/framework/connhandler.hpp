@@ -14,7 +14,7 @@ using CReadCBFunc = std::function<int32_t(std::string_view)>;
 using CEventCBFunc = std::function<void(const EnumConnEventType)>;
 using CWriteCBFunc = std::function<void()>;
 
-class CConnectionHandler : public CObject {
+class CConnectionHandler : public CObject, public CPooled<CConnectionHandler> {
 private:
     CReadCBFunc m_read_callback = { nullptr };
     CWriteCBFunc m_write_callback = { nullptr };
@@ -35,6 +35,14 @@ public:
     CConnection* Connection() { return m_conn.get(); }
     bool InitProxy(const std::string& hostname);
     bool EnableProxy();
+    // Recycles the handler once everything queued has been written, may delete it right away
+    void Close();
+    // Recycles the handler at once, dropping what is still queued for a peer that stopped reading
+    void Abort();
+    // Feeds the chains of input to cb one by one instead of linearizing the whole buffer, drains what cb
+    // consumed and stops at the first chain cb did not consume entirely, as incremental parsers such as llhttp
+    // and nghttp2 only do to stop reading. Returns the bytes consumed or -1
+    static int64_t Consume(struct evbuffer* input, const CReadCBFunc& cb);
 };
 
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
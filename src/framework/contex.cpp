@@ -1,4 +1,5 @@
 #include "contex.hpp"
+#include "chrono.hpp"
 #include "utils.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
@@ -45,11 +46,11 @@ CContex::CContex(event_base* base)
 
 CContex::~CContex()
 {
+    Destroy();
     if (m_base) {
         event_base_free(m_base);
         m_base = nullptr;
     }
-    Destroy();
 }
 
 event_base* CContex::Base()
@@ -117,60 +118,75 @@ evhttp_connection* CContex::CreateHttpConnection(bufferevent* bev, const char* a
 
 bool CContex::AddEvent(const uint32_t id, const uint32_t t, std::function<void()> cb)
 {
-    auto it = m_em.find(id);
-    if (it != m_em.end()) {
-        UnRegister(it->second);
-    }
-
-    timeval tv;
-    tv.tv_sec = t / 1000;
-    tv.tv_usec = (t - tv.tv_sec * 1000) * 1000;
-    auto ev = Register(-1, 0, &tv, cb);
-    if (nullptr == ev)
-        return false;
-
-    m_em[id] = ev;
-    return true;
+    return addTimer(id, t, false, std::move(cb));
 }
 
 bool CContex::AddPersistEvent(const uint32_t id, const uint32_t t, std::function<void()> cb)
 {
-    auto it = m_em.find(id);
-    if (it != m_em.end()) {
-        UnRegister(it->second);
-    }
-
-    timeval tv;
-    tv.tv_sec = t / 1000;
-    tv.tv_usec = (t - tv.tv_sec * 1000) * 1000;
-    auto ev = Register(-1, EV_PERSIST, &tv, cb);
-    if (nullptr == ev)
-        return false;
-
-    m_em[id] = ev;
-    return true;
+    return addTimer(id, t, true, std::move(cb));
 }
 
 void CContex::DelEvent(const uint32_t id)
 {
-    auto it = m_em.find(id);
-    if (it != m_em.end()) {
-        UnRegister(it->second);
-        m_em.erase(it);
-    }
+    m_wheel.Del(id);
 }
 
 bool CContex::HasEvent(const uint32_t id)
 {
-    return m_em.find(id) == m_em.end() ? false : true;
+    return m_wheel.Has(id);
 }
 
 void CContex::Destroy()
 {
-    for (auto& v : m_em) {
-        UnRegister(v.second);
+    m_wheel.Clear();
+    if (m_wheel_ev) {
+        event_free(m_wheel_ev);
+        m_wheel_ev = nullptr;
+    }
+    m_wheel_next.reset();
+}
+
+bool CContex::addTimer(const uint32_t id, const uint32_t t, const bool persist, std::function<void()> cb)
+{
+    CheckCondition(m_base, false);
+    if (!m_wheel_ev) {
+        m_wheel_ev = event_new(m_base, -1, 0, CContex::onWheelTick, this);
+        CheckCondition(m_wheel_ev, false);
+    }
+    if (!m_wheel.Add(id, CChrono::SteadyMs(), t, persist, std::move(cb)))
+        return false;
+    armWheel();
+    return true;
+}
+
+// all timers of the contex share one libevent timer armed at the wheel's next expiry
+void CContex::armWheel()
+{
+    CheckConditionVoid(m_wheel_ev);
+    auto next = m_wheel.NextExpire();
+    if (!next.has_value()) {
+        event_del(m_wheel_ev);
+        m_wheel_next.reset();
+        return;
     }
-    m_em.clear();
+    if (m_wheel_next.has_value() && m_wheel_next.value() <= next.value())
+        return;
+
+    const int64_t now = CChrono::SteadyMs();
+    const uint64_t t = next.value() > (uint64_t)now ? next.value() - now : 0;
+    timeval tv;
+    tv.tv_sec = t / 1000;
+    tv.tv_usec = (t - tv.tv_sec * 1000) * 1000;
+    if (0 == event_add(m_wheel_ev, &tv))
+        m_wheel_next = next;
+}
+
+void CContex::onWheelTick(evutil_socket_t, short, void* arg)
+{
+    auto ctx = static_cast<CContex*>(arg);
+    ctx->m_wheel_next.reset();
+    ctx->m_wheel.Update(CChrono::SteadyMs());
+    ctx->armWheel();
 }
 
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
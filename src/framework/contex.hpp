@@ -13,6 +13,7 @@
 
 #include "common.hpp"
 #include "object.hpp"
+#include "timerwheel.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
 
@@ -44,14 +45,21 @@ public:
     bool AddEvent(const uint32_t id, const uint32_t t, std::function<void()> cb);
     bool AddPersistEvent(const uint32_t id, const uint32_t t, std::function<void()> cb);
     void DelEvent(const uint32_t id);
+    // A one-shot timer is gone once it fired, the libevent events the wheel replaced were kept until DelEvent
     bool HasEvent(const uint32_t id);
     void Destroy();
     evhttp_connection* CreateHttpConnection(bufferevent* bev, const char* address, unsigned short port);
 
+private:
+    bool addTimer(const uint32_t id, const uint32_t t, const bool persist, std::function<void()> cb);
+    void armWheel();
+    static void onWheelTick(evutil_socket_t, short, void*);
+
 private:
     event_base* m_base;
-    using EventMap = std::map<const uint32_t, CEvent*>;
-    EventMap m_em;
+    CTimerWheel m_wheel;
+    struct event* m_wheel_ev = { nullptr };
+    std::optional<uint64_t> m_wheel_next;
 
     DISABLE_CLASS_COPYABLE(CContex);
 };
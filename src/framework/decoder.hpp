@@ -144,6 +144,8 @@ private:
 template <>
 class CDecoder<GRPCMessageHeader> : public CObject {
 public:
+    // incremental decoder fed with Feed
+    CDecoder() = default;
     CDecoder(const char* data, const uint32_t dlen)
         : m_data(data)
         , m_dlen(dlen)
@@ -158,13 +160,64 @@ public:
         CheckCondition(offset < m_dlen, std::make_tuple(false, 0, nullptr, 0));
         h.datalen = CUtils::Ntoh32(*(uint32_t*)(m_data + offset));
         offset += sizeof(uint32_t);
-        CheckCondition(offset < m_dlen, std::make_tuple(false, 0, nullptr, 0));
+        // an empty message is all header
+        CheckCondition(offset <= m_dlen, std::make_tuple(false, 0, nullptr, 0));
         return std::make_tuple(true, h.flags, m_data + GRPC_MESSAGE_HEADER_LENGTH, h.DataSize());
     }
 
+    // Hands each complete message of data to cb(flags, message) in order, several per call and one over several
+    // calls. A message that lies whole in data is handed out in place, the bytes of one split across calls are
+    // gathered first and only valid during cb. False on a message over maxlen or when cb returns false.
+    template <typename F>
+    bool Feed(std::string_view data, const uint32_t maxlen, F&& cb)
+    {
+        while (!data.empty()) {
+            if (m_buffer.empty() && data.size() >= GRPC_MESSAGE_HEADER_LENGTH) {
+                const uint32_t len = length(data.data());
+                CheckCondition(len <= maxlen, false);
+                if (data.size() - GRPC_MESSAGE_HEADER_LENGTH >= len) {
+                    CheckCondition(cb((uint8_t)data[0], data.substr(GRPC_MESSAGE_HEADER_LENGTH, len)), false);
+                    data.remove_prefix(GRPC_MESSAGE_HEADER_LENGTH + len);
+                    continue;
+                }
+            }
+            if (m_buffer.size() < GRPC_MESSAGE_HEADER_LENGTH) {
+                const size_t n = std::min(GRPC_MESSAGE_HEADER_LENGTH - m_buffer.size(), data.size());
+                m_buffer.append(data.substr(0, n));
+                data.remove_prefix(n);
+                if (m_buffer.size() < GRPC_MESSAGE_HEADER_LENGTH)
+                    break;
+                m_need = length(m_buffer.data());
+                CheckCondition(m_need <= maxlen, false);
+            }
+            const size_t n = std::min(GRPC_MESSAGE_HEADER_LENGTH + m_need - m_buffer.size(), data.size());
+            m_buffer.append(data.substr(0, n));
+            data.remove_prefix(n);
+            if (m_buffer.size() == GRPC_MESSAGE_HEADER_LENGTH + m_need) {
+                const bool ok = cb((uint8_t)m_buffer[0], std::string_view(m_buffer).substr(GRPC_MESSAGE_HEADER_LENGTH));
+                m_buffer.clear();
+                CheckCondition(ok, false);
+            }
+        }
+        return true;
+    }
+
+    // bytes of a message that is not complete yet
+    size_t Buffered() const { return m_buffer.size(); }
+
 private:
-    const char* m_data;
-    uint32_t m_dlen;
+    static uint32_t length(const char* header)
+    {
+        uint32_t len;
+        memcpy(&len, header + sizeof(uint8_t), sizeof(len));
+        return CUtils::Ntoh32(len);
+    }
+
+private:
+    const char* m_data = { nullptr };
+    uint32_t m_dlen = { 0 };
+    std::string m_buffer;
+    uint32_t m_need = { 0 };
     DISABLE_CLASS_COPYABLE(CDecoder);
 };
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common.hpp"
+#include "contex.hpp"
+#include "object.hpp"
+#include "utils.hpp"
+
+#if defined(LINUX_PLATFORMOS)
+#include <sys/eventfd.h>
+#endif
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Wakes up the CContex it is registered on from any thread.
+// An eventfd on linux, a socketpair elsewhere.
+class CDoorbell : public CObject {
+public:
+    CDoorbell() = default;
+    ~CDoorbell()
+    {
+        if (m_ev) {
+            CDEL(m_ev);
+        }
+        for (auto fd : m_fds) {
+            if (fd >= 0)
+                evutil_closesocket(fd);
+        }
+    }
+
+    bool Create()
+    {
+        CheckCondition(m_fds[0] < 0, false);
+#if defined(LINUX_PLATFORMOS)
+        m_fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return m_fds[0] >= 0;
+#else
+        if (0 != evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds))
+            return false;
+        evutil_make_socket_nonblocking(m_fds[0]);
+        evutil_make_socket_nonblocking(m_fds[1]);
+        return true;
+#endif
+    }
+
+    // cb runs on ctx every time the bell has been rung at least once
+    bool Register(CContex& ctx, std::function<void()> cb)
+    {
+        CheckCondition(m_fds[0] >= 0 && !m_ev, false);
+        m_ev = ctx.Register(m_fds[0], EV_READ | EV_PERSIST, nullptr, [this, cb]() { this->drain(); cb(); });
+        return m_ev != nullptr;
+    }
+
+    bool IsValid() const { return nullptr != m_ev; }
+
+    void Ring()
+    {
+#if defined(LINUX_PLATFORMOS)
+        eventfd_write(m_fds[0], 1);
+#else
+        const char c = 0;
+        send(m_fds[1], &c, 1, 0);
+#endif
+    }
+
+private:
+    void drain()
+    {
+#if defined(LINUX_PLATFORMOS)
+        eventfd_t v;
+        eventfd_read(m_fds[0], &v);
+#else
+        char buf[64];
+        while (recv(m_fds[0], buf, sizeof(buf), 0) > 0) { }
+#endif
+    }
+
+private:
+    evutil_socket_t m_fds[2] = { -1, -1 };
+    CEvent* m_ev = { nullptr };
+
+    DISABLE_CLASS_COPYABLE(CDoorbell);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
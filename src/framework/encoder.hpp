@@ -93,6 +93,14 @@ template <>
 class CEncoder<GRPCMessageHeader> : public CObject {
 public:
     CEncoder() = default;
+    // the length prefix of a message of dlen bytes, for messages framed where they are written
+    static void EncodeHeader(char* out, const uint8_t flags, const uint32_t dlen)
+    {
+        const uint32_t len = CUtils::Hton32(dlen);
+        out[0] = (char)flags;
+        memcpy(out + sizeof(uint8_t), &len, sizeof(len));
+    }
+
     std::optional<std::string_view> Encode(const uint8_t flags,
         const void* data,
         const uint32_t dlen)
@@ -0,0 +1,348 @@
+#include "grpc.hpp"
+#include "argument.hpp"
+#include "encoder.hpp"
+#include "worker.hpp"
+#include "xlog.hpp"
+
+#include <zlib.h>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+namespace ghttp {
+namespace {
+// flag of a message compressed with the grpc-encoding of the call
+const uint8_t GRPC_FLAG_COMPRESSED = 0x01;
+
+// grpc-message is percent-encoded outside of printable ascii
+std::string percentEncode(std::string_view v)
+{
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(v.size());
+    for (unsigned char c : v) {
+        if (c < 0x20 || c > 0x7E || c == '%') {
+            out.push_back('%');
+            out.push_back(HEX[c >> 4]);
+            out.push_back(HEX[c & 0x0F]);
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+// zlib streams of the thread by encoding, set up on first use and ended with the thread
+struct ZStreams {
+    z_stream deflaters[(size_t)GrpcEncoding::COUNT] = {};
+    z_stream inflaters[(size_t)GrpcEncoding::COUNT] = {};
+    bool deflating[(size_t)GrpcEncoding::COUNT] = {};
+    bool inflating[(size_t)GrpcEncoding::COUNT] = {};
+    ~ZStreams()
+    {
+        for (size_t i = 0; i < (size_t)GrpcEncoding::COUNT; ++i) {
+            if (deflating[i])
+                deflateEnd(&deflaters[i]);
+            if (inflating[i])
+                inflateEnd(&inflaters[i]);
+        }
+    }
+};
+thread_local ZStreams ZSTREAMS;
+
+// gzip wraps the raw stream in its own header and trailer, deflate in the zlib ones
+int32_t windowBits(const GrpcEncoding enc)
+{
+    return enc == GrpcEncoding::GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+}
+
+z_stream* deflater(const GrpcEncoding enc)
+{
+    const size_t i = (size_t)enc;
+    z_stream* z = &ZSTREAMS.deflaters[i];
+    if (ZSTREAMS.deflating[i]) {
+        CheckCondition(Z_OK == deflateReset(z), nullptr);
+        return z;
+    }
+    CheckCondition(Z_OK == deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits(enc), 8, Z_DEFAULT_STRATEGY), nullptr);
+    ZSTREAMS.deflating[i] = true;
+    return z;
+}
+
+z_stream* inflater(const GrpcEncoding enc)
+{
+    const size_t i = (size_t)enc;
+    z_stream* z = &ZSTREAMS.inflaters[i];
+    if (ZSTREAMS.inflating[i]) {
+        CheckCondition(Z_OK == inflateReset(z), nullptr);
+        return z;
+    }
+    CheckCondition(Z_OK == inflateInit2(z, windowBits(enc)), nullptr);
+    ZSTREAMS.inflating[i] = true;
+    return z;
+}
+} // namespace
+
+std::optional<GrpcEncoding> CGrpcCodec::Parse(std::string_view name)
+{
+    if (name.empty() || name == "identity")
+        return GrpcEncoding::IDENTITY;
+    if (name == "gzip")
+        return GrpcEncoding::GZIP;
+    if (name == "deflate")
+        return GrpcEncoding::DEFLATE;
+    return std::nullopt;
+}
+
+std::string_view CGrpcCodec::Name(const GrpcEncoding enc)
+{
+    switch (enc) {
+    case GrpcEncoding::GZIP:
+        return "gzip";
+    case GrpcEncoding::DEFLATE:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+GrpcEncoding CGrpcCodec::Choose(std::string_view accept)
+{
+    bool deflate = false;
+    while (!accept.empty()) {
+        const size_t comma = accept.find(',');
+        std::string_view name = accept.substr(0, comma);
+        accept.remove_prefix(comma == std::string_view::npos ? accept.size() : comma + 1);
+        while (!name.empty() && name.front() == ' ')
+            name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ')
+            name.remove_suffix(1);
+        if (name == "gzip")
+            return GrpcEncoding::GZIP;
+        deflate = deflate || name == "deflate";
+    }
+    return deflate ? GrpcEncoding::DEFLATE : GrpcEncoding::IDENTITY;
+}
+
+bool CGrpcCodec::Compress(const GrpcEncoding enc, std::string_view in, std::string& out)
+{
+    CheckCondition(enc != GrpcEncoding::IDENTITY && enc < GrpcEncoding::COUNT, false);
+    z_stream* z = deflater(enc);
+    CheckCondition(z, false);
+    out.resize(deflateBound(z, in.size()));
+    z->next_in = (Bytef*)in.data();
+    z->avail_in = in.size();
+    z->next_out = (Bytef*)out.data();
+    z->avail_out = out.size();
+    // the bound leaves room for all of it in one go
+    CheckCondition(Z_STREAM_END == deflate(z, Z_FINISH), false);
+    out.resize(out.size() - z->avail_out);
+    return true;
+}
+
+GrpcStatus CGrpcCodec::Inflate(const GrpcEncoding enc, std::string_view in, const size_t maxlen, std::string& out)
+{
+    CheckCondition(enc != GrpcEncoding::IDENTITY && enc < GrpcEncoding::COUNT, GrpcStatus::INTERNAL);
+    z_stream* z = inflater(enc);
+    CheckCondition(z, GrpcStatus::INTERNAL);
+    z->next_in = (Bytef*)in.data();
+    z->avail_in = in.size();
+    // grows by doubling from a guess, so a bomb stops at maxlen rather than being inflated whole
+    size_t size = std::min(maxlen, std::max<size_t>(in.size() * 4, 256));
+    size_t produced = 0;
+    for (;;) {
+        out.resize(size);
+        z->next_out = (Bytef*)out.data() + produced;
+        z->avail_out = size - produced;
+        const int32_t rv = inflate(z, Z_NO_FLUSH);
+        produced = size - z->avail_out;
+        if (rv == Z_STREAM_END) {
+            out.resize(produced);
+            return GrpcStatus::OK;
+        }
+        // corrupt or truncated, the input ran out with room left
+        CheckCondition((rv == Z_OK || rv == Z_BUF_ERROR) && z->avail_out == 0, GrpcStatus::INTERNAL);
+        CheckCondition(size < maxlen, GrpcStatus::RESOURCE_EXHAUSTED);
+        size = std::min(maxlen, size * 2);
+    }
+}
+
+size_t CGrpcCodec::InflateLimit(const size_t len, const size_t maxlen)
+{
+    const uint64_t ratio = MYARGS.GrpcMaxRatio.value_or(GRPC_MAX_RATIO);
+    return ratio > 0 ? (size_t)std::min<uint64_t>(maxlen, ratio * len) : maxlen;
+}
+
+CGrpcCall::CGrpcCall(CStream* stream, const CGrpcService* service, const uint32_t maxmessage)
+    : m_stream(stream)
+    , m_service(service)
+    , m_maxmessage(maxmessage)
+{
+    auto req = stream->GetRequest();
+    m_recv_encoding = CGrpcCodec::Parse(req->GetHeaderByKey("grpc-encoding"));
+    if (MYARGS.GrpcCompressMin.value_or(GRPC_COMPRESS_MIN) > 0)
+        m_send_encoding = CGrpcCodec::Choose(req->GetHeaderByKey("grpc-accept-encoding"));
+    // goes out with the response headers, each message still says whether it is compressed
+    if (m_send_encoding != GrpcEncoding::IDENTITY)
+        stream->GetResponse()->AddHeader("grpc-encoding", CGrpcCodec::Name(m_send_encoding));
+}
+
+bool CGrpcCall::Send(std::string_view msg)
+{
+    CheckCondition(!m_finished, false);
+    auto rsp = m_stream->GetResponse();
+    if (!rsp->IsStreaming())
+        CheckCondition(rsp->Begin(HttpStatusCode::OK), false);
+    uint8_t flags = 0;
+    if (m_send_encoding != GrpcEncoding::IDENTITY && msg.size() >= MYARGS.GrpcCompressMin.value_or(GRPC_COMPRESS_MIN)) {
+        thread_local std::string compressed;
+        // a message compression does not shrink goes as it is
+        if (CGrpcCodec::Compress(m_send_encoding, msg, compressed) && compressed.size() < msg.size()) {
+            if (CWorker::LOCAL_WORKER)
+                CWorker::LOCAL_WORKER->AddGrpcSaved(msg.size() - compressed.size());
+            msg = compressed;
+            flags = GRPC_FLAG_COMPRESSED;
+        }
+    }
+    char head[GRPC_MESSAGE_HEADER_LENGTH];
+    CEncoder<GRPCMessageHeader>::EncodeHeader(head, flags, msg.size());
+    return rsp->Write(std::string_view(head, sizeof(head)), msg);
+}
+
+bool CGrpcCall::Finish(const GrpcStatus status, std::string_view message)
+{
+    CheckCondition(!m_finished, false);
+    m_finished = true;
+    return trailers(status, message);
+}
+
+bool CGrpcCall::trailers(const GrpcStatus status, std::string_view message)
+{
+    auto rsp = m_stream->GetResponse();
+    // an http2 response is 200 whatever the status of the call, which comes in its trailers
+    if (!rsp->IsStreaming())
+        CheckCondition(rsp->Begin(HttpStatusCode::OK), false);
+    char code[12];
+    auto [end, _] = std::to_chars(code, code + sizeof(code), (uint32_t)status);
+    rsp->AddTrailer("grpc-status", std::string_view(code, end - code));
+    if (!message.empty())
+        rsp->AddTrailer("grpc-message", percentEncode(message));
+    return rsp->End();
+}
+
+bool CGrpcCall::Writable()
+{
+    CheckCondition(!m_finished, false);
+    auto rsp = m_stream->GetResponse();
+    return !rsp->IsStreaming() || rsp->Writable();
+}
+
+void CGrpcCall::OnDrain(std::function<void(CGrpcCall*)> cb)
+{
+    m_stream->GetResponse()->OnDrain([this, cb = std::move(cb)](CResponse*) { cb(this); });
+}
+
+void CGrpcCall::SetDeadline(const uint64_t deadline, const uint32_t id)
+{
+    m_deadline = deadline;
+    m_deadline_id = id;
+}
+
+bool CGrpcCall::Start()
+{
+    CheckCondition(m_service->onstart, true);
+    return handled(m_service->onstart(this));
+}
+
+bool CGrpcCall::OnData(std::string_view data)
+{
+    // messages arriving after the call finished have nobody to go to
+    CheckCondition(!m_finished, true);
+    const bool ok = m_decoder.Feed(data, m_maxmessage, [this](const uint8_t flags, std::string_view msg) {
+        if (flags & GRPC_FLAG_COMPRESSED) {
+            if (!m_recv_encoding || m_recv_encoding == GrpcEncoding::IDENTITY) {
+                Finish(GrpcStatus::UNIMPLEMENTED, "message compressed with an unsupported grpc-encoding");
+                return false;
+            }
+            thread_local std::string inflated;
+            const auto status = CGrpcCodec::Inflate(m_recv_encoding.value(), msg, CGrpcCodec::InflateLimit(msg.size(), m_maxmessage), inflated);
+            if (status != GrpcStatus::OK) {
+                Finish(status, status == GrpcStatus::RESOURCE_EXHAUSTED ? "decompressed message larger than the limit" : "corrupt compressed message");
+                return false;
+            }
+            msg = inflated;
+        }
+        if (!m_service->onmessage) {
+            Finish(GrpcStatus::UNIMPLEMENTED, "method takes no messages");
+            return false;
+        }
+        return handled(m_service->onmessage(this, msg)) && !m_finished;
+    });
+    if (!ok && !m_finished)
+        Finish(GrpcStatus::RESOURCE_EXHAUSTED, "message larger than the limit");
+    return ok;
+}
+
+bool CGrpcCall::OnHalfClose()
+{
+    m_halfclosed = true;
+    CheckCondition(!m_finished, true);
+    if (m_decoder.Buffered() > 0)
+        return Finish(GrpcStatus::INTERNAL, "stream ended within a message");
+    CheckCondition(m_service->onhalfclose, true);
+    return handled(m_service->onhalfclose(this));
+}
+
+void CGrpcCall::OnCancel()
+{
+    CheckConditionVoid(!m_finished);
+    m_finished = true;
+    if (m_service->oncancel)
+        m_service->oncancel(this);
+}
+
+void CGrpcCall::OnDeadline()
+{
+    CheckConditionVoid(!m_finished);
+    SPDLOG_DEBUG("{} grpc call {} past its deadline", __FUNCTION__, GetRequest()->GetPath());
+    m_finished = true;
+    if (m_service->oncancel)
+        m_service->oncancel(this);
+    // last, the end of the response may close the stream and free the call
+    trailers(GrpcStatus::DEADLINE_EXCEEDED, "deadline exceeded");
+}
+
+std::optional<uint64_t> CGrpcCall::ParseTimeout(std::string_view v)
+{
+    // at most 8 digits and a unit
+    CheckCondition(v.size() >= 2 && v.size() <= 9, std::nullopt);
+    uint64_t n = 0;
+    const char* last = v.data() + v.size() - 1;
+    auto [end, ec] = std::from_chars(v.data(), last, n);
+    CheckCondition(ec == std::errc() && end == last, std::nullopt);
+    switch (v.back()) {
+    case 'H':
+        return n * 3600000;
+    case 'M':
+        return n * 60000;
+    case 'S':
+        return n * 1000;
+    case 'm':
+        return n;
+    case 'u':
+        return (n + 999) / 1000;
+    case 'n':
+        return (n + 999999) / 1000000;
+    default:
+        return std::nullopt;
+    }
+}
+
+bool CGrpcCall::handled(const bool ok)
+{
+    if (!ok && !m_finished)
+        Finish(GrpcStatus::INTERNAL);
+    return ok;
+}
+}
+
+NAMESPACE_FRAMEWORK_END
@@ -0,0 +1,122 @@
+#pragma once
+#include "common.hpp"
+#include "decoder.hpp"
+#include "httpmsg.hpp"
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+namespace ghttp {
+// status of a finished call, sent as the grpc-status trailer
+enum class GrpcStatus : uint32_t {
+    OK = 0,
+    CANCELLED = 1,
+    UNKNOWN = 2,
+    INVALID_ARGUMENT = 3,
+    DEADLINE_EXCEEDED = 4,
+    NOT_FOUND = 5,
+    ALREADY_EXISTS = 6,
+    PERMISSION_DENIED = 7,
+    RESOURCE_EXHAUSTED = 8,
+    FAILED_PRECONDITION = 9,
+    ABORTED = 10,
+    OUT_OF_RANGE = 11,
+    UNIMPLEMENTED = 12,
+    INTERNAL = 13,
+    UNAVAILABLE = 14,
+    DATA_LOSS = 15,
+    UNAUTHENTICATED = 16,
+};
+
+// message compression of a call, named by grpc-encoding, deflate being the zlib format
+enum class GrpcEncoding : uint8_t {
+    IDENTITY = 0,
+    DEFLATE,
+    GZIP,
+    COUNT,
+};
+
+// Compresses and inflates grpc messages with zlib streams kept per thread, reset between messages rather than set
+// up for each one, into buffers of the caller whose capacity carries over as well
+class CGrpcCodec {
+public:
+    static std::optional<GrpcEncoding> Parse(std::string_view name);
+    static std::string_view Name(const GrpcEncoding enc);
+    // the encoding to answer with from a grpc-accept-encoding list, gzip first and identity without a match
+    static GrpcEncoding Choose(std::string_view accept);
+    static bool Compress(const GrpcEncoding enc, std::string_view in, std::string& out);
+    // OK, RESOURCE_EXHAUSTED once the output would pass maxlen, INTERNAL on corrupt input
+    static GrpcStatus Inflate(const GrpcEncoding enc, std::string_view in, const size_t maxlen, std::string& out);
+    // bytes a compressed message of len may inflate to, grpcmaxratio times len and at most maxlen
+    static size_t InflateLimit(const size_t len, const size_t maxlen);
+};
+
+class CGrpcCall;
+// Handlers of one grpc method. onmessage runs for every message of the client once its length prefixed frame is
+// complete, onhalfclose when the client stopped sending and oncancel when the call ends without Finish, reset by the
+// client or past its deadline. Unary and server streaming methods answer from onmessage, client streaming ones from
+// onhalfclose, bidi streaming ones from both or later from elsewhere. A handler returning false without having
+// finished the call finishes it with INTERNAL.
+struct CGrpcService {
+    std::function<bool(CGrpcCall*)> onstart = { nullptr };
+    std::function<bool(CGrpcCall*, std::string_view)> onmessage = { nullptr };
+    std::function<bool(CGrpcCall*)> onhalfclose = { nullptr };
+    std::function<void(CGrpcCall*)> oncancel = { nullptr };
+    // bytes one message may have, 0 for the body limit of the server
+    uint32_t maxmessage = { 0 };
+};
+
+// One call of a grpc method on an http2 stream, valid until Finish or oncancel. Messages are handed to the service
+// in place in the received DATA, a protobuf message parses straight from the view (ParseFromArray), only messages
+// split across DATA frames are gathered first. Messages sent go out as DATA frames within the flow control window,
+// the status as trailers after them. Messages compressed by the client with its grpc-encoding are inflated first,
+// bounded by the message limit and by grpcmaxratio times their compressed size. Sent messages from grpccompressmin
+// bytes are compressed with the first of gzip and deflate the client accepts, when that makes them smaller.
+class CGrpcCall {
+public:
+    CGrpcCall(CStream* stream, const CGrpcService* service, const uint32_t maxmessage);
+    ~CGrpcCall() = default;
+    CRequest* GetRequest() { return m_stream->GetRequest(); }
+    // the response headers leave with the first message or with Finish
+    bool Send(std::string_view msg);
+    bool Finish(const GrpcStatus status, std::string_view message = {});
+    bool IsFinished() const { return m_finished; }
+    bool IsHalfClosed() const { return m_halfclosed; }
+    // false once sent messages reach the watermark, OnDrain tells when to go on
+    bool Writable();
+    void OnDrain(std::function<void(CGrpcCall*)> cb);
+    // steady milliseconds by which the client wants its answer, from grpc-timeout
+    std::optional<uint64_t> GetDeadline() const { return m_deadline; }
+
+    // driven by the connection
+    void SetDeadline(const uint64_t deadline, const uint32_t id);
+    uint32_t GetDeadlineId() const { return m_deadline_id; }
+    bool Start();
+    bool OnData(std::string_view data);
+    bool OnHalfClose();
+    void OnCancel();
+    void OnDeadline();
+    // milliseconds of a grpc-timeout value, rounded up
+    static std::optional<uint64_t> ParseTimeout(std::string_view v);
+
+private:
+    // finishes with INTERNAL a call its handler failed without finishing it
+    bool handled(const bool ok);
+    // ends the response with the status, the call may be gone once it returns
+    bool trailers(const GrpcStatus status, std::string_view message);
+
+private:
+    CStream* m_stream = { nullptr };
+    const CGrpcService* m_service = { nullptr };
+    uint32_t m_maxmessage = { 0 };
+    CDecoder<GRPCMessageHeader> m_decoder;
+    // of the messages of the client, none when it named an encoding we lack
+    std::optional<GrpcEncoding> m_recv_encoding;
+    GrpcEncoding m_send_encoding = { GrpcEncoding::IDENTITY };
+    std::optional<uint64_t> m_deadline;
+    uint32_t m_deadline_id = { 0 };
+    bool m_finished = { false };
+    bool m_halfclosed = { false };
+};
+}
+
+NAMESPACE_FRAMEWORK_END
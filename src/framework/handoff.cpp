@@ -0,0 +1,221 @@
+#include "handoff.hpp"
+#include "argument.hpp"
+#include "utils.hpp"
+#include "xlog.hpp"
+
+#include "nlohmann/json.hpp"
+
+#if defined(LINUX_PLATFORMOS)
+#include <sys/un.h>
+#endif
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+#if defined(LINUX_PLATFORMOS)
+static bool makeUnixAddr(const std::string& path, sockaddr_un& addr)
+{
+    CheckCondition(!path.empty() && path.size() < sizeof(addr.sun_path), false);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    return true;
+}
+#endif
+
+bool CHandoff::Receive(const std::string& path)
+{
+#if defined(LINUX_PLATFORMOS)
+    sockaddr_un addr;
+    CheckCondition(makeUnixAddr(path, addr), false);
+    int32_t fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CheckCondition(fd >= 0, false);
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        evutil_closesocket(fd);
+        return false;
+    }
+    timeval tv = { HANDOFF_TIMEOUT, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    char buf[HANDOFF_BUFFER_SIZE];
+    char ctrl[CMSG_SPACE(sizeof(int32_t) * HANDOFF_MAX_FDS)];
+    iovec iov = { buf, sizeof(buf) };
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    auto n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    evutil_closesocket(fd);
+    if (n <= 0) {
+        SPDLOG_ERROR("CTX:{} handoff receive from {} fail {}", MYARGS.CTXID, path, strerror(errno));
+        return false;
+    }
+
+    std::vector<int32_t> fds;
+    for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+            const size_t cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+            const size_t off = fds.size();
+            fds.resize(off + cnt);
+            memcpy(fds.data() + off, CMSG_DATA(cmsg), cnt * sizeof(int32_t));
+        }
+    }
+    std::vector<std::string> hosts;
+    try {
+        hosts = nlohmann::json::parse(std::string_view(buf, n)).get<std::vector<std::string>>();
+    } catch (const nlohmann::json::exception& e) {
+        SPDLOG_ERROR("CTX:{} handoff invalid message {}", MYARGS.CTXID, e.what());
+    }
+    if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || hosts.size() != fds.size()) {
+        SPDLOG_ERROR("CTX:{} handoff got {} sockets for {} hosts", MYARGS.CTXID, fds.size(), hosts.size());
+        for (auto v : fds)
+            evutil_closesocket(v);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < fds.size(); ++i) {
+            m_inherited.emplace(hosts[i], fds[i]);
+        }
+    }
+    SPDLOG_INFO("CTX:{} handoff inherited {} listening sockets from {}", MYARGS.CTXID, fds.size(), path);
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::optional<int32_t> CHandoff::Take(const std::string& host)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_inherited.find(host);
+    CheckCondition(it != m_inherited.end(), std::nullopt);
+    auto fd = it->second;
+    m_inherited.erase(it);
+    return fd;
+}
+
+bool CHandoff::Serve(const std::string& path, std::function<void()> cb)
+{
+    // sockets nobody asked for, e.g. a host removed from the config
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& [_, fd] : m_inherited) {
+            evutil_closesocket(fd);
+        }
+        m_inherited.clear();
+    }
+#if defined(LINUX_PLATFORMOS)
+    sockaddr_un addr;
+    CheckCondition(m_fd < 0 && makeUnixAddr(path, addr), false);
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    CheckCondition(m_fd >= 0, false);
+    // the previous generation keeps its socket open but the path belongs to us from now on
+    ::unlink(path.c_str());
+    if (::bind(m_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(m_fd, 1) < 0) {
+        SPDLOG_ERROR("CTX:{} handoff listen on {} fail {}", MYARGS.CTXID, path, strerror(errno));
+        evutil_closesocket(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_path = path;
+    m_callback = std::move(cb);
+    m_ev = CContex::MAIN_CONTEX->Register(m_fd, EV_READ | EV_PERSIST, nullptr, [this]() { this->onAccept(); });
+    return m_ev != nullptr;
+#else
+    return false;
+#endif
+}
+
+void CHandoff::Destroy()
+{
+    if (m_ev) {
+        CContex::MAIN_CONTEX->UnRegister(m_ev);
+        m_ev = nullptr;
+    }
+    if (m_fd >= 0) {
+        evutil_closesocket(m_fd);
+        m_fd = -1;
+    }
+    // after a handoff the path is owned by the new process
+    if (!m_handed && !m_path.empty())
+        ::unlink(m_path.c_str());
+    m_path.clear();
+}
+
+void CHandoff::Add(const std::string& host, const int32_t fd)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listeners.emplace_back(host, fd);
+}
+
+void CHandoff::Remove(const int32_t fd)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listeners.erase(std::remove_if(m_listeners.begin(), m_listeners.end(), [fd](const auto& v) { return v.second == fd; }), m_listeners.end());
+}
+
+void CHandoff::onAccept()
+{
+#if defined(LINUX_PLATFORMOS)
+    int32_t fd = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    CheckConditionVoid(fd >= 0);
+    const bool ok = send(fd);
+    evutil_closesocket(fd);
+    CheckConditionVoid(ok);
+    m_handed = true;
+    // the event is running, it is freed in Destroy
+    event_del(m_ev->Event());
+    evutil_closesocket(m_fd);
+    m_fd = -1;
+    if (m_callback)
+        m_callback();
+#endif
+}
+
+bool CHandoff::send(const int32_t fd)
+{
+#if defined(LINUX_PLATFORMOS)
+    std::vector<std::string> hosts;
+    std::vector<int32_t> fds;
+    {
+        // the workers keep accepting on them until the new process is up
+        std::lock_guard<std::mutex> lock(m_mutex);
+        CheckCondition(m_listeners.size() <= HANDOFF_MAX_FDS, false);
+        for (auto& [host, v] : m_listeners) {
+            hosts.push_back(host);
+            fds.push_back(v);
+        }
+    }
+    const std::string payload = nlohmann::json(hosts).dump();
+    CheckCondition(payload.size() <= HANDOFF_BUFFER_SIZE, false);
+
+    char ctrl[CMSG_SPACE(sizeof(int32_t) * HANDOFF_MAX_FDS)];
+    memset(ctrl, 0, sizeof(ctrl));
+    iovec iov = { (void*)payload.data(), payload.size() };
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty()) {
+        msg.msg_control = ctrl;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int32_t) * fds.size());
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int32_t) * fds.size());
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int32_t) * fds.size());
+    }
+    if (::sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)payload.size()) {
+        SPDLOG_ERROR("CTX:{} handoff send fail {}", MYARGS.CTXID, strerror(errno));
+        return false;
+    }
+    SPDLOG_INFO("CTX:{} handoff {} listening sockets to the new process", MYARGS.CTXID, fds.size());
+    return true;
+#else
+    return false;
+#endif
+}
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.hpp"
+#include "contex.hpp"
+#include "object.hpp"
+#include "singleton.hpp"
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Hands the listening sockets of a thread to a newly started process over a unix socket (SCM_RIGHTS).
+// The new process accepts on the very same sockets, so nothing queued in the backlog is lost
+// and there is no window where connections are refused.
+// One per process: the main thread serves the handoff while reuseport workers open their own listeners.
+class CHandoff : public CObject, public CSingleton<CHandoff> {
+public:
+    friend class CSingleton<CHandoff>;
+    CHandoff() = default;
+    ~CHandoff() = default;
+
+    // New process, before listening. Fails quietly when no older process serves the path
+    bool Receive(const std::string& path);
+    std::optional<int32_t> Take(const std::string& host);
+    // Old process, on the main thread. cb runs once the sockets have been handed over
+    bool Serve(const std::string& path, std::function<void()> cb);
+    void Destroy();
+
+    // Thread safe, listeners of any thread are handed over
+    void Add(const std::string& host, const int32_t fd);
+    void Remove(const int32_t fd);
+
+private:
+    void onAccept();
+    bool send(const int32_t fd);
+
+private:
+    static const uint32_t HANDOFF_MAX_FDS = 64;
+    static const uint32_t HANDOFF_BUFFER_SIZE = 8192;
+    static const uint32_t HANDOFF_TIMEOUT = 3;
+
+    std::mutex m_mutex;
+    std::multimap<std::string, int32_t> m_inherited;
+    std::vector<std::pair<std::string, int32_t>> m_listeners;
+    evutil_socket_t m_fd = { -1 };
+    CEvent* m_ev = { nullptr };
+    std::string m_path;
+    bool m_handed = { false };
+    std::function<void()> m_callback = { nullptr };
+
+    DISABLE_CLASS_COPYABLE(CHandoff);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,199 @@
+#pragma once
+#include "common.hpp"
+#include "utils.hpp"
+
+#include <array>
+#include <vector>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+namespace ghttp {
+// FNV-1a over the lowercased name, usable at compile time for well known headers
+constexpr uint32_t HeaderHash(std::string_view name, uint32_t h = 2166136261u)
+{
+    for (auto c : name) {
+        h ^= (uint8_t)((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct CHttpHeaderKey {
+    constexpr explicit CHttpHeaderKey(std::string_view n)
+        : name(n)
+        , hash(HeaderHash(n))
+    {
+    }
+    std::string_view name;
+    uint32_t hash;
+};
+
+inline constexpr CHttpHeaderKey HEADER_CONTENT_TYPE { "content-type" };
+inline constexpr CHttpHeaderKey HEADER_CONTENT_LENGTH { "content-length" };
+inline constexpr CHttpHeaderKey HEADER_AUTHORIZATION { "authorization" };
+inline constexpr CHttpHeaderKey HEADER_CONNECTION { "connection" };
+inline constexpr CHttpHeaderKey HEADER_UPGRADE { "upgrade" };
+inline constexpr CHttpHeaderKey HEADER_SEC_WEBSOCKET_KEY { "sec-websocket-key" };
+inline constexpr CHttpHeaderKey HEADER_SEC_WEBSOCKET_ACCEPT { "sec-websocket-accept" };
+
+// Header table of a request or response. Names and values are copied once into an arena that keeps its
+// capacity across Clear, entries are offsets into it, the first HTTP_HEADER_INLINE of them stored inline.
+// Names are lowercased on the way in and looked up case insensitively by hash. Views handed out stay valid
+// until the table is modified.
+class CHttpHeaders {
+    struct Entry {
+        uint32_t koff;
+        uint32_t klen;
+        uint32_t voff;
+        uint32_t vlen;
+        uint32_t hash;
+    };
+    enum class State : uint8_t {
+        NONE,
+        KEY,
+        VALUE,
+    };
+
+public:
+    class Iterator {
+    public:
+        Iterator(const CHttpHeaders* h, size_t i)
+            : m_h(h)
+            , m_i(i)
+        {
+        }
+        std::pair<std::string_view, std::string_view> operator*() const { return { m_h->key(m_h->at(m_i)), m_h->value(m_h->at(m_i)) }; }
+        Iterator& operator++()
+        {
+            ++m_i;
+            return *this;
+        }
+        bool operator!=(const Iterator& o) const { return m_i != o.m_i; }
+
+    private:
+        const CHttpHeaders* m_h;
+        size_t m_i;
+    };
+
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, m_count); }
+    size_t Size() const { return m_count; }
+    bool Empty() const { return 0 == m_count; }
+
+    void Clear()
+    {
+        m_arena.clear();
+        m_spill.clear();
+        m_count = 0;
+        m_state = State::NONE;
+    }
+
+    // parser side: a name and its value may arrive in several pieces, names are continued until a value,
+    // possibly empty, is appended
+    void AppendKey(std::string_view k)
+    {
+        if (m_state != State::KEY) {
+            reserve();
+            push({ (uint32_t)m_arena.size(), 0, (uint32_t)m_arena.size(), 0, HeaderHash("") });
+            m_state = State::KEY;
+        }
+        auto& e = at(m_count - 1);
+        appendLower(k);
+        e.klen += k.size();
+        e.hash = HeaderHash(k, e.hash);
+        e.voff = m_arena.size();
+    }
+
+    void AppendValue(std::string_view v)
+    {
+        CheckConditionVoid(m_count > 0 && m_state != State::NONE);
+        m_state = State::VALUE;
+        m_arena.append(v);
+        at(m_count - 1).vlen += v.size();
+    }
+
+    // replaces the value of an existing header
+    void Set(std::string_view k, std::string_view v)
+    {
+        reserve();
+        m_state = State::NONE;
+        if (auto i = find(HeaderHash(k), k); i < m_count) {
+            at(i).voff = m_arena.size();
+            at(i).vlen = v.size();
+            m_arena.append(v);
+            return;
+        }
+        Entry e = { (uint32_t)m_arena.size(), (uint32_t)k.size(), 0, (uint32_t)v.size(), HeaderHash(k) };
+        appendLower(k);
+        e.voff = m_arena.size();
+        m_arena.append(v);
+        push(e);
+    }
+
+    std::string_view Get(std::string_view k) const { return Get(CHttpHeaderKey(k)); }
+    std::string_view Get(const CHttpHeaderKey& k) const
+    {
+        auto i = find(k.hash, k.name);
+        return i < m_count ? value(at(i)) : std::string_view();
+    }
+    bool Has(std::string_view k) const { return Has(CHttpHeaderKey(k)); }
+    bool Has(const CHttpHeaderKey& k) const { return find(k.hash, k.name) < m_count; }
+
+private:
+    Entry& at(size_t i) { return i < HTTP_HEADER_INLINE ? m_inline[i] : m_spill[i - HTTP_HEADER_INLINE]; }
+    const Entry& at(size_t i) const { return i < HTTP_HEADER_INLINE ? m_inline[i] : m_spill[i - HTTP_HEADER_INLINE]; }
+    std::string_view key(const Entry& e) const { return std::string_view(m_arena.data() + e.koff, e.klen); }
+    std::string_view value(const Entry& e) const { return std::string_view(m_arena.data() + e.voff, e.vlen); }
+
+    void push(const Entry& e)
+    {
+        if (m_count < HTTP_HEADER_INLINE)
+            m_inline[m_count] = e;
+        else
+            m_spill.push_back(e);
+        ++m_count;
+    }
+
+    void reserve()
+    {
+        if (m_arena.capacity() < HTTP_HEADER_ARENA_SIZE)
+            m_arena.reserve(HTTP_HEADER_ARENA_SIZE);
+    }
+
+    void appendLower(std::string_view k)
+    {
+        for (auto c : k)
+            m_arena.push_back((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c);
+    }
+
+    // index of the header or m_count, the last one wins when a header is repeated
+    size_t find(const uint32_t hash, std::string_view k) const
+    {
+        for (size_t i = m_count; i > 0; --i) {
+            auto& e = at(i - 1);
+            if (e.hash == hash && e.klen == k.size() && equalLower(key(e), k))
+                return i - 1;
+        }
+        return m_count;
+    }
+
+    static bool equalLower(std::string_view lower, std::string_view k)
+    {
+        for (size_t i = 0; i < k.size(); ++i) {
+            auto c = k[i];
+            if (lower[i] != ((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    std::string m_arena;
+    std::array<Entry, HTTP_HEADER_INLINE> m_inline;
+    std::vector<Entry> m_spill;
+    size_t m_count = { 0 };
+    State m_state = { State::NONE };
+};
+}
+
+NAMESPACE_FRAMEWORK_END
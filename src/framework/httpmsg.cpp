@@ -1,6 +1,7 @@
 #include "httpmsg.hpp"
 #include "argument.hpp"
 #include "chrono.hpp"
+#include "contex.hpp"
 #include "httpserver.hpp"
 #include "stringtool.hpp"
 #include "xlog.hpp"
@@ -228,6 +229,20 @@ static const std::map<HttpStatusCode, std::string> RESPSTR = {
     { HttpStatusCode::BADGATEWAY, "BADGATEWAY" },
 };
 
+// http/1.1 head fragments emitted as they are on every response
+static const auto STATUSLINE = []() {
+    std::unordered_map<HttpStatusCode, std::string> lines;
+    for (auto& [code, reason] : RESPSTR) {
+        lines.emplace(code, fmt::format("HTTP/1.1 {} {}\r\n", (int32_t)code, reason));
+    }
+    return lines;
+}();
+static const std::string SERVERLINE = fmt::format("server: PICO-v{}.{}\r\n", MAJOR, MINOR);
+static const std::string JSONTYPELINE = "content-type: application/json; charset=utf-8\r\n";
+static const std::string CLOSELINE = "connection: close\r\n";
+// "date: ...\r\n" of the calling thread, refreshed once a second by a timer on its context
+static thread_local std::string DATELINE;
+
 static const std::map<HttpMethod, std::string> HTTPMETHOD = {
     { HttpMethod::GET, "GET" },
     { HttpMethod::POST, "POST" },
@@ -280,18 +295,42 @@ std::optional<std::string> GetMiMe(const std::string& m)
     return std::nullopt;
 }
 
-std::string GetHttpDate()
+static void refreshHttpDate()
 {
     struct tm t;
     CChrono::GMTime(nullptr, &t);
-    return fmt::format("{:%a, %d %b %Y %H:%M:%S GMT}", t);
+    DATELINE.clear();
+    fmt::format_to(std::back_inserter(DATELINE), "date: {:%a, %d %b %Y %H:%M:%S GMT}\r\n", t);
 }
 
-std::string GetHttpServer()
+const std::string& GetHttpDateLine()
 {
-    return fmt::format("PICO-v{}.{}", MAJOR, MINOR);
+    // the context is asked for its timer rather than remembered, a new one may take the address of the last
+    auto ctx = CContex::MAIN_CONTEX.get();
+    if (!ctx || !ctx->HasEvent(HTTP_DATE_TIMER_ID)) {
+        refreshHttpDate();
+        // without a context every call formats the time again
+        if (ctx)
+            ctx->AddPersistEvent(HTTP_DATE_TIMER_ID, 1000, refreshHttpDate);
+    }
+    return DATELINE;
+}
+
+std::string_view GetHttpDate()
+{
+    std::string_view line = GetHttpDateLine();
+    line.remove_prefix(sizeof("date: ") - 1);
+    line.remove_suffix(sizeof("\r\n") - 1);
+    return line;
+}
+
+std::string_view GetHttpServer()
+{
+    std::string_view line = SERVERLINE;
+    line.remove_prefix(sizeof("server: ") - 1);
+    line.remove_suffix(sizeof("\r\n") - 1);
+    return line;
 }
-static const std::string NULLSTR = "";
 ///////////////////////////////////////////////////////////////CRequest////////////////////////////////////////////////////////
 CRequest::CRequest(CHTTPClient* con)
     : con(con)
@@ -300,9 +339,11 @@ CRequest::CRequest(CHTTPClient* con)
 
 void CRequest::Reset()
 {
-    qheaders.clear();
-    headers.clear();
+    qheaders.Clear();
+    headers.Clear();
     path.clear();
+    query.clear();
+    params.clear();
     body.clear();
     scheme.clear();
     host.clear();
@@ -323,41 +364,44 @@ void CRequest::SetUid(const int64_t uid)
     this->uid = uid;
 }
 
-const std::string& CRequest::GetQueryByKey(const std::string& key) const
+std::string_view CRequest::GetQueryByKey(std::string_view key) const
+{
+    return qheaders.Get(key);
+}
+
+std::string_view CRequest::GetHeaderByKey(std::string_view key) const
 {
-    auto it = qheaders.find(key);
-    return it != qheaders.end() ? it->second : NULLSTR;
+    return headers.Get(key);
 }
 
-const std::string& CRequest::GetHeaderByKey(const std::string& key) const
+std::string_view CRequest::GetHeaderByKey(const CHttpHeaderKey& key) const
 {
-    auto it = headers.find(key);
-    return it != headers.end() ? it->second : NULLSTR;
+    return headers.Get(key);
 }
 
 void CRequest::ClearHeader()
 {
-    headers.clear();
+    headers.Clear();
 }
 
-void CRequest::AddHeader(const std::string& key, const std::string& val)
+void CRequest::AddHeader(std::string_view key, std::string_view val)
 {
-    if (!key.empty()) {
-        headers[CStringTool::ToLower(key)] = val;
-    } else {
-        for (auto& [k, v] : headers) {
-            if (v.empty()) {
-                headers[k] = val;
-                break;
-            }
-        }
-    }
+    headers.Set(key, val);
+}
+
+void CRequest::AppendHeaderKey(std::string_view key)
+{
+    headers.AppendKey(key);
 }
 
-bool CRequest::HasHeader(const std::string& key) const
+void CRequest::AppendHeaderValue(std::string_view val)
 {
-    auto it = headers.find(key);
-    return it != headers.end();
+    headers.AppendValue(val);
+}
+
+bool CRequest::HasHeader(std::string_view key) const
+{
+    return headers.Has(key);
 }
 
 void CRequest::AppendBody(std::string_view body)
@@ -381,6 +425,33 @@ void CRequest::SetPath(const std::string& path)
     this->path = path;
 }
 
+void CRequest::AppendPath(std::string_view path)
+{
+    this->path.append(path);
+}
+
+void CRequest::SetTarget(std::string_view target)
+{
+    // the target may be the path itself, the query is taken out before the path is cut
+    auto pos = target.find('?');
+    if (pos == std::string_view::npos) {
+        query.clear();
+        path.assign(target);
+    } else {
+        query.assign(target.substr(pos + 1));
+        path.assign(target.substr(0, pos));
+    }
+}
+
+std::string_view CRequest::GetParam(std::string_view name) const
+{
+    for (auto& v : params) {
+        if (v.name == name && v.off + v.len <= path.size())
+            return std::string_view(path).substr(v.off, v.len);
+    }
+    return std::string_view();
+}
+
 void CRequest::SetMethod(HttpMethod method)
 {
     this->method = method;
@@ -403,8 +474,8 @@ void CRequest::SetScheme(const std::string& scheme)
 
 void CRequest::GetAllHeaders(std::map<std::string, std::string>& header)
 {
-    for (auto& [k, v] : this->headers) {
-        header[k] = v;
+    for (auto [k, v] : this->headers) {
+        header[std::string(k)] = v;
     }
 }
 
@@ -428,24 +499,23 @@ void CRequest::SetMinor(uint8_t minor)
     this->minor = minor;
 }
 
-const std::string& CRequest::GetConnectionHeader()
+std::string_view CRequest::GetConnectionHeader()
 {
-    static const std::string connection_close = "close";
-    static const std::string connection_keepalive = "keep-alive";
-    if (1 == major && minor < 1)
-        return GetHeaderByKey("connection").empty() ? connection_close : GetHeaderByKey("connection");
-    return GetHeaderByKey("connection").empty() ? connection_keepalive : GetHeaderByKey("connection");
+    auto connection = GetHeaderByKey(HEADER_CONNECTION);
+    if (!connection.empty())
+        return connection;
+    return (1 == major && minor < 1) ? "close" : "keep-alive";
 }
 
 bool CRequest::IsGRPC()
 {
-    return 0 == GetHeaderByKey("content-type").find("application/grpc");
+    return 0 == GetHeaderByKey(HEADER_CONTENT_TYPE).find("application/grpc");
 }
 
 std::string CRequest::DebugStr()
 {
     std::string h, debugstr;
-    for (auto& [k, v] : headers) {
+    for (auto [k, v] : headers) {
         h += fmt::format("{}: {} ", k, v);
     }
     return fmt::format("method:{} path:{} header:{} body:{}",
@@ -461,10 +531,18 @@ CResponse::CResponse(CHTTPClient* con)
 
 void CResponse::Reset()
 {
-    qheaders.clear();
-    headers.clear();
+    qheaders.Clear();
+    headers.Clear();
+    trailers.Clear();
     status = std::nullopt;
     body = std::nullopt;
+    streaming = false;
+    chunked = false;
+    closing = false;
+    ended = false;
+    pending.clear();
+    pendingoff = 0;
+    drain = nullptr;
 }
 
 CResponse* CResponse::Clone()
@@ -474,22 +552,24 @@ CResponse* CResponse::Clone()
     return self;
 }
 
-const std::string& CResponse::GetQueryByKey(const std::string& key) const
+std::string_view CResponse::GetQueryByKey(std::string_view key) const
+{
+    return qheaders.Get(key);
+}
+
+std::string_view CResponse::GetHeaderByKey(std::string_view key) const
 {
-    auto it = qheaders.find(key);
-    return it != qheaders.end() ? it->second : NULLSTR;
+    return headers.Get(key);
 }
 
-const std::string& CResponse::GetHeaderByKey(const std::string& key) const
+std::string_view CResponse::GetHeaderByKey(const CHttpHeaderKey& key) const
 {
-    auto it = headers.find(key);
-    return it != headers.end() ? it->second : NULLSTR;
+    return headers.Get(key);
 }
 
-bool CResponse::HasHeader(const std::string& key) const
+bool CResponse::HasHeader(std::string_view key) const
 {
-    auto it = headers.find(key);
-    return it != headers.end() ? true : false;
+    return headers.Has(key);
 }
 
 void CResponse::SetBody(std::string_view body)
@@ -526,29 +606,168 @@ void CResponse::SetStreamId(const int32_t streamid)
 }
 
 bool CResponse::Response(const std::pair<HttpStatusCode, std::string>& res)
+{
+    return response(res.first, res.second, nullptr);
+}
+
+bool CResponse::Response(std::pair<HttpStatusCode, std::string>&& res)
+{
+    return response(res.first, res.second, &res.second);
+}
+
+bool CResponse::response(const HttpStatusCode status, std::string_view data, std::string* owned)
 {
     if (!Conn()->IsHttp2()) {
-        const auto& contenttype = Conn()->GetStream(-1).value()->GetRequest()->GetHeaderByKey("content-type");
-        std::string httprsp = fmt::format("HTTP/1.1 {} {}\r\n", (int32_t)res.first, HttpReason(res.first).value_or(""));
-        for (auto& [k, v] : headers) {
-            httprsp += fmt::format("{}: {}\r\n", k, v);
-        }
-        httprsp += fmt::format("date: {}\r\n", GetHttpDate());
-        httprsp += fmt::format("server: {}\r\n", GetHttpServer());
-        httprsp += fmt::format("connection: {}\r\n", Conn()->GetStream(-1).value()->GetRequest()->GetConnectionHeader());
-        httprsp += fmt::format("content-type: {}\r\n", contenttype.empty() ? "application/json; charset=utf-8" : contenttype);
-        httprsp += fmt::format("content-length: {}\r\n", res.second.size());
-        httprsp += fmt::format("\r\n");
-        if (!res.second.empty()) {
-            httprsp.append(res.second);
-            SetBody(res.second);
-        }
-        return Conn()->GetConnection()->SendCmd(httprsp.data(), httprsp.size());
+        auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
+        // a draining worker or a refused request closes the connection after its last response, upgrades are left to the websocket
+        const bool closing = Conn()->IsClosing() && status != HttpStatusCode::SWITCH && Conn()->IsLastRequest(request);
+        auto& head = http1Head(status, request, closing);
+        char length[24];
+        auto [end, _] = std::to_chars(length, length + sizeof(length), data.size());
+        head.append("content-length: ").append(length, end - length).append("\r\n\r\n");
+        // pipelined responses leave in the order of their requests
+        return Conn()->Http1Response(request, closing, head, data, owned);
     } else {
-        if (!res.second.empty()) {
-            SetBody(res.second);
-        }
-        return Conn()->H2Response(Conn()->GetStream(streamid.value_or(-1)).value()->GetRequest(), res.first, {}, GetBody());
+        return Conn()->H2Response(Conn()->GetStream(streamid.value_or(-1)).value()->GetRequest(), status, {}, data, owned);
+    }
+}
+
+std::string& CResponse::http1Head(const HttpStatusCode status, CRequest* request, const bool closing)
+{
+    const auto contenttype = request->GetHeaderByKey(HEADER_CONTENT_TYPE);
+    // the head is serialized into a per thread buffer that keeps its capacity between responses
+    thread_local std::string head;
+    head.clear();
+    if (auto it = STATUSLINE.find(status); it != std::end(STATUSLINE))
+        head.append(it->second);
+    else
+        fmt::format_to(std::back_inserter(head), "HTTP/1.1 {} \r\n", (int32_t)status);
+    for (auto [k, v] : headers) {
+        head.append(k).append(": ").append(v).append("\r\n");
+    }
+    head.append(GetHttpDateLine());
+    head.append(SERVERLINE);
+    if (closing)
+        head.append(CLOSELINE);
+    else
+        head.append("connection: ").append(request->GetConnectionHeader()).append("\r\n");
+    if (contenttype.empty())
+        head.append(JSONTYPELINE);
+    else
+        head.append("content-type: ").append(contenttype).append("\r\n");
+    return head;
+}
+
+bool CResponse::Begin(const HttpStatusCode status)
+{
+    CheckCondition(!streaming, false);
+    streaming = true;
+    ended = false;
+    this->status = status;
+    if (Conn()->IsHttp2()) {
+        pending.clear();
+        pendingoff = 0;
+        Conn()->AddWriter(this);
+        return Conn()->H2Stream(this, status);
+    }
+    auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
+    // chunked transfer-encoding came with http/1.1, older clients get the whole body with its length at End
+    chunked = request->GetMajor() > 1 || request->GetMinor() > 0;
+    Conn()->AddWriter(this);
+    if (!chunked) {
+        redrain();
+        return true;
+    }
+    closing = Conn()->IsClosing() && Conn()->IsLastRequest(request);
+    auto& head = http1Head(status, request, closing);
+    head.append("transfer-encoding: chunked\r\n\r\n");
+    return Conn()->Http1Stream(request, closing, head, nullptr, false);
+}
+
+bool CResponse::Write(std::string_view data)
+{
+    CheckCondition(streaming && !ended, false);
+    // an empty chunk would end the body
+    CheckCondition(!data.empty(), true);
+    if (Conn()->IsHttp2()) {
+        pending.append(data);
+        return Conn()->H2Resume(streamid.value_or(-1));
+    }
+    if (!chunked) {
+        pending.append(data);
+        redrain();
+        return true;
+    }
+    auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
+    std::string chunk;
+    chunk.reserve(data.size() + 16);
+    fmt::format_to(std::back_inserter(chunk), "{:x}\r\n", data.size());
+    chunk.append(data).append("\r\n");
+    return Conn()->Http1Stream(request, closing, chunk, &chunk, false);
+}
+
+bool CResponse::Write(std::string_view head, std::string_view data)
+{
+    if (!Conn()->IsHttp2()) {
+        std::string both;
+        both.reserve(head.size() + data.size());
+        both.append(head).append(data);
+        return Write(both);
+    }
+    CheckCondition(streaming && !ended, false);
+    pending.append(head).append(data);
+    return Conn()->H2Resume(streamid.value_or(-1));
+}
+
+bool CResponse::End()
+{
+    CheckCondition(streaming && !ended, false);
+    ended = true;
+    Conn()->DelWriter(this);
+    if (Conn()->IsHttp2())
+        return Conn()->H2Resume(streamid.value_or(-1));
+    if (!chunked) {
+        streaming = false;
+        return response(status.value_or(HttpStatusCode::OK), pending, &pending);
+    }
+    auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
+    static const std::string LASTCHUNK = "0\r\n\r\n";
+    return Conn()->Http1Stream(request, closing, LASTCHUNK, nullptr, true);
+}
+
+bool CResponse::Writable()
+{
+    CheckCondition(streaming && !ended, false);
+    // http2 keeps what the flow control window holds back, it counts against the same watermark
+    if (Conn()->IsHttp2() && pending.size() - pendingoff >= MAX_WATERMARK_SIZE)
+        return false;
+    // a response behind an earlier request waits for its turn, the ones ready ahead of theirs count as output
+    auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
+    const auto held = Conn()->IsHttp2() ? std::optional<size_t>(0) : Conn()->PipelineHeld(request);
+    CheckCondition(held, false);
+    auto bev = Conn()->GetConnection()->GetBufEvent();
+    return bev && evbuffer_get_length(bufferevent_get_output(bev)) + held.value() < MAX_WATERMARK_SIZE;
+}
+
+void CResponse::OnDrain(std::function<void(CResponse*)> cb)
+{
+    drain = std::move(cb);
+    redrain();
+}
+
+void CResponse::redrain()
+{
+    CheckConditionVoid(drain && streaming && !ended && !chunked && con && !Conn()->IsHttp2());
+    if (auto bev = Conn()->GetConnection()->GetBufEvent(); bev)
+        bufferevent_trigger(bev, EV_WRITE, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
+}
+
+void CResponse::StreamSent(const size_t n)
+{
+    pendingoff += n;
+    if (pendingoff == pending.size()) {
+        pending.clear();
+        pendingoff = 0;
     }
 }
 
@@ -564,20 +783,21 @@ bool CResponse::SendFile(const std::string& filename)
         } else {
             auto hfd = fopen(f.c_str(), "r");
             if (hfd) {
+                auto request = req ? req : Conn()->GetStream(-1).value()->GetRequest();
                 std::string httprsp = fmt::format("HTTP/1.1 {} {}\r\n", (int32_t)HttpStatusCode::OK, HttpReason(HttpStatusCode::OK).value_or(""));
-                for (auto& [k, v] : headers) {
+                for (auto [k, v] : headers) {
                     httprsp += fmt::format("{}: {}\r\n", k, v);
                 }
-                httprsp += fmt::format("date: {}\r\n", GetHttpDate());
-                httprsp += fmt::format("server: {}\r\n", GetHttpServer());
+                httprsp += GetHttpDateLine();
+                httprsp += SERVERLINE;
                 httprsp += fmt::format("content-type: {}\r\n", mime.value());
                 httprsp += fmt::format("content-length: {}\r\n", fs::file_size(f));
-                httprsp += fmt::format("connection: {}\r\n", Conn()->GetStream(-1).value()->GetRequest()->GetConnectionHeader());
+                const bool closing = Conn()->IsClosing() && Conn()->IsLastRequest(request);
+                httprsp += fmt::format("connection: {}\r\n", closing ? "close" : request->GetConnectionHeader());
                 if (MYARGS.IsAllowOrigin && MYARGS.IsAllowOrigin.value())
                     httprsp += fmt::format("access-control-allow-origin: {}\r\n", "*");
                 httprsp += fmt::format("\r\n");
-                Conn()->GetConnection()->SendCmd(httprsp.data(), httprsp.size());
-                return Conn()->GetConnection()->SendFile(fileno(hfd));
+                return Conn()->Http1Response(request, closing, httprsp, {}, nullptr, fileno(hfd));
             } else {
                 return Response({ HttpStatusCode::NOTFOUND, HttpReason(HttpStatusCode::NOTFOUND).value_or("") });
             }
@@ -586,29 +806,30 @@ bool CResponse::SendFile(const std::string& filename)
     return Response({ HttpStatusCode::NOTFOUND, HttpReason(HttpStatusCode::NOTFOUND).value_or("") });
 }
 
-void CResponse::AddHeader(const std::string& key, const std::string& val)
+void CResponse::AddHeader(std::string_view key, std::string_view val)
 {
-    if (!key.empty()) {
-        headers[CStringTool::ToLower(key)] = val;
-    } else {
-        for (auto& [k, v] : headers) {
-            if (v.empty()) {
-                headers[k] = val;
-                break;
-            }
-        }
-    }
+    headers.Set(key, val);
+}
+
+void CResponse::AppendHeaderKey(std::string_view key)
+{
+    headers.AppendKey(key);
+}
+
+void CResponse::AppendHeaderValue(std::string_view val)
+{
+    headers.AppendValue(val);
 }
 
 bool CResponse::IsGRPC()
 {
-    return 0 == GetHeaderByKey("content-type").find("application/grpc");
+    return 0 == GetHeaderByKey(HEADER_CONTENT_TYPE).find("application/grpc");
 }
 
 std::string CResponse::DebugStr()
 {
     std::string h, debugstr;
-    for (auto& [k, v] : headers) {
+    for (auto [k, v] : headers) {
         h += fmt::format("{}: {} ", k, v);
     }
     return fmt::format("status:{} header:{} body:{}",
@@ -642,14 +863,25 @@ int32_t CHttpParser::parseHttp1Msg(CHTTPClient* session, std::string_view data)
             return 0;
         }
     }
+    if (session->IsPassive()) {
+        // the rest of a refused request is read and dropped until its response closes the connection
+        if (session->IsRefused())
+            return data.length();
+        if (session->PipelineStalled() || session->BodyPaused())
+            return 0;
+    }
     auto datalen = data.length();
     err = llhttp_execute(&m_parser, data.data(), datalen);
     if (err == HPE_OK) {
     } else {
         if (err == HPE_PAUSED_UPGRADE) {
+            // frames sent right behind the upgrade request are left to the websocket
+            datalen = llhttp_get_error_pos(&m_parser) - data.data();
             session->OnWebsocket();
             llhttp_resume_after_upgrade(&m_parser);
         } else if (err == HPE_PAUSED) {
+            // the pipeline is full or the body handler is behind, the rest is parsed once they made room
+            datalen = llhttp_get_error_pos(&m_parser) - data.data();
             llhttp_resume(&m_parser);
         } else if (err == HPE_PAUSED_H2_UPGRADE) {
             SPDLOG_INFO("http1 upgrade to http2");
@@ -3,6 +3,8 @@
 #include "common.hpp"
 #include "connection.hpp"
 #include "connhandler.hpp"
+#include "httpheader.hpp"
+#include "httprouter.hpp"
 
 #include "llhttp.h"
 
@@ -42,15 +44,18 @@ enum class HttpMethod : uint32_t {
     OPTIONS = 1 << 6,
     TRACE = 1 << 7,
     GETPOST = GET | POST,
+    ALL = DELETE | GET | HEAD | POST | PUT | CONNECT | OPTIONS | TRACE,
 };
 std::optional<const char*> HttpReason(HttpStatusCode code);
 std::optional<const char*> HttpMethodStr(HttpMethod m);
 std::optional<HttpMethod> HttpStrMethod(const std::string& m);
 std::optional<std::string> GetMiMe(const std::string& m);
-std::string GetHttpDate();
-std::string GetHttpServer();
+// cached per thread, refreshed once a second
+std::string_view GetHttpDate();
+const std::string& GetHttpDateLine();
+std::string_view GetHttpServer();
 
-class CRequest {
+class CRequest : public CPooled<CRequest> {
 public:
     CRequest(CHTTPClient* con);
     std::string DebugStr();
@@ -59,19 +64,30 @@ public:
     CHTTPClient* Conn() { return con; }
     void SetUid(const int64_t);
     std::optional<int64_t> GetUid() const { return uid; }
-    const std::string& GetQueryByKey(const std::string&) const;
-    const std::string& GetHeaderByKey(const std::string&) const;
+    std::string_view GetQueryByKey(std::string_view) const;
+    std::string_view GetHeaderByKey(std::string_view) const;
+    std::string_view GetHeaderByKey(const CHttpHeaderKey&) const;
     void SetMethod(HttpMethod);
     HttpMethod GetMethod() const { return method; }
     void ClearHeader();
-    void AddHeader(const std::string&, const std::string&);
-    bool HasHeader(const std::string&) const;
+    void AddHeader(std::string_view, std::string_view);
+    // filled piecewise by the parser without allocating per header
+    void AppendHeaderKey(std::string_view);
+    void AppendHeaderValue(std::string_view);
+    bool HasHeader(std::string_view) const;
     void SetBody(const std::string&);
     void SetBodyByView(std::string_view);
     const std::string& GetBody() const { return body; }
     void AppendBody(std::string_view);
     void SetPath(const std::string&);
     const std::string& GetPath() const { return path; }
+    void AppendPath(std::string_view);
+    // splits the request target at '?', the path is what routes are matched against
+    void SetTarget(std::string_view);
+    const std::string& GetQuery() const { return query; }
+    // captures of the route that matched the path, empty views for unknown names
+    std::string_view GetParam(std::string_view) const;
+    CHttpParams& GetParams() { return params; }
     void SetStreamId(const int32_t);
     std::optional<int32_t> GetStreamId() const { return streamid; }
     void SetFd(const int32_t);
@@ -87,16 +103,18 @@ public:
     uint8_t GetMajor() const { return major; }
     void SetMinor(uint8_t minor);
     uint8_t GetMinor() const { return minor; }
-    const std::string& GetConnectionHeader();
+    std::string_view GetConnectionHeader();
     bool IsGRPC();
 
 private:
     CHTTPClient* con = { nullptr };
     uint8_t major;
     uint8_t minor;
-    std::map<std::string, std::string> qheaders;
-    std::map<std::string, std::string> headers;
+    CHttpHeaders qheaders;
+    CHttpHeaders headers;
     std::string path;
+    std::string query;
+    CHttpParams params;
     std::string body;
     std::string scheme;
     std::string host;
@@ -107,25 +125,33 @@ private:
     std::optional<int32_t> fd;
 };
 
-class CResponse {
+class CResponse : public CPooled<CResponse> {
 public:
     CResponse(CHTTPClient* con);
     std::string DebugStr();
     void Reset();
     CResponse* Clone();
     bool Response(const std::pair<HttpStatusCode, std::string>& res);
-    void AddHeader(const std::string&, const std::string&);
+    // the body is handed over to the connection without being copied
+    bool Response(std::pair<HttpStatusCode, std::string>&& res);
+    void AddHeader(std::string_view, std::string_view);
+    void AppendHeaderKey(std::string_view);
+    void AppendHeaderValue(std::string_view);
     void SetStatus(std::optional<HttpStatusCode>);
     void SetBody(std::string_view);
     CHTTPClient* Conn() { return con; }
-    const std::string& GetQueryByKey(const std::string&) const;
-    const std::string& GetHeaderByKey(const std::string&) const;
+    // the request answered, its stream lives until the response is written
+    void SetRequest(CRequest* req) { this->req = req; }
+    CRequest* GetRequest() { return req; }
+    std::string_view GetQueryByKey(std::string_view) const;
+    std::string_view GetHeaderByKey(std::string_view) const;
+    std::string_view GetHeaderByKey(const CHttpHeaderKey&) const;
     std::optional<HttpStatusCode> GetStatus() const { return status; }
     std::optional<std::string_view> GetBody() const { return body; }
     void SetStreamId(const int32_t);
     std::optional<int32_t> GetStreamId() const { return streamid; }
     bool SendFile(const std::string&);
-    bool HasHeader(const std::string&) const;
+    bool HasHeader(std::string_view) const;
     void AppendBody(std::string_view);
     void SetMajor(uint8_t major);
     uint8_t GetMajor() const { return major; }
@@ -133,38 +159,93 @@ public:
     uint8_t GetMinor() const { return minor; }
     bool IsGRPC();
 
+    // Streaming response Api, the body leaves as it is produced instead of being sized up front: chunked
+    // transfer-encoding on http/1.1 and DATA frames on http2, http/1.0 clients still get it in one piece at End.
+    // Write accepts data beyond the watermark, a handler producing a large body stops once Writable is false and
+    // goes on from the drain callback
+    bool Begin(const HttpStatusCode status);
+    bool Write(std::string_view data);
+    // head and data as one write, such as a grpc message after its length prefix
+    bool Write(std::string_view head, std::string_view data);
+    bool End();
+    bool Writable();
+    // runs each time the connection drained its output, until End
+    void OnDrain(std::function<void(CResponse*)> cb);
+    std::function<void(CResponse*)>& GetDrain() { return drain; }
+    bool IsStreaming() const { return streaming; }
+    // http2 data provider side, DATA frames are written from what was written and not sent yet
+    std::string_view PendingStream() const { return std::string_view(pending).substr(pendingoff); }
+    void StreamSent(const size_t n);
+    bool IsEnded() const { return ended; }
+    // trailer fields of a streamed http2 response, they leave after its last DATA frame
+    void AddTrailer(std::string_view k, std::string_view v) { trailers.Set(k, v); }
+    const CHttpHeaders& GetTrailers() const { return trailers; }
+
+private:
+    bool response(const HttpStatusCode status, std::string_view data, std::string* owned);
+    std::string& http1Head(const HttpStatusCode status, CRequest* request, const bool closing);
+    // a body held until End drains nothing, the drain callback is offered the connection from the loop instead
+    void redrain();
+
 private:
     CHTTPClient* con = { nullptr };
+    CRequest* req = { nullptr };
     uint8_t major;
     uint8_t minor;
-    std::map<std::string, std::string> qheaders;
-    std::map<std::string, std::string> headers;
+    CHttpHeaders qheaders;
+    CHttpHeaders headers;
+    CHttpHeaders trailers;
     std::optional<HttpStatusCode> status;
     std::optional<std::string> body;
     std::optional<int32_t> streamid;
+    bool streaming = { false };
+    bool chunked = { false };
+    bool closing = { false };
+    bool ended = { false };
+    // written but not sent, by http2 and http/1.0
+    std::string pending;
+    size_t pendingoff = { 0 };
+    std::function<void(CResponse*)> drain = { nullptr };
 };
 
-class CStream {
+class CStream : public CPooled<CStream> {
 public:
     CStream(const int32_t streamid, CHTTPClient* conn)
         : m_stream_id(streamid)
     {
         m_req.reset(CNEW ghttp::CRequest(conn));
         m_rsp.reset(CNEW ghttp::CResponse(conn));
+        m_rsp->SetRequest(m_req.get());
         if (streamid > 0) {
             m_req->SetStreamId(streamid);
             m_rsp->SetStreamId(streamid);
         }
     }
-    ~CStream()
+    ~CStream() = default;
+    // starts over as another stream of the connection, what the request and response allocated is kept
+    void Reuse(const int32_t streamid)
     {
-        m_req.release();
-        m_req.release();
+        m_stream_id = streamid;
+        m_req->Reset();
+        m_rsp->Reset();
+        m_rsp->SetRequest(m_req.get());
+        if (streamid > 0) {
+            m_req->SetStreamId(streamid);
+            m_rsp->SetStreamId(streamid);
+        }
     }
     ghttp::CRequest* GetRequest() { return m_req.get(); }
     ghttp::CResponse* GetResponse() { return m_rsp.get(); }
-    void SetRequest(ghttp::CRequest* req) { m_req.reset(req); }
-    void SetResponse(ghttp::CResponse* rsp) { m_rsp.reset(rsp); }
+    void SetRequest(ghttp::CRequest* req)
+    {
+        m_req.reset(req);
+        m_rsp->SetRequest(req);
+    }
+    void SetResponse(ghttp::CResponse* rsp)
+    {
+        m_rsp.reset(rsp);
+        m_rsp->SetRequest(m_req.get());
+    }
     int32_t GetStreamId() { return m_stream_id; }
 
 private:
@@ -189,5 +270,7 @@ private:
 
 using HttpReqRspCallback = std::function<bool(CRequest*, CResponse*)>;
 using HttpRspCallback = std::function<bool(CResponse*)>;
+// receives the body of a request chunk by chunk instead of CRequest::GetBody, false refuses the request
+using HttpBodyCallback = std::function<bool(CRequest*, std::string_view)>;
 }
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,183 @@
+#pragma once
+#include "common.hpp"
+#include "utils.hpp"
+
+#include <vector>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+namespace ghttp {
+// A path parameter captured by the router, located by offset in the matched path so it survives copies of the request
+struct CHttpParam {
+    std::string_view name;
+    uint32_t off;
+    uint32_t len;
+};
+using CHttpParams = std::vector<CHttpParam>;
+
+// Radix tree of routes. Static runs of a pattern share their common prefixes, ":name" captures one path segment and
+// "*name" (or a bare "*") the rest of the path, so "/game/v1/user/:uid" and "/static/*file" are valid patterns.
+// Static children are tried before a parameter and a parameter before a wildcard, backtracking when a branch fails.
+// Every node carries its routes with their method masks, a path that matches a node without a route for the method
+// still reports the node so the caller can refuse the method. Patterns are copied into the tree, parameter names
+// handed out point into it and stay valid as long as the router.
+template <typename T>
+class CHttpRouter {
+    struct Route {
+        uint32_t methods;
+        T value;
+    };
+    struct Node {
+        std::string prefix;
+        // first byte of each static child, scanned before comparing whole prefixes
+        std::string indices;
+        std::vector<std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> param;
+        std::unique_ptr<Node> wildcard;
+        std::string name;
+        std::vector<Route> routes;
+    };
+
+public:
+    struct Match {
+        T* value = { nullptr };
+        // a route exists for the path but none for the method
+        bool badmethod = { false };
+    };
+
+    CHttpRouter() = default;
+    ~CHttpRouter() = default;
+
+    // false when the pattern conflicts with a parameter of another name at the same place or is malformed
+    bool Add(std::string_view pattern, const uint32_t methods, T value)
+    {
+        CheckCondition(!pattern.empty() && pattern[0] == '/', false);
+        Node* node = &m_root;
+        while (!pattern.empty()) {
+            if (pattern[0] == ':') {
+                auto end = std::min(pattern.find('/'), pattern.size());
+                auto name = pattern.substr(1, end - 1);
+                CheckCondition(!name.empty(), false);
+                if (!node->param) {
+                    node->param = std::make_unique<Node>();
+                    node->param->name = name;
+                }
+                CheckCondition(node->param->name == name, false);
+                node = node->param.get();
+                pattern.remove_prefix(end);
+            } else if (pattern[0] == '*') {
+                auto name = pattern.substr(1);
+                CheckCondition(name.find('/') == std::string_view::npos, false);
+                if (!node->wildcard) {
+                    node->wildcard = std::make_unique<Node>();
+                    node->wildcard->name = name;
+                }
+                CheckCondition(node->wildcard->name == name, false);
+                node = node->wildcard.get();
+                pattern = {};
+            } else {
+                auto run = pattern.substr(0, std::min(pattern.find_first_of(":*"), pattern.size()));
+                node = addStatic(node, run);
+                pattern.remove_prefix(run.size());
+            }
+        }
+        for (auto& v : node->routes) {
+            CheckCondition(0 == (v.methods & methods), false);
+        }
+        node->routes.push_back({ methods, std::move(value) });
+        ++m_size;
+        return true;
+    }
+
+    // path without its query string, params receive the captures of the matched route
+    Match Find(const uint32_t method, std::string_view path, CHttpParams& params)
+    {
+        params.clear();
+        Node* node = find(&m_root, path, 0, params);
+        Match m;
+        CheckCondition(node, m);
+        for (auto& v : node->routes) {
+            if (v.methods & method) {
+                m.value = &v.value;
+                return m;
+            }
+        }
+        // the first route of the path answers for a method it does not accept
+        m.value = &node->routes.front().value;
+        m.badmethod = true;
+        return m;
+    }
+
+    size_t Size() const { return m_size; }
+
+private:
+    Node* addStatic(Node* node, std::string_view run)
+    {
+        while (!run.empty()) {
+            auto i = node->indices.find(run[0]);
+            if (i == std::string::npos) {
+                auto child = std::make_unique<Node>();
+                child->prefix = run;
+                node->indices.push_back(run[0]);
+                node->children.push_back(std::move(child));
+                return node->children.back().get();
+            }
+            Node* child = node->children[i].get();
+            size_t l = 0;
+            while (l < run.size() && l < child->prefix.size() && run[l] == child->prefix[l])
+                ++l;
+            if (l < child->prefix.size()) {
+                // split the child at the end of the common prefix
+                auto mid = std::make_unique<Node>();
+                mid->prefix = child->prefix.substr(0, l);
+                child->prefix.erase(0, l);
+                mid->indices.push_back(child->prefix[0]);
+                mid->children.push_back(std::move(node->children[i]));
+                node->children[i] = std::move(mid);
+                child = node->children[i].get();
+            }
+            node = child;
+            run.remove_prefix(l);
+        }
+        return node;
+    }
+
+    Node* find(Node* node, std::string_view rest, const uint32_t off, CHttpParams& params)
+    {
+        if (rest.empty() && !node->routes.empty())
+            return node;
+        if (!rest.empty()) {
+            for (size_t i = 0; i < node->indices.size(); ++i) {
+                if (node->indices[i] != rest[0])
+                    continue;
+                auto child = node->children[i].get();
+                if (0 == rest.compare(0, child->prefix.size(), child->prefix)) {
+                    if (auto r = find(child, rest.substr(child->prefix.size()), off + child->prefix.size(), params); r)
+                        return r;
+                }
+                break;
+            }
+            if (node->param) {
+                auto end = std::min(rest.find('/'), rest.size());
+                if (end > 0) {
+                    params.push_back({ node->param->name, off, (uint32_t)end });
+                    if (auto r = find(node->param.get(), rest.substr(end), off + end, params); r)
+                        return r;
+                    params.pop_back();
+                }
+            }
+        }
+        if (node->wildcard && !node->wildcard->routes.empty()) {
+            params.push_back({ node->wildcard->name, off, (uint32_t)rest.size() });
+            return node->wildcard.get();
+        }
+        return nullptr;
+    }
+
+private:
+    Node m_root;
+    size_t m_size = { 0 };
+};
+}
+
+NAMESPACE_FRAMEWORK_END
@@ -1,5 +1,6 @@
 #include "httpserver.hpp"
 #include "argument.hpp"
+#include "chrono.hpp"
 #include "connection.hpp"
 #include "decoder.hpp"
 #include "encoder.hpp"
@@ -15,6 +16,32 @@ NAMESPACE_FRAMEWORK_BEGIN
 /////////////////////////////////////////////////////////////////////////CWebSocket/////////////////////////////////////////////////////////////
 
 namespace {
+// opaque data of the PING frames that measure the round trip for the window auto-tuning
+const uint8_t H2_BDP_PING[8] = { 'p', 'i', 'c', 'o', 'b', 'd', 'p', 0 };
+
+// a header field nghttp2 points to instead of copying, the strings have to outlive the HEADERS frame
+nghttp2_nv h2nv(std::string_view name, std::string_view value)
+{
+    return { (uint8_t*)name.data(), (uint8_t*)value.data(), name.size(), value.size(), NGHTTP2_NV_FLAG_NO_COPY_NAME | NGHTTP2_NV_FLAG_NO_COPY_VALUE };
+}
+
+const nghttp2_nv H2_JSON_TYPE = h2nv("content-type", "application/json; charset=utf-8");
+const nghttp2_nv H2_GRPC_ENCODING = h2nv("grpc-accept-encoding", "identity,deflate,gzip");
+nghttp2_nv H2_GRPC_OK[] = { h2nv("grpc-status", "0") };
+
+// ":status" values from 100 to 599 formatted once, others answer as 500
+std::string_view h2Status(const ghttp::HttpStatusCode status)
+{
+    static const std::string STATUSES = []() {
+        std::string s;
+        for (int32_t i = 100; i < 600; ++i)
+            s += std::to_string(i);
+        return s;
+    }();
+    const uint32_t code = (uint32_t)status;
+    return std::string_view(STATUSES).substr(((code >= 100 && code < 600) ? code - 100 : 400) * 3, 3);
+}
+
 int htp_msg_begin(llhttp_t* htp)
 {
     SPDLOG_DEBUG("{}", __FUNCTION__);
@@ -24,6 +51,8 @@ int htp_msg_begin(llhttp_t* htp)
     if (session->IsPassive()) {
         req->Reset();
         rsp->Reset();
+        session->SetInflight(true);
+        session->OnRequestBegin();
     } else {
         rsp->Reset();
     }
@@ -33,11 +62,20 @@ int htp_msg_begin(llhttp_t* htp)
 int htp_uricb(llhttp_t* htp, const char* data, size_t len)
 {
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
-    session->GetStream(-1).value()->GetRequest()->SetPath(std::string(data, len));
+    // the target may arrive in pieces, it is split once complete
+    session->GetStream(-1).value()->GetRequest()->AppendPath(std::string_view(data, len));
     SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string(data, len));
     return 0;
 }
 
+int htp_url_complete(llhttp_t* htp)
+{
+    CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
+    auto req = session->GetStream(-1).value()->GetRequest();
+    req->SetTarget(req->GetPath());
+    return 0;
+}
+
 // HTTP response status code
 int htp_statuscb(llhttp_t* htp, const char* at, size_t length)
 {
@@ -57,11 +95,23 @@ int htp_hdr_keycb(llhttp_t* htp, const char* data, size_t len)
 {
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
     if (session->IsPassive()) {
-        session->GetStream(-1).value()->GetRequest()->AddHeader(std::string(data, len), std::string(""));
+        session->GetStream(-1).value()->GetRequest()->AppendHeaderKey(std::string_view(data, len));
     } else {
-        session->GetStream(-1).value()->GetResponse()->AddHeader(std::string(data, len), std::string(""));
+        session->GetStream(-1).value()->GetResponse()->AppendHeaderKey(std::string_view(data, len));
+    }
+    SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string_view(data, len));
+    return 0;
+}
+
+// an empty value closes the name, so a header without value is not merged with the next name
+int htp_hdr_keycompletecb(llhttp_t* htp)
+{
+    CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
+    if (session->IsPassive()) {
+        session->GetStream(-1).value()->GetRequest()->AppendHeaderValue(std::string_view());
+    } else {
+        session->GetStream(-1).value()->GetResponse()->AppendHeaderValue(std::string_view());
     }
-    SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string(data, len));
     return 0;
 }
 
@@ -69,11 +119,11 @@ int htp_hdr_valcb(llhttp_t* htp, const char* data, size_t len)
 {
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
     if (session->IsPassive()) {
-        session->GetStream(-1).value()->GetRequest()->AddHeader(std::string(""), std::string(data, len));
+        session->GetStream(-1).value()->GetRequest()->AppendHeaderValue(std::string_view(data, len));
     } else {
-        session->GetStream(-1).value()->GetResponse()->AddHeader(std::string(""), std::string(data, len));
+        session->GetStream(-1).value()->GetResponse()->AppendHeaderValue(std::string_view(data, len));
     }
-    SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string(data, len));
+    SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string_view(data, len));
     return 0;
 }
 
@@ -81,9 +131,14 @@ int htp_hdrs_completecb(llhttp_t* htp)
 {
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
     if (session->IsPassive()) {
-        session->GetStream(-1).value()->GetRequest()->SetMethod((ghttp::HttpMethod)(1 << htp->method));
-        session->GetStream(-1).value()->GetRequest()->SetMajor(htp->http_major);
-        session->GetStream(-1).value()->GetRequest()->SetMinor(htp->http_minor);
+        auto req = session->GetStream(-1).value()->GetRequest();
+        req->SetMethod((ghttp::HttpMethod)(1 << htp->method));
+        req->SetMajor(htp->http_major);
+        req->SetMinor(htp->http_minor);
+        SPDLOG_DEBUG("{}", __FUNCTION__);
+        if ((htp->flags & F_CHUNKED) || htp->content_length > 0)
+            session->ArmDeadline(HttpDeadline::BODY);
+        return session->OnRequestHead(req, (htp->flags & F_CONTENT_LENGTH) ? std::optional<uint64_t>(htp->content_length) : std::nullopt);
     } else {
         session->GetStream(-1).value()->GetResponse()->SetMajor(htp->http_major);
         session->GetStream(-1).value()->GetResponse()->SetMinor(htp->http_minor);
@@ -100,12 +155,12 @@ int htp_hdrs_completecb(llhttp_t* htp)
 int htp_bodycb(llhttp_t* htp, const char* data, size_t len)
 {
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
+    SPDLOG_DEBUG("{} {}", __FUNCTION__, len);
     if (session->IsPassive()) {
-        session->GetStream(-1).value()->GetRequest()->AppendBody(std::string_view(data, len));
+        return session->OnRequestBody(session->GetStream(-1).value()->GetRequest(), std::string_view(data, len));
     } else {
         session->GetStream(-1).value()->GetResponse()->AppendBody(std::string_view(data, len));
     }
-    SPDLOG_DEBUG("{} {}", __FUNCTION__, std::string(data, len));
     return 0;
 }
 
@@ -113,20 +168,29 @@ int htp_msg_completecb(llhttp_t* htp)
 {
     SPDLOG_DEBUG("{}", __FUNCTION__);
     CHTTPClient* session = static_cast<CHTTPClient*>(htp->data);
-    auto req = session->GetStream(-1).value()->GetRequest();
-    auto rsp = session->GetStream(-1).value()->GetResponse();
     if (session->IsPassive()) {
-        auto filter = session->GetHttpServer()->GetFilter(req->GetPath());
+        // the request waits in the pipeline for its response while the next one is parsed
+        auto stream = session->QueueRequest();
+        auto req = stream->GetRequest();
+        auto rsp = stream->GetResponse();
+        // routed once the headers were in
+        auto filter = session->Route();
         auto cmd = (uint32_t)req->GetMethod();
         if (filter) {
-            if (0 == ((uint32_t)(filter.value()->cmd) & cmd)) {
+            if (0 == ((uint32_t)(filter->cmd) & cmd)) {
+                rsp->Response({ ghttp::HttpStatusCode::BADMETHOD, "" });
+            } else if (!filter->cb) {
+                // grpc methods are only called over http2
                 rsp->Response({ ghttp::HttpStatusCode::BADREQUEST, "" });
             } else {
-                auto r = session->GetHttpServer()->EmitEvent("start", req, rsp);
+                std::optional<std::pair<ghttp::HttpStatusCode, std::string>> r;
+                // a streamed body passed the start event before its first chunk
+                if (!session->BodyStreamed())
+                    r = session->GetHttpServer()->EmitEvent("start", req, rsp);
                 if (r) {
                     rsp->Response({ r.value().first, ghttp::HttpReason(r.value().first).value_or("") });
                 } else {
-                    auto res = filter.value()->cb(req, rsp);
+                    auto res = filter->cb(req, rsp);
                     if (res) {
                         session->GetHttpServer()->EmitEvent("finish", req, rsp);
                     }
@@ -135,6 +199,10 @@ int htp_msg_completecb(llhttp_t* htp)
         } else {
             rsp->SendFile(req->GetPath());
         }
+        session->OnRequestEnd();
+        // stop behind this request until a response makes room, an upgrade is left to the parser
+        if (!htp->upgrade && session->PipelineStalled())
+            return HPE_PAUSED;
     } else {
         session->Response(-1);
     }
@@ -158,9 +226,9 @@ constexpr llhttp_settings_t htp_hooks = {
     htp_msg_completecb, // llhttp_cb on_message_complete;
     nullptr, // llhttp_cb on_chunk_header;
     nullptr, // llhttp_cb on_chunk_complete;
-    nullptr, // llhttp_cb on_url_complete;
+    htp_url_complete, // llhttp_cb on_url_complete;
     htp_status_complete, // llhttp_cb on_status_complete;
-    nullptr, // llhttp_cb on_header_field_complete;
+    htp_hdr_keycompletecb, // llhttp_cb on_header_field_complete;
     nullptr // llhttp_cb on_header_value_complete;
 };
 } // namespace
@@ -172,8 +240,13 @@ CWebSocket* CWebSocket::Upgrade(ghttp::CResponse* rsp, Callback rdfunc)
     if (!evconn)
         return nullptr;
     auto ws = CNEW CWebSocket(evconn);
+    // the connection handler callbacks are replaced, so the listener is notified when the websocket goes away
+    ws->m_server = rsp->Conn()->GetHttpServer();
     if (auto bev = evconn->GetBufEvent(); bev) {
         bufferevent_setcb(bev, onRead, onWrite, onError, ws);
+        // bytes left behind the upgrade are parsed once the http parser has drained its part
+        if (evbuffer_get_length(bufferevent_get_input(bev)) > 0)
+            bufferevent_trigger(bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
     }
     ws->m_rdfunc = std::move(rdfunc);
     ws->m_parser.SetStatus(CWSParser::WS_STATUS::WS_CONNECTED);
@@ -181,13 +254,22 @@ CWebSocket* CWebSocket::Upgrade(ghttp::CResponse* rsp, Callback rdfunc)
     return ws;
 }
 
+thread_local std::unordered_set<CWebSocket*> CWebSocket::m_alive;
+
 CWebSocket::CWebSocket(CConnection* evconn)
     : m_evcon(evconn)
 {
+    m_alive.insert(this);
 }
 
 CWebSocket::~CWebSocket()
 {
+    m_alive.erase(this);
+    if (m_server) {
+        m_server->OnClosed();
+        if (CWorker::LOCAL_WORKER)
+            CWorker::LOCAL_WORKER->DecConnection();
+    }
     if (m_evcon) {
         auto h = m_evcon->Handler();
         CDEL(h);
@@ -227,6 +309,24 @@ bool CWebSocket::SendCmd(const CWSParser::WS_OPCODE opcode, std::string_view dat
     return false;
 }
 
+void CWebSocket::Shutdown()
+{
+    CheckConditionVoid(!m_shutdown);
+    m_shutdown = true;
+    const char code[] = { (char)(CWSParser::WS_CLOSE_GOING_AWAY >> 8), (char)(CWSParser::WS_CLOSE_GOING_AWAY & 0xff) };
+    SendCmd(CWSParser::WS_OPCODE_CLOSE, std::string_view(code, sizeof(code)));
+}
+
+void CWebSocket::DrainAll()
+{
+    // a close frame written may free its websocket, or another one from the callbacks it runs
+    std::vector<CWebSocket*> alive(m_alive.begin(), m_alive.end());
+    for (auto ws : alive) {
+        if (m_alive.count(ws))
+            ws->Shutdown();
+    }
+}
+
 void CWebSocket::onRead(struct bufferevent* bev, void* arg)
 {
     CWebSocket* ws = (CWebSocket*)arg;
@@ -234,15 +334,22 @@ void CWebSocket::onRead(struct bufferevent* bev, void* arg)
     auto obuf = bufferevent_get_output(bev);
     auto dlen = evbuffer_get_length(ibuf);
     while (dlen > 0) {
-        auto data = evbuffer_pullup(ibuf, -1);
-        auto ret = ws->m_parser.Process((const char*)data, dlen);
+        // linearize one frame at a time, the rest of the buffer stays in its chains
+        const unsigned int hlen = std::min<size_t>(dlen, CWSParser::WS_MAX_HEADER_SIZE);
+        const auto size = CWSParser::FrameSize((const char*)evbuffer_pullup(ibuf, hlen), hlen);
+        if (0 == size || (size > dlen && size < MAX_WATERMARK_SIZE))
+            return;
+        const unsigned int flen = std::min<unsigned long long>(size, dlen);
+        auto data = evbuffer_pullup(ibuf, flen);
+        auto ret = ws->m_parser.Process((const char*)data, flen);
         switch (ret) {
         case 0:
-            break;
+            return;
         case -1:
-        case -2:
+        case -2: {
             CDEL(ws);
-            break;
+            return;
+        }
         default: {
             if (ws->m_parser.IsFin()) {
                 if (ws->m_parser.IsPong()) {
@@ -285,18 +392,33 @@ void CHTTPClient::OnWebsocket()
     auto req = GetStream(-1).value()->GetRequest();
     auto rsp = GetStream(-1).value()->GetResponse();
     if (IsPassive()) {
-        const auto& seckey = req->GetHeaderByKey("sec-websocket-key");
+        // the upgrade request is the last one queued
+        CheckConditionVoid(!m_pipeline.empty());
+        req = m_pipeline.back().stream->GetRequest();
+        rsp = m_pipeline.back().stream->GetResponse();
+        // the connection cannot change hands while earlier requests still wait for their response
+        if (m_pipeline.size() > 1) {
+            rsp->Response({ ghttp::HttpStatusCode::BADREQUEST, "" });
+            return;
+        }
+        auto seckey = req->GetHeaderByKey(ghttp::HEADER_SEC_WEBSOCKET_KEY);
         if (!seckey.empty()) {
-            auto&& swsk = CWSParser::GenSecWebSocketAccept(seckey);
+            auto&& swsk = CWSParser::GenSecWebSocketAccept(std::string(seckey));
             rsp->AddHeader("Connection", "upgrade");
             rsp->AddHeader("Sec-WebSocket-Accept", swsk);
             rsp->AddHeader("Upgrade", "websocket");
             rsp->Response({ ghttp::HttpStatusCode::SWITCH, "" });
-            CWebSocket::Upgrade(rsp, m_wsfunc);
+            // the connection belongs to the websocket from now on, with the read and write timeouts of the socket
+            if (CWebSocket::Upgrade(rsp, m_wsfunc)) {
+                m_passive.erase(this);
+                DisarmDeadline();
+                struct timeval rwtv = { MYARGS.HttpTimeout.value_or(60), 0 };
+                bufferevent_set_timeouts(GetConnection()->GetBufEvent(), &rwtv, &rwtv);
+            }
             return;
         }
     } else {
-        const auto& seckey = rsp->GetHeaderByKey("sec-websocket-accept");
+        auto seckey = rsp->GetHeaderByKey(ghttp::HEADER_SEC_WEBSOCKET_ACCEPT);
         if (!seckey.empty()) {
             const auto&& key = CWSParser::GenSecWebSocketAccept(MYARGS.ConfMap["websocketkey"]);
             if (seckey == CWSParser::GenSecWebSocketAccept(key)) {
@@ -321,9 +443,17 @@ void CHTTPServer::destroy()
 {
 }
 
-bool CHTTPServer::OnConnected(std::string host, const int32_t fd)
+bool CHTTPServer::OnConnected(std::string host, const int32_t fd, const bool counted)
 {
-    CheckCondition(!host.empty(), true);
+    // a connection dispatched by main was counted there, one that does not come up is taken back
+    auto uncount = [counted]() {
+        if (counted && CWorker::LOCAL_WORKER)
+            CWorker::LOCAL_WORKER->DecConnection();
+    };
+    if (host.empty()) {
+        uncount();
+        return true;
+    }
 
     CHTTPClient* hclient = CNEW CHTTPClient();
     CConnectionHandler* h = CNEW CConnectionHandler();
@@ -341,15 +471,23 @@ bool CHTTPServer::OnConnected(std::string host, const int32_t fd)
         [hclient](const EnumConnEventType e) {
             if (e == EnumConnEventType::EnumConnEventType_Connected) {
             } else if (e == EnumConnEventType::EnumConnEventType_Closed) {
+                if (auto server = hclient->GetHttpServer(); server) {
+                    server->OnClosed();
+                    if (CWorker::LOCAL_WORKER)
+                        CWorker::LOCAL_WORKER->DecConnection();
+                }
                 delete hclient;
             }
         });
     if (h->Init(fd, host)) {
+        // the client arms its own deadlines instead of socket timeouts
         hclient->Init(h->Connection(), this);
-        struct timeval rwtv = { MYARGS.HttpTimeout.value_or(60), 0 };
-        bufferevent_set_timeouts(hclient->GetConnection()->GetBufEvent(), &rwtv, &rwtv);
+        if (!counted && CWorker::LOCAL_WORKER)
+            CWorker::LOCAL_WORKER->IncConnection();
         return true;
     }
+    uncount();
+    OnClosed();
     CDEL(hclient);
     CDEL(h);
     return false;
@@ -366,9 +504,22 @@ void CHTTPServer::ServeWs(const std::string path, CWebSocket::Callback cb)
         });
 }
 
+void CHTTPServer::ServeNotFound(const std::string path)
+{
+    Register(
+        path,
+        ghttp::HttpMethod::ALL,
+        [](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+            return rsp->Response({ ghttp::HttpStatusCode::NOTFOUND, ghttp::HttpReason(ghttp::HttpStatusCode::NOTFOUND).value_or("") });
+        });
+}
+
 bool CHTTPServer::Register(const std::string path, FilterData filter)
 {
-    m_callbacks[path] = filter;
+    if (!m_router.Add(path, (uint32_t)filter.cmd, filter)) {
+        SPDLOG_ERROR("{} conflicting route {}", __FUNCTION__, path);
+        return false;
+    }
     return true;
 }
 
@@ -378,10 +529,23 @@ bool CHTTPServer::Register(const std::string path, ghttp::HttpMethod cmd, ghttp:
     return Register(path, filter);
 }
 
-bool CHTTPServer::Emit(const std::string& path, ghttp::CRequest* req, ghttp::CResponse* rsp)
+bool CHTTPServer::Register(const std::string path, ghttp::HttpMethod cmd, ghttp::HttpReqRspCallback cb, ghttp::HttpBodyCallback bodycb, const uint64_t maxbody)
 {
-    if (auto it = m_callbacks.find(path); it != m_callbacks.end()) {
-        return it->second.cb(req, rsp);
+    FilterData filter = { .cmd = cmd, .cb = cb, .bodycb = bodycb, .maxbody = maxbody };
+    return Register(path, filter);
+}
+
+bool CHTTPServer::RegisterGrpc(const std::string path, ghttp::CGrpcService service)
+{
+    FilterData filter = { .cmd = ghttp::HttpMethod::POST, .cb = nullptr, .grpc = std::move(service) };
+    return Register(path, filter);
+}
+
+bool CHTTPServer::Emit(ghttp::CRequest* req, ghttp::CResponse* rsp)
+{
+    // the router answers with another method's route of the path, the caller refuses the request
+    if (auto filter = GetFilter(req); filter && filter.value()->cb && ((uint32_t)filter.value()->cmd & (uint32_t)req->GetMethod())) {
+        return filter.value()->cb(req, rsp);
     }
     return false;
 }
@@ -400,15 +564,23 @@ std::optional<std::pair<ghttp::HttpStatusCode, std::string>> CHTTPServer::EmitEv
     return std::nullopt;
 }
 
-std::optional<CHTTPServer::FilterData*> CHTTPServer::GetFilter(const std::string& path)
+std::optional<CHTTPServer::FilterData*> CHTTPServer::GetFilter(ghttp::CRequest* req)
 {
-    auto it = m_callbacks.find(path);
-    if (it != std::end(m_callbacks)) {
-        return std::optional<FilterData*>(&it->second);
+    // a method the route does not accept is refused by the caller from the filter's mask
+    auto m = m_router.Find((uint32_t)req->GetMethod(), req->GetPath(), req->GetParams());
+    if (m.value) {
+        return std::optional<FilterData*>(m.value);
     }
     return std::nullopt;
 }
 
+uint64_t CHTTPServer::BodyLimit(FilterData* filter)
+{
+    if (filter && filter->maxbody > 0)
+        return filter->maxbody;
+    return MYARGS.MaxBodySize.value_or(MAX_HTTP_BODY_SIZE);
+}
+
 ///////////////////////////////////////////////////////////////CHTTPClient/////////////////////////////////////////////////////////////////////////
 CHTTPClient::CHTTPClient()
 {
@@ -416,8 +588,26 @@ CHTTPClient::CHTTPClient()
     m_parser.GetParser().data = this;
 }
 
+thread_local std::unordered_set<CHTTPClient*> CHTTPClient::m_passive;
+thread_local CTimerWheel CHTTPClient::m_deadlines;
+thread_local uint32_t CHTTPClient::m_deadline_ids = { 0 };
+thread_local uint64_t CHTTPClient::m_deadline_now = { 0 };
+
 CHTTPClient::~CHTTPClient()
 {
+    m_passive.erase(this);
+    DisarmDeadline();
+    // calls of a connection that is gone end like reset ones
+    for (auto& [_, call] : m_calls) {
+        if (call->GetDeadlineId())
+            m_deadlines.Del(call->GetDeadlineId());
+        call->OnCancel();
+    }
+    // files of responses that never got their turn
+    for (auto& v : m_pipeline) {
+        if (v.fd >= 0)
+            close(v.fd);
+    }
     if (m_session)
         nghttp2_session_del(m_session);
 }
@@ -427,6 +617,386 @@ void CHTTPClient::Init(CConnection* conn, CHTTPServer* server)
     SetConnection(conn);
     SetHttpServer(server);
     m_base_stream.reset(CNEW ghttp::CStream(-1, this));
+    if (server) {
+        m_passive.insert(this);
+        ArmDeadline(HttpDeadline::IDLE);
+    }
+}
+
+ghttp::CStream* CHTTPClient::QueueRequest()
+{
+    auto stream = m_base_stream.get();
+    m_pipeline.push_back({ std::move(m_base_stream) });
+    if (!m_spare.empty()) {
+        m_base_stream = std::move(m_spare.back());
+        m_spare.pop_back();
+    } else {
+        m_base_stream.reset(CNEW ghttp::CStream(-1, this));
+    }
+    return stream;
+}
+
+bool CHTTPClient::IsLastRequest(ghttp::CRequest* req)
+{
+    return m_pipeline.empty() || m_pipeline.back().stream->GetRequest() == req;
+}
+
+std::optional<size_t> CHTTPClient::PipelineHeld(ghttp::CRequest* req)
+{
+    CheckCondition(m_pipeline.empty() || m_pipeline.front().stream->GetRequest() == req
+            || std::none_of(std::begin(m_pipeline), std::end(m_pipeline), [req](auto& v) { return v.stream->GetRequest() == req; }),
+        std::nullopt);
+    size_t held = 0;
+    for (auto& v : m_pipeline)
+        held += v.output.size();
+    return held;
+}
+
+bool CHTTPClient::PipelineStalled()
+{
+    if (m_pipeline.size() >= HTTP_PIPELINE_DEPTH)
+        m_stalled = true;
+    return m_stalled;
+}
+
+void CHTTPClient::OnRequestBegin()
+{
+    m_reading = true;
+    ArmDeadline(HttpDeadline::HEADER);
+}
+
+int CHTTPClient::OnRequestHead(ghttp::CRequest* req, std::optional<uint64_t> length)
+{
+    m_body_size = 0;
+    m_body_streamed = false;
+    auto filter = m_httpserver->GetFilter(req);
+    m_route = filter.value_or(nullptr);
+    // a declared length over the limit is refused before the body is read
+    if (length && length.value() > CHTTPServer::BodyLimit(m_route)) {
+        Refuse(ghttp::HttpStatusCode::ENTITYTOOLARGE);
+        return HPE_PAUSED;
+    }
+    if (m_route && m_route->bodycb && ((uint32_t)m_route->cmd & (uint32_t)req->GetMethod())) {
+        // the body callback only sees requests the start event lets through
+        if (auto r = m_httpserver->EmitEvent("start", req, GetStream(-1).value()->GetResponse()); r) {
+            Refuse(r.value().first);
+            return HPE_PAUSED;
+        }
+        m_body_streamed = true;
+    }
+    return 0;
+}
+
+int CHTTPClient::OnRequestBody(ghttp::CRequest* req, std::string_view chunk)
+{
+    // the body deadline is the time between two pieces, a slow upload still completes
+    ArmDeadline(HttpDeadline::BODY);
+    m_body_size += chunk.size();
+    // chunked bodies have no length up front, they are refused once they grow over the limit
+    if (m_body_size > CHTTPServer::BodyLimit(m_route)) {
+        Refuse(ghttp::HttpStatusCode::ENTITYTOOLARGE);
+        return HPE_PAUSED;
+    }
+    if (!m_body_streamed) {
+        req->AppendBody(chunk);
+        return 0;
+    }
+    if (!m_route->bodycb(req, chunk)) {
+        Refuse(ghttp::HttpStatusCode::BADREQUEST);
+        return HPE_PAUSED;
+    }
+    // the callback paused the body, the parser stops right behind this chunk
+    return m_body_paused ? HPE_PAUSED : 0;
+}
+
+void CHTTPClient::OnRequestEnd()
+{
+    m_reading = false;
+    armAfterRequest();
+}
+
+void CHTTPClient::armAfterRequest()
+{
+    if (m_pipeline.empty())
+        armIdle();
+    else if (m_pipeline.front().stream->GetResponse()->IsStreaming())
+        DisarmDeadline();
+    else
+        ArmDeadline(HttpDeadline::HANDLER);
+}
+
+void CHTTPClient::armIdle()
+{
+    // a response still leaving is bounded by its progress, the connection is only idle once the output drained
+    ArmDeadline(outputLength() > 0 ? HttpDeadline::WRITE : HttpDeadline::IDLE);
+}
+
+void CHTTPClient::afterWrite()
+{
+    if (!IsHttp2()) {
+        if (!m_reading)
+            armAfterRequest();
+    } else if (m_streams.empty()) {
+        armIdle();
+    } else {
+        // the streams left wait for their handlers or the peer's window, the drain was progress all the same
+        ArmDeadline(HttpDeadline::WRITE);
+    }
+}
+
+void CHTTPClient::markWrite()
+{
+    // progress is measured against the most that waited to leave since the write deadline was armed
+    if (m_deadline == HttpDeadline::WRITE)
+        m_write_mark = std::max(m_write_mark, outputLength());
+}
+
+size_t CHTTPClient::outputLength()
+{
+    auto bev = GetConnection() ? GetConnection()->GetBufEvent() : nullptr;
+    return bev ? evbuffer_get_length(bufferevent_get_output(bev)) : 0;
+}
+
+void CHTTPClient::Refuse(const ghttp::HttpStatusCode status)
+{
+    CheckConditionVoid(!m_refused);
+    m_refused = true;
+    m_reading = false;
+    m_body_streamed = false;
+    // the request is queued like a complete one so its response keeps its place in the pipeline
+    auto stream = QueueRequest();
+    stream->GetResponse()->Response({ status, ghttp::HttpReason(status).value_or("") });
+}
+
+void CHTTPClient::PauseBody()
+{
+    CheckConditionVoid(!m_body_paused);
+    m_body_paused = true;
+    // the handler holding the body back is not the peer being slow
+    DisarmDeadline();
+    // the kernel buffer fills up and the peer is held back by tcp flow control
+    if (auto bev = GetConnection()->GetBufEvent(); bev)
+        bufferevent_disable(bev, EV_READ);
+}
+
+void CHTTPClient::ResumeBody()
+{
+    CheckConditionVoid(m_body_paused);
+    m_body_paused = false;
+    ArmDeadline(HttpDeadline::BODY);
+    if (auto bev = GetConnection()->GetBufEvent(); bev) {
+        bufferevent_enable(bev, EV_READ);
+        // chunks already buffered are parsed after this callback
+        if (evbuffer_get_length(bufferevent_get_input(bev)) > 0)
+            bufferevent_trigger(bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
+    }
+}
+
+bool CHTTPClient::Http1Response(ghttp::CRequest* req, const bool closing, std::string_view head, std::string_view data, std::string* owned, const int32_t fd)
+{
+    auto it = std::find_if(std::begin(m_pipeline), std::end(m_pipeline), [req](auto& v) { return v.stream->GetRequest() == req; });
+    if (it == std::end(m_pipeline))
+        return writeHttp1(closing, head, data, owned, fd);
+    if (it != std::begin(m_pipeline)) {
+        // answered ahead of an earlier request, written once that one is out
+        it->answered = true;
+        it->closing = closing;
+        it->fd = fd;
+        it->output.assign(head).append(data);
+        return true;
+    }
+    return nextResponse(writeHttp1(closing, head, data, owned, fd));
+}
+
+bool CHTTPClient::Http1Stream(ghttp::CRequest* req, const bool closing, std::string_view data, std::string* owned, const bool end)
+{
+    auto it = std::find_if(std::begin(m_pipeline), std::end(m_pipeline), [req](auto& v) { return v.stream->GetRequest() == req; });
+    if (it == std::end(m_pipeline))
+        return writeHttp1(closing && end, {}, data, owned, -1);
+    if (it != std::begin(m_pipeline)) {
+        // streamed ahead of an earlier request, kept until that one is out
+        it->output.append(data);
+        if (end) {
+            it->answered = true;
+            it->closing = closing;
+        }
+        return true;
+    }
+    // a streamed response may take as long as it needs
+    if (!m_reading && m_deadline == HttpDeadline::HANDLER)
+        DisarmDeadline();
+    bool ok = writeHttp1(closing && end, {}, data, owned, -1);
+    return end ? nextResponse(ok) : ok;
+}
+
+bool CHTTPClient::nextResponse(bool ok)
+{
+    // the stream may still be the caller, it is only reset when it is reused
+    m_spare.push_back(std::move(m_pipeline.front().stream));
+    m_pipeline.pop_front();
+    while (ok && !m_pipeline.empty()) {
+        auto& next = m_pipeline.front();
+        if (!next.answered) {
+            // a response that started streaming ahead of its turn goes on writing directly
+            if (!next.output.empty()) {
+                ok = writeHttp1(false, {}, next.output, &next.output, -1);
+                next.output.clear();
+            }
+            break;
+        }
+        ok = writeHttp1(next.closing, {}, next.output, &next.output, next.fd);
+        m_spare.push_back(std::move(next.stream));
+        m_pipeline.pop_front();
+    }
+    SetInflight(!m_pipeline.empty());
+    if (!m_reading)
+        armAfterRequest();
+    if (m_stalled && m_pipeline.size() < HTTP_PIPELINE_DEPTH) {
+        m_stalled = false;
+        // requests left in the input buffer are parsed after this callback
+        if (auto bev = GetConnection()->GetBufEvent(); bev && evbuffer_get_length(bufferevent_get_input(bev)) > 0)
+            bufferevent_trigger(bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
+    }
+    return ok;
+}
+
+bool CHTTPClient::writeHttp1(const bool closing, std::string_view head, std::string_view data, std::string* owned, const int32_t fd)
+{
+    auto conn = GetConnection();
+    if (closing)
+        conn->SetFlag(CConnection::ConnectionFlags_Closing);
+    // head and body are queued as separate chains and leave in one writev
+    if (!head.empty() && !conn->SendCmd(head.data(), head.size()))
+        return false;
+    if (!data.empty() && !(owned ? conn->SendCmd(std::move(*owned)) : conn->SendCmd(data.data(), data.size())))
+        return false;
+    return fd < 0 || conn->SendFile(fd);
+}
+
+namespace {
+uint32_t deadlineSeconds(const HttpDeadline d)
+{
+    switch (d) {
+    case HttpDeadline::HEADER:
+        return MYARGS.HeaderTimeout.value_or(HTTP_HEADER_TIMEOUT);
+    case HttpDeadline::BODY:
+        return MYARGS.BodyTimeout.value_or(MYARGS.HttpTimeout.value_or(60));
+    case HttpDeadline::IDLE:
+        return MYARGS.KeepAliveTimeout.value_or(MYARGS.HttpTimeout.value_or(60));
+    case HttpDeadline::HANDLER:
+        return MYARGS.HandlerTimeout.value_or(HTTP_HANDLER_TIMEOUT);
+    case HttpDeadline::WRITE:
+        return MYARGS.WriteTimeout.value_or(MYARGS.HttpTimeout.value_or(60));
+    default:
+        return 0;
+    }
+}
+
+void startDeadlineTick()
+{
+    if (CContex::MAIN_CONTEX && !CContex::MAIN_CONTEX->HasEvent(HTTP_DEADLINE_TIMER_ID))
+        CContex::MAIN_CONTEX->AddPersistEvent(HTTP_DEADLINE_TIMER_ID, HTTP_DEADLINE_TICK, []() { CHTTPClient::UpdateDeadlines(CChrono::SteadyMs()); });
+}
+} // namespace
+
+void CHTTPClient::ArmDeadline(const HttpDeadline d)
+{
+    const uint64_t now = DeadlineNow();
+    // the wheel is coarse, re-arming the same deadline within a tick changes nothing
+    if (m_deadline == d && now < m_deadline_armed + HTTP_DEADLINE_TICK)
+        return;
+    const uint32_t t = deadlineSeconds(d);
+    if (0 == t) {
+        DisarmDeadline();
+        return;
+    }
+    if (0 == m_deadline_id)
+        m_deadline_id = ++m_deadline_ids == 0 ? ++m_deadline_ids : m_deadline_ids;
+    m_deadline = d;
+    m_deadline_armed = now;
+    if (HttpDeadline::WRITE == d)
+        m_write_mark = outputLength();
+    m_deadlines.Add(m_deadline_id, now, t * 1000, false, [this]() { onDeadline(); });
+    startDeadlineTick();
+}
+
+void CHTTPClient::DisarmDeadline()
+{
+    CheckConditionVoid(m_deadline);
+    m_deadline.reset();
+    m_deadlines.Del(m_deadline_id);
+}
+
+void CHTTPClient::UpdateDeadlines(const uint64_t now)
+{
+    m_deadline_now = std::max(m_deadline_now, now);
+    m_deadlines.Update(now);
+    // the tick stops with the last deadline and comes back with the next one
+    if (0 == m_deadlines.Size() && CContex::MAIN_CONTEX)
+        CContex::MAIN_CONTEX->DelEvent(HTTP_DEADLINE_TIMER_ID);
+}
+
+uint64_t CHTTPClient::DeadlineNow()
+{
+    return std::max<uint64_t>(CChrono::SteadyMs(), m_deadline_now);
+}
+
+void CHTTPClient::onDeadline()
+{
+    const auto d = m_deadline.value_or(HttpDeadline::IDLE);
+    m_deadline.reset();
+    // a peer reading slowly still gets the rest, only a whole period without a byte leaving closes the connection
+    if (HttpDeadline::WRITE == d && outputLength() < m_write_mark) {
+        ArmDeadline(HttpDeadline::WRITE);
+        return;
+    }
+    if (CWorker::LOCAL_WORKER)
+        CWorker::LOCAL_WORKER->IncHttpTimeout(d);
+    auto conn = GetConnection();
+    SPDLOG_DEBUG("CTX:{} {} {} deadline {}", MYARGS.CTXID, __FUNCTION__, conn->GetPeerIp(), (uint32_t)d);
+    // whatever is still queued goes too, a peer that stopped reading would keep it forever
+    if (conn->Handler())
+        conn->Handler()->Abort();
+}
+
+void CHTTPClient::AddWriter(ghttp::CResponse* rsp)
+{
+    if (std::find(std::begin(m_writers), std::end(m_writers), rsp) == std::end(m_writers))
+        m_writers.push_back(rsp);
+}
+
+void CHTTPClient::DelWriter(ghttp::CResponse* rsp)
+{
+    std::erase(m_writers, rsp);
+}
+
+void CHTTPClient::DrainAll()
+{
+    // drain may delete the client
+    std::vector<CHTTPClient*> clients(m_passive.begin(), m_passive.end());
+    for (auto v : clients) {
+        v->drain();
+    }
+}
+
+void CHTTPClient::drain()
+{
+    auto conn = GetConnection();
+    CheckConditionVoid(conn && conn->Handler());
+    if (IsHttp2()) {
+        if (!m_goaway) {
+            m_goaway = true;
+            nghttp2_submit_goaway(m_session, NGHTTP2_FLAG_NONE, nghttp2_session_get_last_proc_stream_id(m_session), NGHTTP2_NO_ERROR, nullptr, 0);
+            sessionSend();
+        }
+        // nghttp2 stops wanting io once GOAWAY is out and every stream is closed
+        if (nghttp2_session_want_read(m_session) || nghttp2_session_want_write(m_session))
+            return;
+    } else if (m_inflight) {
+        // the response closes the connection
+        return;
+    }
+    conn->Handler()->Close();
 }
 
 bool CHTTPClient::Request(ghttp::HttpMethod method, std::string_view body, std::map<std::string, std::string> header)
@@ -605,6 +1175,17 @@ void CHTTPClient::OnWrite(CHTTPClient* hclient)
             // }
         }
     }
+    // the output drained, what was left of the responses is out
+    if (hclient->m_deadline == HttpDeadline::WRITE)
+        hclient->afterWrite();
+    // streamed responses produce more now that the output drained, a writer may end or start another one meanwhile
+    auto writers = hclient->m_writers;
+    for (auto v : writers) {
+        if (std::find(std::begin(hclient->m_writers), std::end(hclient->m_writers), v) == std::end(hclient->m_writers))
+            continue;
+        if (v->GetDrain() && v->Writable())
+            v->GetDrain()(v);
+    }
 }
 
 bool CHTTPClient::CheckHttp2()
@@ -640,6 +1221,7 @@ ssize_t CHTTPClient::sendCallback(nghttp2_session* session, const uint8_t* data,
         return NGHTTP2_ERR_WOULDBLOCK;
     }
     session_data->GetConnection()->SendCmd(data, length);
+    session_data->markWrite();
     return (ssize_t)length;
 }
 
@@ -649,19 +1231,38 @@ int CHTTPClient::onRequestRecv(ghttp::CStream* stream)
     auto rsp = stream->GetResponse();
     if (!req->GetPath().empty()) {
         SPDLOG_DEBUG("{} {} {} {}", MYARGS.CTXID, __FUNCTION__, req->GetStreamId().value(), req->GetPath());
+        // refused like over http/1, before the start event
+        if (auto filter = m_httpserver->GetFilter(req); filter && 0 == ((uint32_t)filter.value()->cmd & (uint32_t)req->GetMethod())) {
+            H2Response(req, ghttp::HttpStatusCode::BADMETHOD, {}, ghttp::HttpReason(ghttp::HttpStatusCode::BADMETHOD).value_or(""));
+            return 0;
+        }
         if (!req->IsGRPC()) {
             auto r = m_httpserver->EmitEvent("start", req, rsp);
             if (r) {
-                H2Response(req, r.value().first, {}, r.value().second);
+                H2Response(req, r.value().first, {}, r.value().second, &r.value().second);
                 return 0;
             }
         } else {
             CDecoder<GRPCMessageHeader> dec(req->GetBody().data(), req->GetBody().length());
             auto [ret, flag, msg, msglen] = dec.Decode();
-            req->SetBodyByView(std::string_view((char*)msg, msglen));
+            if (flag & 0x01) {
+                // a compressed message is inflated into the body, bounded like the body of the route
+                auto encoding = ghttp::CGrpcCodec::Parse(req->GetHeaderByKey("grpc-encoding"));
+                auto filter = m_httpserver->GetFilter(req);
+                const size_t maxlen = ghttp::CGrpcCodec::InflateLimit(msglen, CHTTPServer::BodyLimit(filter ? filter.value() : nullptr));
+                std::string body;
+                if (!encoding || encoding == ghttp::GrpcEncoding::IDENTITY
+                    || ghttp::CGrpcCodec::Inflate(encoding.value(), std::string_view((char*)msg, msglen), maxlen, body) != ghttp::GrpcStatus::OK) {
+                    H2Response(req, ghttp::HttpStatusCode::BADREQUEST, {}, ghttp::HttpReason(ghttp::HttpStatusCode::BADREQUEST).value_or(""));
+                    return 0;
+                }
+                req->SetBody(body);
+            } else {
+                req->SetBodyByView(std::string_view((char*)msg, msglen));
+            }
         }
 
-        if (!m_httpserver->Emit(req->GetPath(), req, rsp)) {
+        if (!m_httpserver->Emit(req, rsp)) {
             fs::path f = MYARGS.WebRootDir.value_or(fs::current_path()) + req->GetPath();
             if (!fs::exists(f)) {
                 H2Response(req, ghttp::HttpStatusCode::NOTFOUND, {}, ghttp::HttpReason(ghttp::HttpStatusCode::NOTFOUND).value_or(""));
@@ -672,13 +1273,12 @@ int CHTTPClient::onRequestRecv(ghttp::CStream* stream)
                 H2Response(req, ghttp::HttpStatusCode::NOTFOUND, {}, ghttp::HttpReason(ghttp::HttpStatusCode::NOTFOUND).value_or(""));
                 return 0;
             }
-            auto hfd = fopen(f.c_str(), "r");
-            if (hfd) {
+            if (auto fd = open(f.c_str(), O_RDONLY); fd != -1) {
                 std::unordered_map<std::string, std::string> header;
                 header["content-type"] = mime.value();
                 if (MYARGS.IsAllowOrigin && MYARGS.IsAllowOrigin.value())
                     header["access-control-allow-origin"] = "*";
-                sendFile(req, ghttp::HttpStatusCode::OK, header, fileno(hfd));
+                H2File(req, ghttp::HttpStatusCode::OK, header, fd);
                 return 0;
             }
             H2Response(req, ghttp::HttpStatusCode::NOTFOUND, {}, ghttp::HttpReason(ghttp::HttpStatusCode::NOTFOUND).value_or(""));
@@ -691,24 +1291,60 @@ int CHTTPClient::onRequestRecv(ghttp::CStream* stream)
     return 0;
 }
 
+void CHTTPClient::startGrpc(ghttp::CStream* stream)
+{
+    auto req = stream->GetRequest();
+    CheckConditionVoid(req->IsGRPC() && req->GetMethod() == ghttp::HttpMethod::POST);
+    auto filter = m_httpserver->GetFilter(req);
+    CheckConditionVoid(filter && filter.value()->grpc);
+    auto& service = filter.value()->grpc.value();
+    const int32_t streamid = stream->GetStreamId();
+    const uint32_t maxmessage = service.maxmessage > 0 ? service.maxmessage : (uint32_t)std::min<uint64_t>(CHTTPServer::BodyLimit(filter.value()), UINT32_MAX);
+    auto call = m_calls.emplace(streamid, CNEW ghttp::CGrpcCall(stream, &service, maxmessage)).first->second.get();
+    // enforced on the coarse tick of the connection deadlines, up to one tick late
+    if (auto timeout = ghttp::CGrpcCall::ParseTimeout(req->GetHeaderByKey("grpc-timeout")); timeout) {
+        const uint64_t now = DeadlineNow();
+        const uint32_t id = ++m_deadline_ids == 0 ? ++m_deadline_ids : m_deadline_ids;
+        call->SetDeadline(now + timeout.value(), id);
+        m_deadlines.Add(id, now, (uint32_t)std::min<uint64_t>(timeout.value(), UINT32_MAX), false, [this, streamid]() {
+            if (auto it = m_calls.find(streamid); it != std::end(m_calls))
+                it->second->OnDeadline();
+        });
+        startDeadlineTick();
+    }
+    call->Start();
+}
+
 int CHTTPClient::onFrameRecvCallback(nghttp2_session* session, const nghttp2_frame* frame, void* user_data)
 {
     CHTTPClient* session_data = (CHTTPClient*)user_data;
+    if (frame->hd.type == NGHTTP2_PING && (frame->hd.flags & NGHTTP2_FLAG_ACK) && 0 == memcmp(frame->ping.opaque_data, H2_BDP_PING, sizeof(H2_BDP_PING)))
+        session_data->h2PingAck();
     if (session_data->m_httpserver) {
+        if (frame->hd.type == NGHTTP2_RST_STREAM)
+            session_data->h2Reset();
         switch (frame->hd.type) {
         case NGHTTP2_DATA:
-        case NGHTTP2_HEADERS:
+        case NGHTTP2_HEADERS: {
+            ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+            /* For DATA and HEADERS frame, this callback may be called after
+               onstreamclosecallback. Check that stream still alive. */
+            if (!stream_data) {
+                return 0;
+            }
+            if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+                session_data->startGrpc(stream_data);
+            // the connection deadline follows the stream that moved last, a frame of any stream is progress
+            session_data->ArmDeadline((frame->hd.flags & NGHTTP2_FLAG_END_STREAM) ? HttpDeadline::HANDLER : HttpDeadline::BODY);
             /* Check that the client request has finished */
             if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
-                ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
-                /* For DATA and HEADERS frame, this callback may be called after
-                   onstreamclosecallback. Check that stream still alive. */
-                if (!stream_data) {
+                if (auto it = session_data->m_calls.find(frame->hd.stream_id); it != std::end(session_data->m_calls)) {
+                    it->second->OnHalfClose();
                     return 0;
                 }
                 return session_data->onRequestRecv(stream_data);
             }
-            break;
+        } break;
         default:
             break;
         }
@@ -731,12 +1367,26 @@ int CHTTPClient::onDataChunkRecvCallback(nghttp2_session* session,
     uint8_t flags, int32_t stream_id, const uint8_t* data, size_t len, void* user_data)
 {
     CHTTPClient* session_data = (CHTTPClient*)user_data;
+    session_data->h2Received(len);
     if (session_data->m_httpserver) {
         ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, stream_id);
         if (!stream_data) {
             return 0;
         }
-        stream_data->GetRequest()->AppendBody(std::string_view((char*)data, len));
+        session_data->ArmDeadline(HttpDeadline::BODY);
+        // a grpc call takes its messages as they complete, the limit is on each message
+        if (auto it = session_data->m_calls.find(stream_id); it != std::end(session_data->m_calls)) {
+            it->second->OnData(std::string_view((const char*)data, len));
+            return 0;
+        }
+        auto req = stream_data->GetRequest();
+        // the route is only looked up for bodies over the default limit
+        if (auto size = req->GetBody().size() + len; size > CHTTPServer::BodyLimit(nullptr)
+            && size > CHTTPServer::BodyLimit(session_data->m_httpserver->GetFilter(req).value_or(nullptr))) {
+            nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_CANCEL);
+            return 0;
+        }
+        req->AppendBody(std::string_view((char*)data, len));
     } else {
         ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, stream_id);
         if (stream_data->GetRequest()->GetStreamId().value_or(-1) == stream_id) {
@@ -750,7 +1400,7 @@ int CHTTPClient::onDataChunkRecvCallback(nghttp2_session* session,
                     return 0;
                 stream_data->GetResponse()->SetBody(std::string_view((const char*)msg, msglen));
             } else {
-                auto content_length = CStringTool::ToInteger<size_t>(stream_data->GetResponse()->GetHeaderByKey("content-length"));
+                auto content_length = CStringTool::ToInteger<size_t>(stream_data->GetResponse()->GetHeaderByKey(ghttp::HEADER_CONTENT_LENGTH));
                 if (content_length > stream_data->GetResponse()->GetBody().value_or("").length())
                     return 0;
             }
@@ -771,6 +1421,8 @@ int CHTTPClient::onStreamCloseCallback(nghttp2_session* session, int32_t stream_
         if (!stream_data) {
             return 0;
         }
+        if (auto it = session_data->m_calls.find(stream_id); it != std::end(session_data->m_calls))
+            it->second->OnCancel();
         session_data->DelStream(stream_id);
         SPDLOG_DEBUG("{} ServerStream {} closed with error_code={} errstr {}", MYARGS.CTXID.c_str(), stream_id, error_code, nghttp2_strerror(error_code));
         return 0;
@@ -798,8 +1450,19 @@ int CHTTPClient::onHeaderCallback(nghttp2_session* session,
     CHTTPClient* session_data = (CHTTPClient*)user_data;
     (void)flags;
 
+    // 32 bytes of overhead per field as SETTINGS_MAX_HEADER_LIST_SIZE counts them, the stream is reset once over
+    const uint64_t limit = MYARGS.H2MaxHeaderList.value_or(MAX_HTTP_HEAD_SIZE);
+    const uint64_t before = session_data->m_header_bytes;
+    session_data->m_header_bytes += namelen + valuelen + 32;
+    if (session_data->m_header_bytes > limit) {
+        if (before <= limit)
+            session_data->h2Violation(H2Violation::HEADERLIST);
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    }
+
     if (session_data->m_httpserver) {
         const char PATH[] = ":path";
+        const char METHOD[] = ":method";
         switch (frame->hd.type) {
         case NGHTTP2_HEADERS:
             if (frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
@@ -809,13 +1472,13 @@ int CHTTPClient::onHeaderCallback(nghttp2_session* session,
             if (!stream_data) {
                 break;
             }
-            stream_data->GetRequest()->AddHeader(std::string((char*)name, namelen), std::string((char*)value, valuelen));
+            stream_data->GetRequest()->AddHeader(std::string_view((char*)name, namelen), std::string_view((char*)value, valuelen));
             SPDLOG_DEBUG("HTTP2 Server HEADER {} {}", name, value);
             if (namelen == sizeof(PATH) - 1 && memcmp(PATH, name, namelen) == 0) {
-                size_t j;
-                for (j = 0; j < valuelen && value[j] != '?'; ++j)
-                    ;
-                stream_data->GetRequest()->SetPath(std::string((char*)value, j));
+                stream_data->GetRequest()->SetTarget(std::string_view((char*)value, valuelen));
+            } else if (namelen == sizeof(METHOD) - 1 && memcmp(METHOD, name, namelen) == 0) {
+                if (auto m = ghttp::HttpStrMethod(std::string((char*)value, valuelen)); m)
+                    stream_data->GetRequest()->SetMethod(m.value());
             }
             break;
         }
@@ -824,7 +1487,7 @@ int CHTTPClient::onHeaderCallback(nghttp2_session* session,
         case NGHTTP2_HEADERS:
             ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
             if (frame->headers.cat == NGHTTP2_HCAT_RESPONSE && stream_data->GetRequest()->GetStreamId().value_or(-1) == frame->hd.stream_id) {
-                stream_data->GetResponse()->AddHeader(std::string((char*)name, namelen), std::string((char*)value, valuelen));
+                stream_data->GetResponse()->AddHeader(std::string_view((char*)name, namelen), std::string_view((char*)value, valuelen));
                 SPDLOG_DEBUG("HTTP2 Client HEADER {} {}", name, value);
                 if (stream_data->GetResponse()->HasHeader(":status"))
                     stream_data->GetResponse()->SetStatus((ghttp::HttpStatusCode)CStringTool::ToInteger<int32_t>(stream_data->GetResponse()->GetHeaderByKey(":status")));
@@ -838,6 +1501,7 @@ int CHTTPClient::onHeaderCallback(nghttp2_session* session,
 int CHTTPClient::onBeginHeadersCallback(nghttp2_session* session, const nghttp2_frame* frame, void* user_data)
 {
     CHTTPClient* session_data = (CHTTPClient*)user_data;
+    session_data->m_header_bytes = 0;
 
     if (session_data->m_httpserver) {
         if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
@@ -868,22 +1532,108 @@ int CHTTPClient::onBeforeFrameSendCallback(nghttp2_session* session, const nghtt
     } else {
         SPDLOG_DEBUG("{} Client {}", __FUNCTION__, frame->hd.type);
     }
+    // the errors the peer caused show in the frames answering them
+    uint32_t code = NGHTTP2_NO_ERROR;
+    if (frame->hd.type == NGHTTP2_RST_STREAM)
+        code = frame->rst_stream.error_code;
+    else if (frame->hd.type == NGHTTP2_GOAWAY)
+        code = frame->goaway.error_code;
+    if (code == NGHTTP2_FLOW_CONTROL_ERROR)
+        session_data->h2Violation(H2Violation::FLOWCONTROL);
+    else if (code == NGHTTP2_FRAME_SIZE_ERROR)
+        session_data->h2Violation(H2Violation::FRAMESIZE);
+    return 0;
+}
+
+int CHTTPClient::onInvalidFrameRecvCallback(nghttp2_session* session, const nghttp2_frame* frame, int lib_error_code, void* user_data)
+{
+    CHTTPClient* session_data = (CHTTPClient*)user_data;
+    (void)session;
+    // streams past SETTINGS_MAX_CONCURRENT_STREAMS are refused, or fail the connection once the peer acknowledged it
+    if (session_data->m_httpserver && frame->hd.type == NGHTTP2_HEADERS
+        && (lib_error_code == NGHTTP2_ERR_REFUSED_STREAM
+            || (lib_error_code == NGHTTP2_ERR_PROTO && session_data->m_streams.size() >= MYARGS.H2MaxStreams.value_or(H2_MAX_STREAMS))))
+        session_data->h2Violation(H2Violation::STREAMS);
     return 0;
 }
 
 bool CHTTPClient::sendConnectionHeader()
 {
-    std::vector<nghttp2_settings_entry> iv = { { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100 } };
+    m_h2window = std::min<uint32_t>(MYARGS.H2StreamWindow.value_or(H2_STREAM_WINDOW), NGHTTP2_MAX_WINDOW_SIZE);
+    m_h2connwindow = std::min<uint32_t>(MYARGS.H2ConnWindow.value_or(H2_CONNECTION_WINDOW), NGHTTP2_MAX_WINDOW_SIZE);
+    m_h2maxwindow = std::min<uint32_t>(MYARGS.H2MaxWindow.value_or(H2_MAX_WINDOW), NGHTTP2_MAX_WINDOW_SIZE);
+    std::vector<nghttp2_settings_entry> iv = {
+        { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, MYARGS.H2MaxStreams.value_or(H2_MAX_STREAMS) },
+        { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, m_h2window },
+        { NGHTTP2_SETTINGS_MAX_FRAME_SIZE, std::clamp(MYARGS.H2MaxFrameSize.value_or(H2_MAX_FRAME), H2_MAX_FRAME, H2_MAX_FRAME_LIMIT) },
+        { NGHTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, MYARGS.H2MaxHeaderList.value_or(MAX_HTTP_HEAD_SIZE) },
+    };
 
     int32_t rv = nghttp2_submit_settings(m_session, NGHTTP2_FLAG_NONE, iv.data(), iv.size());
     if (rv != 0) {
         SPDLOG_ERROR("Fatal error: {}", nghttp2_strerror(rv));
         return false;
     }
+    // the connection window has no setting, a WINDOW_UPDATE on stream 0 opens it
+    rv = nghttp2_session_set_local_window_size(m_session, NGHTTP2_FLAG_NONE, 0, m_h2connwindow);
+    if (rv != 0) {
+        SPDLOG_ERROR("Fatal error: {}", nghttp2_strerror(rv));
+        return false;
+    }
     SPDLOG_DEBUG("sendConnectionHeader: {}", nghttp2_strerror(rv));
     return true;
 }
 
+void CHTTPClient::h2Received(const size_t len)
+{
+    CheckConditionVoid(m_h2maxwindow > 0);
+    if (!m_bdp_ping) {
+        CheckConditionVoid(0 == nghttp2_submit_ping(m_session, NGHTTP2_FLAG_NONE, H2_BDP_PING));
+        m_bdp_ping = true;
+        m_bdp_sample = 0;
+    }
+    m_bdp_sample += len;
+}
+
+void CHTTPClient::h2PingAck()
+{
+    CheckConditionVoid(m_bdp_ping);
+    m_bdp_ping = false;
+    // a round trip that filled most of a window was held back by it, the window doubles the sample it carried
+    const uint32_t target = (uint32_t)std::min<uint64_t>(m_bdp_sample * 2, m_h2maxwindow);
+    if (m_bdp_sample * 3 >= (uint64_t)m_h2connwindow * 2 && target > m_h2connwindow
+        && 0 == nghttp2_session_set_local_window_size(m_session, NGHTTP2_FLAG_NONE, 0, target))
+        m_h2connwindow = target;
+    if (m_bdp_sample * 3 >= (uint64_t)m_h2window * 2 && target > m_h2window) {
+        nghttp2_settings_entry iv = { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, target };
+        if (0 == nghttp2_submit_settings(m_session, NGHTTP2_FLAG_NONE, &iv, 1))
+            m_h2window = target;
+    }
+}
+
+void CHTTPClient::h2Reset()
+{
+    // nghttp2 leaves a client free to open and cancel streams without end, the work each one caused is capped here
+    const uint32_t limit = MYARGS.H2MaxResets.value_or(H2_MAX_RESETS);
+    CheckConditionVoid(limit > 0);
+    const uint64_t second = CChrono::SteadyMs() / 1000;
+    if (second != m_resets_second) {
+        m_resets_second = second;
+        m_resets = 0;
+    }
+    if (++m_resets == limit + 1) {
+        SPDLOG_WARN("{} http2 client {} reset {} streams within a second", MYARGS.CTXID, fmt::ptr(this), m_resets);
+        h2Violation(H2Violation::RESETFLOOD);
+        nghttp2_session_terminate_session(m_session, NGHTTP2_ENHANCE_YOUR_CALM);
+    }
+}
+
+void CHTTPClient::h2Violation(const H2Violation v)
+{
+    if (CWorker::LOCAL_WORKER)
+        CWorker::LOCAL_WORKER->IncH2Violation(v);
+}
+
 bool CHTTPClient::sessionSend()
 {
     int32_t rv = nghttp2_session_send(m_session);
@@ -895,148 +1645,213 @@ bool CHTTPClient::sessionSend()
     return true;
 }
 
+CHTTPClient::H2Body::~H2Body()
+{
+    // the output buffer holds its own reference to the ranges not written yet
+    if (segment)
+        evbuffer_file_segment_free(segment);
+}
+
 int CHTTPClient::onSendDataCallback(nghttp2_session* session,
     nghttp2_frame* frame,
     const uint8_t* framehd, size_t length,
     nghttp2_data_source* source,
     void* user_data)
 {
-    std::string_view* data = (std::string_view*)source->ptr;
-
+    (void)session;
+    (void)source;
+    static const uint8_t ZEROS[256] = { 0 };
     CHTTPClient* session_data = (CHTTPClient*)user_data;
-    ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
-    if (!session_data->GetConnection()->SendCmd(framehd, 9))
-        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
-    if (data && !session_data->GetConnection()->SendCmd(data->data(), data->length()))
-        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
-
-    delete data;
-    stream_data->GetRequest()->Reset();
+    auto bev = session_data->GetConnection()->GetBufEvent();
+    CheckCondition(bev, NGHTTP2_ERR_CALLBACK_FAILURE);
+    struct evbuffer* output = bufferevent_get_output(bev);
+    // the frame waits for the socket like the ones nghttp2 serializes itself, OnWrite sends it once the output drained
+    if (evbuffer_get_length(output) >= MAX_WATERMARK_SIZE)
+        return NGHTTP2_ERR_WOULDBLOCK;
 
+    auto zeros = [output](size_t n) {
+        for (; n > 0; n -= std::min(n, sizeof(ZEROS)))
+            evbuffer_add(output, ZEROS, std::min(n, sizeof(ZEROS)));
+    };
+    const size_t padlen = frame->data.padlen;
+    CheckCondition(-1 != evbuffer_add(output, framehd, 9), NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE);
+    if (padlen > 0) {
+        const uint8_t v = (uint8_t)(padlen - 1);
+        evbuffer_add(output, &v, 1);
+    }
+    // the body is looked up by stream, a peer resetting the stream while its frame waited frees it
+    auto it = session_data->m_bodies.find(frame->hd.stream_id);
+    if (it == std::end(session_data->m_bodies)) {
+        zeros(length);
+    } else {
+        auto body = it->second.get();
+        int r = 0;
+        if (body->segment) {
+            r = evbuffer_add_file_segment(output, body->segment, body->sent, length);
+        } else if (body->stream) {
+            r = evbuffer_add(output, body->stream->PendingStream().data(), length);
+            body->stream->StreamSent(length);
+        } else {
+            r = evbuffer_add(output, body->data.data() + body->sent, length);
+        }
+        body->sent += length;
+        CheckCondition(-1 != r, NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE);
+    }
+    if (padlen > 1)
+        zeros(padlen - 1);
+    session_data->markWrite();
     return 0;
 }
 
-static ssize_t nocopy_read_callback(nghttp2_session* session,
+ssize_t CHTTPClient::onReadDataCallback(nghttp2_session* session,
     int32_t stream_id,
     uint8_t* buf, size_t length,
     uint32_t* data_flags,
     nghttp2_data_source* source,
     void* user_data)
 {
-    (void)session;
-    (void)stream_id;
+    (void)buf;
     (void)user_data;
-    std::string_view* data = (std::string_view*)source->ptr;
-    ssize_t r = data->length();
-
-    CHTTPClient* session_data = (CHTTPClient*)user_data;
-    ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, stream_id);
-    SPDLOG_DEBUG("nocopy_read_callback: {}", fmt::ptr(stream_data));
-
-    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    auto body = (H2Body*)source->ptr;
+    uint64_t left = body->size - body->read;
+    if (body->stream) {
+        left = body->stream->PendingStream().size();
+        // nothing to send until the handler writes again
+        if (0 == left && !body->stream->IsEnded())
+            return NGHTTP2_ERR_DEFERRED;
+    }
+    const size_t n = std::min<uint64_t>(length, left);
+    body->read += n;
     *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+    if (n < left || (body->stream && !body->stream->IsEnded()))
+        return n;
 
-    if (stream_data->GetRequest()->IsGRPC()) {
+    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    // trailers end the stream instead of the last DATA frame, a grpc answer without a status of its own is ok
+    const bool trailers = body->stream && !body->stream->GetTrailers().Empty();
+    if (trailers || body->grpc) {
         *data_flags |= NGHTTP2_DATA_FLAG_NO_END_STREAM;
-        static const std::string GRPC_STATUS = "grpc-status";
-        std::vector<nghttp2_nv> hdrs;
-        std::string grpc_status_value = std::to_string(0);
-        hdrs.push_back({ (uint8_t*)GRPC_STATUS.c_str(), (uint8_t*)grpc_status_value.c_str(), GRPC_STATUS.size(), grpc_status_value.size(), NGHTTP2_NV_FLAG_NONE });
-        auto rv = nghttp2_submit_trailer(session, stream_id, &hdrs[0], hdrs.size());
+        int32_t rv = 0;
+        if (trailers) {
+            thread_local std::vector<nghttp2_nv> hdrs;
+            hdrs.clear();
+            for (auto [k, v] : body->stream->GetTrailers())
+                hdrs.push_back({ (uint8_t*)k.data(), (uint8_t*)v.data(), k.size(), v.size(), NGHTTP2_NV_FLAG_NONE });
+            rv = nghttp2_submit_trailer(session, stream_id, hdrs.data(), hdrs.size());
+        } else {
+            rv = nghttp2_submit_trailer(session, stream_id, H2_GRPC_OK, 1);
+        }
         if (rv != 0) {
             SPDLOG_ERROR("Fatal error: {}", nghttp2_strerror(rv));
-            stream_data->GetRequest()->Reset();
             return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
         }
     }
-
-    return r;
+    return n;
 }
 
-static ssize_t file_read_callback(nghttp2_session* session, int32_t stream_id,
-    uint8_t* buf, size_t length,
-    uint32_t* data_flags,
-    nghttp2_data_source* source,
-    void* user_data)
+bool CHTTPClient::H2Response(ghttp::CRequest* stream_data,
+    const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, std::string_view data, std::string* owned)
 {
-    int fd = source->fd;
-    ssize_t r;
-    (void)session;
-    (void)stream_id;
-    (void)user_data;
-
-    ghttp::CStream* stream_data = (ghttp::CStream*)nghttp2_session_get_stream_user_data(session, stream_id);
-
-    while ((r = read(fd, buf, length)) == -1 && errno == EINTR)
-        ;
-    if (r == -1) {
-        stream_data->GetRequest()->Reset();
-        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
-    }
-    if (r == 0) {
-        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    std::unique_ptr<H2Body> body;
+    if (stream_data->IsGRPC()) {
+        body.reset(CNEW H2Body());
+        // framed where it is sent, a message is not bounded by a staging buffer
+        body->data.reserve(GRPC_MESSAGE_HEADER_LENGTH + data.size());
+        body->data.resize(GRPC_MESSAGE_HEADER_LENGTH);
+        CEncoder<GRPCMessageHeader>::EncodeHeader(body->data.data(), 0, data.size());
+        body->data.append(data);
+        body->grpc = true;
+    } else if (!data.empty()) {
+        body.reset(CNEW H2Body());
+        if (owned)
+            body->data = std::move(*owned);
+        else
+            body->data = data;
     }
-
-    stream_data->GetRequest()->Reset();
-
-    return r;
+    if (body)
+        body->size = body->data.size();
+    return submitResponse(stream_data, status, header, std::move(body));
 }
 
-bool CHTTPClient::H2Response(ghttp::CRequest* stream_data,
-    const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, std::optional<std::string_view> body)
+bool CHTTPClient::H2Stream(ghttp::CResponse* rsp, const ghttp::HttpStatusCode status)
 {
-    static const std::string STATUS = ":status";
-    if (stream_data->IsGRPC()) {
-        header["grpc-accept-encoding"] = "identity";
-        CEncoder<GRPCMessageHeader> enc;
-        if (body)
-            body = enc.Encode(0, body.value().data(), body.value().length());
-    }
+    auto stream_data = GetStream(rsp->GetStreamId().value_or(-1));
+    CheckCondition(stream_data, false);
+    std::unique_ptr<H2Body> body(CNEW H2Body());
+    body->stream = rsp;
+    body->grpc = stream_data.value()->GetRequest()->IsGRPC();
+    std::unordered_map<std::string, std::string> header;
+    if (!submitResponse(stream_data.value()->GetRequest(), status, header, std::move(body)))
+        return false;
+    return sessionSend();
+}
 
-    nghttp2_data_provider data_prd;
-    data_prd.source.ptr = body ? CNEW std::string_view(body.value()) : nullptr;
-    data_prd.read_callback = nocopy_read_callback;
+bool CHTTPClient::H2Resume(const int32_t streamid)
+{
+    // the stream may be gone already when the peer reset it, one that was not deferred reads the new data by itself
+    CheckCondition(nghttp2_session_find_stream(m_session, streamid), false);
+    nghttp2_session_resume_data(m_session, streamid);
+    return sessionSend();
+}
 
-    header["date"] = ghttp::GetHttpDate();
-    header["server"] = ghttp::GetHttpServer();
-    header["content-type"] = stream_data->GetHeaderByKey("content-type").empty() ? "application/json; charset=utf-8" : stream_data->GetHeaderByKey("content-type");
-    std::vector<nghttp2_nv> hdrs;
-    std::string status_value = std::to_string((long)status);
-    hdrs.push_back({ (uint8_t*)STATUS.c_str(), (uint8_t*)status_value.c_str(), STATUS.size(), status_value.size(), NGHTTP2_NV_FLAG_NONE });
-    for (auto& [k, v] : header) {
-        hdrs.push_back({ (uint8_t*)k.c_str(), (uint8_t*)v.c_str(), k.size(), v.size(), NGHTTP2_NV_FLAG_NONE });
+bool CHTTPClient::H2File(ghttp::CRequest* stream_data,
+    const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, const int32_t fd)
+{
+    struct stat st;
+    if (-1 == fstat(fd, &st)) {
+        close(fd);
+        return false;
     }
-    auto rv = nghttp2_submit_response(m_session, stream_data->GetStreamId().value(), hdrs.data(), hdrs.size(), body ? &data_prd : nullptr);
-    if (rv != 0) {
-        SPDLOG_ERROR("Fatal error: {}", nghttp2_strerror(rv));
-        stream_data->Reset();
+    std::unique_ptr<H2Body> body(CNEW H2Body());
+    body->size = st.st_size;
+    // closes fd with its last reference
+    body->segment = evbuffer_file_segment_new(fd, 0, st.st_size, EVBUF_FS_CLOSE_ON_FREE);
+    if (!body->segment) {
+        close(fd);
         return false;
     }
-    return true;
+    return submitResponse(stream_data, status, header, st.st_size > 0 ? std::move(body) : nullptr);
 }
 
-bool CHTTPClient::sendFile(ghttp::CRequest* stream_data,
-    const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, const int32_t fd)
+bool CHTTPClient::submitResponse(ghttp::CRequest* stream_data, const ghttp::HttpStatusCode status, const std::unordered_map<std::string, std::string>& header, std::unique_ptr<H2Body> body)
 {
-    static const std::string STATUSH = ":status";
-    stream_data->SetFd(fd);
-    nghttp2_data_provider data_prd;
-    data_prd.source.fd = stream_data->GetFd().value_or(-1);
-    data_prd.read_callback = file_read_callback;
-
-    header["date"] = ghttp::GetHttpDate();
-    header["server"] = ghttp::GetHttpServer();
-    std::vector<nghttp2_nv> hdrs;
-    std::string status_value = std::to_string((long)status);
-    hdrs.push_back({ (uint8_t*)STATUSH.c_str(), (uint8_t*)status_value.c_str(), STATUSH.size(), status_value.size(), NGHTTP2_NV_FLAG_NONE });
+    // Only the headers of the caller are copied. nghttp2 reads the others when the HEADERS frame is serialized:
+    // status and constant fields are static, date and server lines live per thread, the request content type lives
+    // with the stream and the content length with the body, both freed only after the frame is out or dropped
+    thread_local std::vector<nghttp2_nv> hdrs;
+    hdrs.clear();
+    hdrs.push_back(h2nv(":status", h2Status(status)));
+    hdrs.push_back(h2nv("date", ghttp::GetHttpDate()));
+    hdrs.push_back(h2nv("server", ghttp::GetHttpServer()));
+    if (!header.count("content-type")) {
+        const auto type = stream_data->GetHeaderByKey(ghttp::HEADER_CONTENT_TYPE);
+        hdrs.push_back(type.empty() ? H2_JSON_TYPE : h2nv("content-type", type));
+    }
+    if (body && body->grpc) {
+        hdrs.push_back(H2_GRPC_ENCODING);
+        // set by the call, it lives with the response of the stream
+        if (const auto enc = body->stream ? body->stream->GetHeaderByKey("grpc-encoding") : std::string_view(); !enc.empty())
+            hdrs.push_back(h2nv("grpc-encoding", enc));
+    } else if (body && !body->stream) {
+        auto [end, _] = std::to_chars(body->length, body->length + sizeof(body->length), body->size);
+        hdrs.push_back(h2nv("content-length", std::string_view(body->length, end - body->length)));
+    }
     for (auto& [k, v] : header) {
         hdrs.push_back({ (uint8_t*)k.c_str(), (uint8_t*)v.c_str(), k.size(), v.size(), NGHTTP2_NV_FLAG_NONE });
     }
-    auto rv = nghttp2_submit_response(m_session, stream_data->GetStreamId().value(), hdrs.data(), hdrs.size(), &data_prd);
+    const int32_t streamid = stream_data->GetStreamId().value();
+    nghttp2_data_provider data_prd;
+    data_prd.source.ptr = body.get();
+    data_prd.read_callback = onReadDataCallback;
+    auto rv = nghttp2_submit_response(m_session, streamid, hdrs.data(), hdrs.size(), body ? &data_prd : nullptr);
     if (rv != 0) {
         SPDLOG_ERROR("Fatal error: {}", nghttp2_strerror(rv));
+        stream_data->Reset();
         return false;
     }
+    if (body)
+        m_bodies[streamid] = std::move(body);
+    ArmDeadline(HttpDeadline::WRITE);
     return true;
 }
 
@@ -1055,16 +1870,23 @@ bool CHTTPClient::submitRequest(ghttp::CStream* stream)
         SPDLOG_DEBUG("HEADERS: {} {}", k, v);
     }
 
-    std::string_view body = stream->GetRequest()->GetBody();
+    std::unique_ptr<H2Body> body;
+    if (!stream->GetRequest()->GetBody().empty()) {
+        body.reset(CNEW H2Body());
+        body->data = stream->GetRequest()->GetBody();
+        body->size = body->data.size();
+    }
     nghttp2_data_provider pro;
-    pro.read_callback = nocopy_read_callback;
-    pro.source.ptr = body.empty() ? nullptr : CNEW std::string_view(body);
-    auto stream_id = nghttp2_submit_request(m_session, nullptr, hdrs.data(), hdrs.size(), body.empty() ? nullptr : &pro, this);
+    pro.read_callback = onReadDataCallback;
+    pro.source.ptr = body.get();
+    auto stream_id = nghttp2_submit_request(m_session, nullptr, hdrs.data(), hdrs.size(), body ? &pro : nullptr, this);
     if (stream_id < 0) {
         SPDLOG_ERROR("Could not submit HTTP request: {}", nghttp2_strerror(stream_id));
         return false;
     }
     nghttp2_session_set_stream_user_data(GetNGHttp2Session(), stream_id, CreateStream(stream_id));
+    if (body)
+        m_bodies[stream_id] = std::move(body);
 
     SPDLOG_DEBUG("{},{}", __FUNCTION__, stream_id);
     return sessionSend();
@@ -1072,18 +1894,38 @@ bool CHTTPClient::submitRequest(ghttp::CStream* stream)
 
 ghttp::CStream* CHTTPClient::CreateStream(const int32_t streamid)
 {
-    m_streams[streamid].reset(CNEW ghttp::CStream(streamid, this));
-    return m_streams[streamid].get();
+    if (m_httpserver)
+        ArmDeadline(HttpDeadline::HEADER);
+    if (auto it = m_streams.find(streamid); it != std::end(m_streams)) {
+        it->second->Reuse(streamid);
+        return it->second.get();
+    }
+    if (!m_spare_streams.empty()) {
+        auto node = std::move(m_spare_streams.back());
+        m_spare_streams.pop_back();
+        node.key() = streamid;
+        node.mapped()->Reuse(streamid);
+        return m_streams.insert(std::move(node)).position->second.get();
+    }
+    return m_streams.emplace(streamid, CNEW ghttp::CStream(streamid, this)).first->second.get();
 }
 
 bool CHTTPClient::DelStream(const int32_t streamid)
 {
     auto stream = GetStream(streamid);
-    if (stream && stream.value()->GetRequest()->GetFd()) {
-        close(stream.value()->GetRequest()->GetFd().value());
-    }
+    if (stream)
+        DelWriter(stream.value()->GetResponse());
 
-    m_streams.erase(streamid);
+    if (auto it = m_calls.find(streamid); it != std::end(m_calls)) {
+        if (it->second->GetDeadlineId())
+            m_deadlines.Del(it->second->GetDeadlineId());
+        m_calls.erase(it);
+    }
+    m_bodies.erase(streamid);
+    if (auto node = m_streams.extract(streamid); node && m_spare_streams.size() < H2_SPARE_STREAMS)
+        m_spare_streams.push_back(std::move(node));
+    if (m_httpserver && m_streams.empty())
+        armIdle();
     return true;
 }
 
@@ -1109,6 +1951,7 @@ bool CHTTPClient::InitNghttp2SessionData()
     nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, onBeginHeadersCallback);
     nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, onDataChunkRecvCallback);
     nghttp2_session_callbacks_set_before_frame_send_callback(callbacks, onBeforeFrameSendCallback);
+    nghttp2_session_callbacks_set_on_invalid_frame_recv_callback(callbacks, onInvalidFrameRecvCallback);
     nghttp2_session_callbacks_set_send_data_callback(callbacks, onSendDataCallback);
 
     if (m_evcon->IsPassive())
@@ -5,11 +5,14 @@
 #include "connhandler.hpp"
 #include "contex.hpp"
 #include "global.hpp"
+#include "grpc.hpp"
 #include "httpmsg.hpp"
 #include "object.hpp"
 #include "tcpserver.hpp"
 #include "wsparser.hpp"
 
+#include <deque>
+
 NAMESPACE_FRAMEWORK_BEGIN
 
 class CWebSocket {
@@ -18,6 +21,11 @@ public:
     static CWebSocket* Upgrade(ghttp::CResponse* rsp, Callback rdfunc);
     bool SendCmd(const CWSParser::WS_OPCODE opcode, std::string_view data);
     static bool Connect(const std::string& url, Callback cb);
+    // Close frame with 1001 going away, the socket is released once the peer answers
+    void Shutdown();
+    static void DrainAll();
+    // websockets of the calling thread
+    static size_t Alive() { return m_alive.size(); }
 
 private:
     CWebSocket(CConnection* evconn);
@@ -28,8 +36,11 @@ private:
 
 private:
     CConnection* m_evcon = { nullptr };
+    CTCPServer* m_server = { nullptr };
     CWSParser m_parser;
     Callback m_rdfunc = { nullptr };
+    bool m_shutdown = { false };
+    static thread_local std::unordered_set<CWebSocket*> m_alive;
 };
 
 class CHTTPServer : public CTCPServer {
@@ -40,30 +51,45 @@ public:
         ghttp::HttpMethod cmd;
         ghttp::HttpReqRspCallback cb;
         std::unordered_map<std::string, std::string> header;
+        // http/1.1 bodies are handed over as they arrive, cb still runs once the request is complete
+        ghttp::HttpBodyCallback bodycb = { nullptr };
+        // bytes a request body may have, 0 for the server default
+        uint64_t maxbody = { 0 };
+        // a grpc method, called over http2 without cb
+        std::optional<ghttp::CGrpcService> grpc;
     };
 
 public:
     CHTTPServer() = default;
     CHTTPServer(CHTTPServer&&);
     ~CHTTPServer();
-    bool OnConnected(std::string host, const int32_t fd);
+    // counted when the dispatcher already added the connection to the gauge of the worker
+    bool OnConnected(std::string host, const int32_t fd, const bool counted = false);
     void ServeWs(const std::string path, CWebSocket::Callback cb);
+    // answers 404 for every method under path, typically a wildcard over an api prefix, without looking at the disk
+    void ServeNotFound(const std::string path);
     bool Register(const std::string path, ghttp::HttpMethod cmd, ghttp::HttpReqRspCallback cb);
+    bool Register(const std::string path, ghttp::HttpMethod cmd, ghttp::HttpReqRspCallback cb, ghttp::HttpBodyCallback bodycb, const uint64_t maxbody = 0);
     bool Register(const std::string path, FilterData rd);
+    // a grpc method at "/package.Service/Method"
+    bool RegisterGrpc(const std::string path, ghttp::CGrpcService service);
     bool RegEvent(std::string ename, std::function<HttpEventType> cb);
-    bool Emit(const std::string& path, ghttp::CRequest* req, ghttp::CResponse* rsp);
+    bool Emit(ghttp::CRequest* req, ghttp::CResponse* rsp);
     std::optional<std::pair<ghttp::HttpStatusCode, std::string>> EmitEvent(std::string ename, ghttp::CRequest* req, ghttp::CResponse* rsp);
-    std::optional<FilterData*> GetFilter(const std::string& path);
+    // routes by the path of req, which receives the parameters of the route
+    std::optional<FilterData*> GetFilter(ghttp::CRequest* req);
+    // body limit of the route, main.web.maxbodysize or MAX_HTTP_BODY_SIZE without one
+    static uint64_t BodyLimit(FilterData* filter);
 
 private:
     void destroy();
 
 private:
-    std::unordered_map<std::string, FilterData> m_callbacks;
+    ghttp::CHttpRouter<FilterData> m_router;
     std::unordered_map<std::string, std::function<HttpEventType>> m_ev_callbacks;
 };
 
-class CHTTPClient {
+class CHTTPClient : public CPooled<CHTTPClient> {
 public:
     CHTTPClient();
     ~CHTTPClient();
@@ -84,6 +110,56 @@ public:
     CHTTPServer* GetHttpServer() { return m_httpserver; };
     const std::string& GetURL() { return m_url; }
     bool IsPassive() { return nullptr == m_callback; }
+    // Graceful shutdown of the passive connections of the calling worker, idle ones are closed at once,
+    // busy ones after their response and http2 sessions after GOAWAY once their streams are done
+    static void DrainAll();
+    static bool IsDraining() { return CWorker::LOCAL_WORKER && CWorker::LOCAL_WORKER->IsDraining(); }
+    void SetInflight(const bool inflight) { m_inflight = inflight; }
+
+    // HTTP/1.1 pipelining Api, requests of a passive connection are queued in arrival order and answered in that order
+    // even when their handlers finish out of order
+    ghttp::CStream* QueueRequest();
+    bool IsLastRequest(ghttp::CRequest* req);
+    // bytes responses ready ahead of their turn hold, none while req itself waits behind an earlier request
+    std::optional<size_t> PipelineHeld(ghttp::CRequest* req);
+    // true while HTTP_PIPELINE_DEPTH requests wait for their response, reading resumes once one is written
+    bool PipelineStalled();
+    bool Http1Response(ghttp::CRequest* req, const bool closing, std::string_view head, std::string_view data, std::string* owned, const int32_t fd = -1);
+    // a piece of a streamed response, the request keeps its place in the pipeline until the end
+    bool Http1Stream(ghttp::CRequest* req, const bool closing, std::string_view data, std::string* owned, const bool end);
+    // streamed responses are offered the connection once its output drained
+    void AddWriter(ghttp::CResponse* rsp);
+    void DelWriter(ghttp::CResponse* rsp);
+    // the response of the request being parsed closes the connection
+    bool IsClosing() { return m_refused || IsDraining(); }
+
+    // HTTP/1.1 request body Api, the route is looked up once the headers are in so an oversized body is answered
+    // with 413 before it is read, and a route with a body callback receives the chunks instead of the request
+    void OnRequestBegin();
+    int OnRequestHead(ghttp::CRequest* req, std::optional<uint64_t> length);
+    int OnRequestBody(ghttp::CRequest* req, std::string_view chunk);
+    void OnRequestEnd();
+    CHTTPServer::FilterData* Route() { return m_route; }
+    bool BodyStreamed() { return m_body_streamed; }
+    // answers the request being parsed at once and drops the rest of the connection's input
+    void Refuse(const ghttp::HttpStatusCode status);
+    bool IsRefused() { return m_refused; }
+    // called by a body callback that falls behind, reading from the socket stops until ResumeBody
+    void PauseBody();
+    void ResumeBody();
+    bool BodyPaused() { return m_body_paused; }
+
+    // Deadlines of a passive connection, one at a time for what it waits for: the headers of a request, the next
+    // piece of its body, its handler, the peer reading the response or the next request. An http2 connection
+    // re-arms it on every frame of any of its streams. They live in one coarse timer wheel per worker and close
+    // the connection when they expire, a zero timeout in the config disables one
+    void ArmDeadline(const HttpDeadline d);
+    void DisarmDeadline();
+    std::optional<HttpDeadline> GetDeadline() { return m_deadline; }
+    // advances the deadlines of the calling worker, driven by a HTTP_DEADLINE_TICK timer
+    static void UpdateDeadlines(const uint64_t now);
+    // the time deadlines are armed from, never behind the last update so one re-armed while expiring is not late
+    static uint64_t DeadlineNow();
 
     // Websocket Api
     void SetWSCallback(CWebSocket::Callback cb) { m_wsfunc = cb; }
@@ -93,7 +169,13 @@ public:
     bool IsHttp2() { return nullptr != m_session; }
     bool CheckHttp2();
     bool InitNghttp2SessionData();
-    bool H2Response(ghttp::CRequest* req, const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, std::optional<std::string_view> data);
+    // the body is kept by the stream until its last DATA frame was written, owned is moved there instead of copied
+    bool H2Response(ghttp::CRequest* req, const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, std::string_view data, std::string* owned = nullptr);
+    // the body of rsp is read as it is written, H2Resume wakes the stream up after a write
+    bool H2Stream(ghttp::CResponse* rsp, const ghttp::HttpStatusCode status);
+    bool H2Resume(const int32_t streamid);
+    // the file is sent from the page cache in DATA frames and closed once the last one left
+    bool H2File(ghttp::CRequest* req, const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, const int32_t fd);
     static void OnWrite(CHTTPClient* hclient);
     nghttp2_session* GetNGHttp2Session() { return m_session; }
     ghttp::CStream* CreateStream(const int32_t streamid);
@@ -112,19 +194,71 @@ private:
         uint8_t flags, int32_t stream_id, const uint8_t* data, size_t len, void* user_data);
     static int onBeginHeadersCallback(nghttp2_session* session, const nghttp2_frame* frame, void* user_data);
     static int onBeforeFrameSendCallback(nghttp2_session* session, const nghttp2_frame* frame, void* user_data);
+    static int onInvalidFrameRecvCallback(nghttp2_session* session, const nghttp2_frame* frame, int lib_error_code, void* user_data);
     static int onSendDataCallback(nghttp2_session* session,
         nghttp2_frame* frame,
         const uint8_t* framehd, size_t length,
         nghttp2_data_source* source,
         void* user_data);
+    static ssize_t onReadDataCallback(nghttp2_session* session,
+        int32_t stream_id,
+        uint8_t* buf, size_t length,
+        uint32_t* data_flags,
+        nghttp2_data_source* source,
+        void* user_data);
 
     int onRequestRecv(ghttp::CStream* req);
+    // a grpc request to a grpc method becomes a call as soon as its headers are in
+    void startGrpc(ghttp::CStream* stream);
     void removeStreamData(ghttp::CRequest* s);
-    bool sendFile(ghttp::CRequest* stream_data,
-        const ghttp::HttpStatusCode status, std::unordered_map<std::string, std::string> header, const int32_t fd);
     bool sessionSend();
     bool sendConnectionHeader();
+    // window auto-tuning, bytes received between a PING and its ACK sample the bandwidth-delay product
+    void h2Received(const size_t len);
+    void h2PingAck();
+    void h2Reset();
+    void h2Violation(const H2Violation v);
     bool submitRequest(ghttp::CStream* stream);
+    void drain();
+    bool writeHttp1(const bool closing, std::string_view head, std::string_view data, std::string* owned, const int32_t fd);
+    bool nextResponse(bool ok);
+    void onDeadline();
+    // the deadline that follows a response or the end of a request
+    void armAfterRequest();
+    // idle once the output drained, bounded by the progress of the write until then
+    void armIdle();
+    void afterWrite();
+    void markWrite();
+    size_t outputLength();
+    struct H2Body;
+    bool submitResponse(ghttp::CRequest* req, const ghttp::HttpStatusCode status, const std::unordered_map<std::string, std::string>& header, std::unique_ptr<H2Body> body);
+
+private:
+    struct Pipelined {
+        std::unique_ptr<ghttp::CStream> stream;
+        // a response that is ready before the ones of earlier requests
+        bool answered = { false };
+        bool closing = { false };
+        std::string output;
+        int32_t fd = { -1 };
+    };
+    // Body of an outgoing http2 message. nghttp2 takes it a DATA frame at a time within the flow control window and
+    // onSendDataCallback writes each frame straight from the source into the output buffer, a file as a range of
+    // one evbuffer_file_segment so it is neither read nor copied here
+    struct H2Body {
+        // moved in or copied, a body handed to the call submitting it would not outlive it
+        std::string data;
+        evbuffer_file_segment* segment = { nullptr };
+        ghttp::CResponse* stream = { nullptr };
+        uint64_t size = { 0 };
+        // bytes handed to frames by the read callback, written by the send callback
+        uint64_t read = { 0 };
+        uint64_t sent = { 0 };
+        bool grpc = { false };
+        // value of the content-length header, read by nghttp2 when the HEADERS frame goes out
+        char length[24];
+        ~H2Body();
+    };
 
 private:
     ghttp::HttpRspCallback m_callback = { nullptr };
@@ -139,7 +273,43 @@ private:
     bool m_proxy_connected = { false };
     CWebSocket::Callback m_wsfunc = { nullptr };
     std::map<int32_t, std::unique_ptr<ghttp::CStream>> m_streams;
+    // closed http2 streams with their map nodes, the next streams of the session take them over
+    std::vector<decltype(m_streams)::node_type> m_spare_streams;
+    std::unordered_map<int32_t, std::unique_ptr<H2Body>> m_bodies;
+    std::unordered_map<int32_t, std::unique_ptr<ghttp::CGrpcCall>> m_calls;
     std::unique_ptr<ghttp::CStream> m_base_stream;
+    std::deque<Pipelined> m_pipeline;
+    // streams of answered requests, reused by the next requests of the connection
+    std::vector<std::unique_ptr<ghttp::CStream>> m_spare;
+    bool m_stalled = { false };
+    std::vector<ghttp::CResponse*> m_writers;
+    CHTTPServer::FilterData* m_route = { nullptr };
+    uint64_t m_body_size = { 0 };
+    bool m_body_streamed = { false };
+    bool m_body_paused = { false };
+    bool m_refused = { false };
+    // between the first byte of a request and its end
+    bool m_reading = { false };
+    std::optional<HttpDeadline> m_deadline;
+    uint64_t m_deadline_armed = { 0 };
+    size_t m_write_mark = { 0 };
+    uint32_t m_deadline_id = { 0 };
+    static thread_local CTimerWheel m_deadlines;
+    static thread_local uint32_t m_deadline_ids;
+    static thread_local uint64_t m_deadline_now;
+    bool m_inflight = { false };
+    bool m_goaway = { false };
+    static thread_local std::unordered_set<CHTTPClient*> m_passive;
+    // http2 receive windows as advertised, the ceiling of their tuning, and the sample of the PING in flight
+    uint32_t m_h2window = { H2_STREAM_WINDOW };
+    uint32_t m_h2connwindow = { H2_CONNECTION_WINDOW };
+    uint32_t m_h2maxwindow = { 0 };
+    uint64_t m_bdp_sample = { 0 };
+    bool m_bdp_ping = { false };
+    uint32_t m_resets = { 0 };
+    uint64_t m_resets_second = { 0 };
+    // header bytes of the header block being received
+    uint64_t m_header_bytes = { 0 };
 };
 
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
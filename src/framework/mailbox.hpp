@@ -0,0 +1,139 @@
+#pragma once
+
+#include "common.hpp"
+#include "contex.hpp"
+#include "doorbell.hpp"
+#include "object.hpp"
+#include "ringbuffer.hpp"
+#include "utils.hpp"
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Full mesh of lock-free mailboxes between workers.
+// Every (from, to) pair of two different workers owns a single producer single consumer ring, every receiver
+// owns one doorbell that is only rung when it has drained the ring being written to. A worker does not mail itself.
+class CMailbox : public CObject {
+public:
+    using Callback = std::function<void(const uint16_t from, const uint8_t type, std::string_view data)>;
+
+public:
+    CMailbox() = default;
+    ~CMailbox()
+    {
+        for (auto& v : m_retry) {
+            if (v) {
+                CDEL(v);
+            }
+        }
+    }
+
+    bool Create(const uint16_t n)
+    {
+        CheckCondition(0 == m_size && n > 0, false);
+        m_rings = std::vector<CRingBuffer>(n * (n - 1));
+        m_bells = std::vector<CDoorbell>(n);
+        m_pending.resize(n * (n - 1));
+        m_retry.resize(n, nullptr);
+        for (auto& v : m_rings) {
+            CheckCondition(v.Create(MAILBOX_RING_SIZE), false);
+        }
+        for (auto& v : m_bells) {
+            CheckCondition(v.Create(), false);
+        }
+        m_size = n;
+        return true;
+    }
+
+    uint16_t Size() const { return m_size; }
+
+    // Called on the receiving worker's thread
+    bool Register(const uint16_t self, CContex& ctx, Callback cb)
+    {
+        CheckCondition(self < m_size, false);
+        return m_bells[self].Register(ctx, [this, self, cb]() { this->read(self, cb); });
+    }
+
+    // Called on the sending worker's thread
+    bool Send(const uint16_t from, const uint16_t to, const uint8_t type, std::string_view data)
+    {
+        CheckCondition(from < m_size && to < m_size && from != to, false);
+        CheckCondition(data.size() < MAILBOX_MAX_PACKET_LENGTH, false);
+        const size_t idx = index(from, to);
+        if (!m_pending[idx].empty())
+            flush(from);
+        if (m_pending[idx].empty() && push(idx, to, type, data))
+            return true;
+        // the receiver is behind, keep the order and retry from the sender's contex
+        m_pending[idx].emplace_back(type, std::string(data));
+        retry(from);
+        return true;
+    }
+
+private:
+    static const uint32_t MAILBOX_RING_SIZE = 256 * 1024;
+    static const uint32_t MAILBOX_MAX_PACKET_LENGTH = 64 * 1024 - 1;
+
+    // the from == to pairs have no ring
+    size_t index(const uint16_t from, const uint16_t to) const { return from * (m_size - 1) + (to < from ? to : to - 1); }
+
+    bool push(const size_t idx, const uint16_t to, const uint8_t type, std::string_view data)
+    {
+        bool wakeup = false;
+        CheckCondition(m_rings[idx].Push(type, data, wakeup), false);
+        if (wakeup)
+            m_bells[to].Ring();
+        return true;
+    }
+
+    void read(const uint16_t self, const Callback& cb)
+    {
+        for (uint16_t from = 0; from < m_size; ++from) {
+            if (from == self)
+                continue;
+            auto& rb = m_rings[index(from, self)];
+            auto pos = rb.Peek([&cb, from](const uint8_t type, std::string_view data) {
+                if (cb)
+                    cb(from, type, data);
+            });
+            rb.Release(pos);
+        }
+    }
+
+    void flush(const uint16_t from)
+    {
+        bool again = false;
+        for (uint16_t to = 0; to < m_size; ++to) {
+            if (to == from)
+                continue;
+            const size_t idx = index(from, to);
+            auto& pending = m_pending[idx];
+            while (!pending.empty() && push(idx, to, pending.front().first, pending.front().second)) {
+                pending.pop_front();
+            }
+            again = again || !pending.empty();
+        }
+        if (again)
+            retry(from);
+    }
+
+    void retry(const uint16_t from)
+    {
+        if (!m_retry[from])
+            m_retry[from] = CEvent::Create(-1, 0, [this, from]() { this->flush(from); });
+        CheckConditionVoid(m_retry[from] && !event_pending(m_retry[from]->Event(), EV_TIMEOUT, nullptr));
+        timeval tv = { 0, 1000 };
+        event_add(m_retry[from]->Event(), &tv);
+    }
+
+private:
+    uint16_t m_size = { 0 };
+    std::vector<CRingBuffer> m_rings;
+    std::vector<CDoorbell> m_bells;
+    // touched by the sending worker only
+    std::vector<std::list<std::pair<uint8_t, std::string>>> m_pending;
+    std::vector<CEvent*> m_retry;
+
+    DISABLE_CLASS_COPYABLE(CMailbox);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
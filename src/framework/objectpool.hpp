@@ -0,0 +1,117 @@
+#pragma once
+#include "common.hpp"
+#include "utils.hpp"
+
+#include <cxxabi.h>
+#include <typeinfo>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Per thread free list of equally sized blocks. Released blocks are kept, up to OBJECT_POOL_MAX_CACHED,
+// and handed out again, so steady connection churn does not reach malloc. A block released on another
+// thread than the one it came from simply joins the pool of the releasing thread.
+class CObjectPool {
+    struct Block {
+        Block* next;
+    };
+
+public:
+    struct Stats {
+        std::string_view name;
+        size_t size;
+        uint64_t hits;
+        uint64_t misses;
+        size_t cached;
+    };
+
+    CObjectPool(const char* name, const size_t size)
+        : m_size(size)
+        , m_next(m_pools)
+    {
+        int status = 0;
+        auto demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        m_name = (0 == status && demangled) ? demangled : name;
+        free(demangled);
+        m_pools = this;
+    }
+
+    void* Alloc(const size_t size)
+    {
+        if (size != m_size)
+            return ::operator new(size);
+        if (m_free) {
+            auto b = m_free;
+            m_free = b->next;
+            --m_cached;
+            ++m_hits;
+            return b;
+        }
+        ++m_misses;
+        return ::operator new(size);
+    }
+
+    void Free(void* p, const size_t size)
+    {
+        CheckConditionVoid(p);
+        if (size != m_size || m_cached >= OBJECT_POOL_MAX_CACHED) {
+            ::operator delete(p);
+            return;
+        }
+        auto b = (Block*)p;
+        b->next = m_free;
+        m_free = b;
+        ++m_cached;
+    }
+
+    void Clear()
+    {
+        while (m_free) {
+            auto b = m_free;
+            m_free = b->next;
+            ::operator delete(b);
+        }
+        m_cached = 0;
+    }
+
+    Stats GetStats() const { return { m_name, m_size, m_hits, m_misses, m_cached }; }
+
+    // Pools used by the calling thread
+    template <typename F>
+    static void ForEach(F&& f)
+    {
+        for (auto p = m_pools; p; p = p->m_next)
+            f(*p);
+    }
+    static void ClearAll()
+    {
+        ForEach([](CObjectPool& p) { p.Clear(); });
+    }
+
+private:
+    std::string m_name;
+    const size_t m_size;
+    Block* m_free = { nullptr };
+    size_t m_cached = { 0 };
+    uint64_t m_hits = { 0 };
+    uint64_t m_misses = { 0 };
+    CObjectPool* m_next = { nullptr };
+    static inline thread_local CObjectPool* m_pools = { nullptr };
+
+    DISABLE_CLASS_COPYABLE(CObjectPool);
+};
+
+// Classes deriving from CPooled<T> are allocated from the pool of the calling thread by CNEW and CDEL
+template <typename T>
+class CPooled {
+public:
+    static void* operator new(size_t size) { return Pool().Alloc(size); }
+    static void operator delete(void* p, size_t size) { Pool().Free(p, size); }
+    static CObjectPool& Pool()
+    {
+        // never destroyed, pooled objects may be released after the thread_locals of their thread are gone
+        static thread_local CObjectPool* pool = ::new CObjectPool(typeid(T).name(), sizeof(T));
+        return *pool;
+    }
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include "common.hpp"
+#include "object.hpp"
+#include "utils.hpp"
+
+#include <sys/mman.h>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Lock-free single producer single consumer ring of variable sized records.
+// Records are kept contiguous (a wrap marker pads the tail of the ring), so the consumer
+// can hand out string_views into the ring until it releases them.
+class CRingBuffer : public CObject {
+#pragma pack(1)
+    struct Record {
+        std::uint32_t size;
+        std::uint8_t type;
+        char data[0];
+    };
+#pragma pack()
+    static const uint32_t RECORD_ALIGN = 8;
+    static const uint32_t WRAP_MARKER = std::numeric_limits<uint32_t>::max();
+
+public:
+    CRingBuffer() = default;
+    ~CRingBuffer()
+    {
+        if (m_data)
+            munmap(m_data, m_capacity);
+        m_data = nullptr;
+    }
+
+    bool Create(const size_t capacity)
+    {
+        CheckCondition(!m_data && capacity >= RECORD_ALIGN && 0 == (capacity & (capacity - 1)), false);
+        auto p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        CheckCondition(p != MAP_FAILED, false);
+        m_data = (char*)p;
+        m_capacity = capacity;
+        return true;
+    }
+
+    bool IsValid() const { return nullptr != m_data; }
+    size_t Capacity() const { return m_capacity; }
+
+    // Producer. wakeup is set when the consumer has seen everything before this record and
+    // therefore needs to be signalled.
+    bool Push(const uint8_t type, std::string_view data, bool& wakeup)
+    {
+        wakeup = false;
+        CheckCondition(IsValid() && data.size() < WRAP_MARKER, false);
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t need = align(sizeof(Record) + data.size());
+        const size_t offset = tail & (m_capacity - 1);
+        const size_t pad = m_capacity - offset < need ? m_capacity - offset : 0;
+        CheckCondition(need <= m_capacity, false);
+        if (tail + pad + need - m_head_cache > m_capacity) {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            CheckCondition(tail + pad + need - m_head_cache <= m_capacity, false);
+        }
+
+        if (pad > 0)
+            ((Record*)(m_data + offset))->size = WRAP_MARKER;
+        Record* rec = (Record*)(m_data + ((tail + pad) & (m_capacity - 1)));
+        rec->size = data.size();
+        rec->type = type;
+        data.copy(rec->data, data.size());
+        m_tail.store(tail + pad + need, std::memory_order_seq_cst);
+        wakeup = m_seen.load(std::memory_order_seq_cst) == tail;
+        return true;
+    }
+
+    // Consumer. Visits every published record, the views stay valid until Release(returned position).
+    // Positions may be released in any order, the ring only reclaims up to the oldest one still held.
+    template <typename F>
+    uint64_t Peek(F&& f)
+    {
+        uint64_t pos = m_seen.load(std::memory_order_relaxed);
+        for (;;) {
+            const uint64_t tail = m_tail.load(std::memory_order_acquire);
+            while (pos < tail) {
+                const Record* rec = (const Record*)(m_data + (pos & (m_capacity - 1)));
+                if (WRAP_MARKER == rec->size) {
+                    pos += m_capacity - (pos & (m_capacity - 1));
+                    continue;
+                }
+                f(rec->type, std::string_view(rec->data, rec->size));
+                pos += align(sizeof(Record) + rec->size);
+            }
+            m_seen.store(pos, std::memory_order_seq_cst);
+            // the producer may have published after the tail was loaded without signalling
+            if (m_tail.load(std::memory_order_seq_cst) == pos)
+                break;
+        }
+        if (!m_held.empty() && m_held.back().first == pos)
+            m_held.back().second++;
+        else if (pos > m_head.load(std::memory_order_relaxed))
+            m_held.emplace_back(pos, 1);
+        return pos;
+    }
+
+    void Release(const uint64_t pos)
+    {
+        for (auto& [end, refs] : m_held) {
+            if (end == pos && refs > 0) {
+                --refs;
+                break;
+            }
+        }
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while (!m_held.empty() && 0 == m_held.front().second) {
+            head = m_held.front().first;
+            m_held.pop_front();
+        }
+        if (head > m_head.load(std::memory_order_relaxed))
+            m_head.store(head, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t align(const size_t n) { return (n + RECORD_ALIGN - 1) & ~size_t(RECORD_ALIGN - 1); }
+
+private:
+    alignas(64) std::atomic<uint64_t> m_tail = { 0 };
+    uint64_t m_head_cache = { 0 };
+    alignas(64) std::atomic<uint64_t> m_head = { 0 };
+    std::atomic<uint64_t> m_seen = { 0 };
+    // consumer side, the end of every peek that is not released yet and how many holders it has
+    std::list<std::pair<uint64_t, uint32_t>> m_held;
+    alignas(64) char* m_data = { nullptr };
+    size_t m_capacity = { 0 };
+
+    DISABLE_CLASS_COPYABLE(CRingBuffer);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "service.hpp"
 #include "argument.hpp"
+#include "handoff.hpp"
 #include "signal.hpp"
 #include "stringtool.hpp"
 #include "worker.hpp"
@@ -14,6 +15,9 @@ bool CService::Loop()
 
     InitSignal();
 
+    if (MYARGS.Handoff)
+        CHandoff::Instance().Receive(MYARGS.Handoff.value());
+
     if (!Init())
         return false;
 
@@ -21,6 +25,9 @@ bool CService::Loop()
 
     Start();
 
+    if (MYARGS.Handoff && !CHandoff::Instance().Serve(MYARGS.Handoff.value(), [this]() { this->Drain(); }))
+        SPDLOG_ERROR("CTX:{} serve handoff on {} fail", MYARGS.CTXID, MYARGS.Handoff.value());
+
     CContex::MAIN_CONTEX->Loop();
 
     Destroy();
@@ -52,23 +59,43 @@ void CService::InitSignal()
 
 void CService::Stopping()
 {
+    if (!m_draining && MYARGS.DrainTimeout.value_or(DRAIN_TIMEOUT) > 0) {
+        Drain();
+        return;
+    }
     CWorkerMgr::Instance().SendMsgToAllWorkers(CChannel::MsgType::Text, "stop");
     CContex::MAIN_CONTEX->Exit(1);
 }
 
+void CService::Drain()
+{
+    CheckConditionVoid(!m_draining);
+    m_draining = true;
+    SPDLOG_INFO("CTX:{} draining {} workers", MYARGS.CTXID, CWorker::RunningWorkers());
+    CWorkerMgr::Instance().SendMsgToAllWorkers(CChannel::MsgType::Text, "drain");
+    CContex::MAIN_CONTEX->AddPersistEvent(DRAIN_TIMER_ID, DRAIN_CHECK_INTERVAL, []() {
+        if (0 == CWorker::RunningWorkers())
+            CContex::MAIN_CONTEX->Exit(0);
+    });
+}
+
 void CService::initWorker()
 {
     const auto MAX_WORKER_NUM = MYARGS.Workers.size();
     for (size_t i = 0; i < MAX_WORKER_NUM; ++i) {
         CWorker* w = CWorkerMgr::Instance().Create(MAX_WORKER_NUM);
-        w->SetId(i);
-        w->SetName(std::to_string(MYARGS.Sid.value()) + std::string("_") + std::to_string(i));
-        CArgument arg = MYARGS;
         if (w) {
-            m_threads.push_back(std::thread([w, arg]() { MYARGS = arg; w->Loop(); }));
+            w->SetId(i);
+            w->SetName(std::to_string(MYARGS.Sid.value()) + std::string("_") + std::to_string(i));
+            m_threads.push_back(std::thread([w, arg = MYARGS]() mutable { MYARGS = std::move(arg); w->Loop(); }));
         }
     }
     CWorker::WaitForAllWorkers(MAX_WORKER_NUM);
+
+    if (const uint32_t interval = MYARGS.StatsInterval.value_or(WORKER_STATS_INTERVAL); interval > 0) {
+        CWorkerMgr::Instance().LogStats();
+        CContex::MAIN_CONTEX->AddPersistEvent(WORKER_STATS_TIMER_ID, interval * 1000, []() { CWorkerMgr::Instance().LogStats(); });
+    }
 }
 
 bool CService::Init()
@@ -84,12 +111,16 @@ void CService::Destroy()
 {
     for (auto& v : m_threads)
         v.join();
+    CHandoff::Instance().Destroy();
+    XLOG::Flush();
 }
 
 void CService::Reload()
 {
     MYARGS.ParseYaml();
     XLOG::Reload();
+    if (MYARGS.Dispatch)
+        CWorkerMgr::Instance().SetDispatchPolicy(MYARGS.Dispatch.value());
     Init();
 }
 
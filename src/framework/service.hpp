@@ -19,6 +19,8 @@ public:
     virtual void Start();
     virtual void Destroy();
     virtual void Reload();
+    // Stop accepting and let the workers finish their connections, the loop exits once all of them are gone
+    virtual void Drain();
 
 private:
     void InitSignal();
@@ -28,6 +30,7 @@ private:
 private:
     std::vector<std::thread> m_threads;
     CSignal m_signal;
+    bool m_draining = { false };
 
     DISABLE_CLASS_COPYABLE(CService);
 };
@@ -1,20 +1,48 @@
 #include "tcpserver.hpp"
+#include "argument.hpp"
 #include "connection.hpp"
+#include "handoff.hpp"
 #include "stringtool.hpp"
 #include "xlog.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
 
+std::mutex CTCPServer::m_registry_mutex;
+std::unordered_set<CTCPServer*> CTCPServer::m_registry;
+
 CTCPServer::~CTCPServer()
 {
+    {
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        m_registry.erase(this);
+    }
     destroy();
 }
 
 CTCPServer::CTCPServer(CTCPServer&& rhs)
     : m_listenfd(rhs.m_listenfd)
     , m_ev(rhs.m_ev)
+    , m_resume_ev(rhs.m_resume_ev)
     , m_connected_callback(std::move(rhs.m_connected_callback))
+    , m_accept_batch(rhs.m_accept_batch)
+    , m_max_connections(rhs.m_max_connections)
+    , m_paused(rhs.m_paused)
+    , m_host(rhs.m_host)
+{
+    if (!m_host.empty()) {
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        m_registry.insert(this);
+    }
+}
+
+void CTCPServer::LogStats()
 {
+    std::lock_guard<std::mutex> lock(m_registry_mutex);
+    for (auto v : m_registry) {
+        SPDLOG_INFO("CTX:{} listener {} accepted {} rejected {} paused {} active {}",
+            MYARGS.CTXID, v->m_host, v->m_stats.accepted.load(), v->m_stats.rejected.load(), v->m_stats.paused.load(),
+            v->m_stats.active.load());
+    }
 }
 
 void CTCPServer::destroy()
@@ -23,7 +51,12 @@ void CTCPServer::destroy()
         CContex::MAIN_CONTEX->UnRegister(m_ev);
         m_ev = nullptr;
     }
+    if (nullptr != m_resume_ev) {
+        CContex::MAIN_CONTEX->UnRegister(m_resume_ev);
+        m_resume_ev = nullptr;
+    }
     if (m_listenfd > 0) {
+        CHandoff::Instance().Remove(m_listenfd);
         evutil_closesocket(m_listenfd);
         m_listenfd = -1;
     }
@@ -35,6 +68,40 @@ bool CTCPServer::ListenAndServe(std::string host, std::function<void(const int32
     if (-1 != m_listenfd)
         return true;
 
+    // a socket inherited from the previous process is already bound and listening
+    if (auto fd = CHandoff::Instance().Take(host); fd) {
+        m_listenfd = fd.value();
+        evutil_make_socket_nonblocking(m_listenfd);
+    } else if (!listen(host)) {
+        return false;
+    }
+
+    m_connected_callback = std::move(cb);
+    m_accept_batch = std::max<uint32_t>(MYARGS.AcceptBatch.value_or(ACCEPT_BATCH_SIZE), 1);
+    m_max_connections = MYARGS.MaxConnections.value_or(0);
+    if (m_ev = CContex::MAIN_CONTEX->Register(
+            m_listenfd,
+            EV_READ | EV_PERSIST,
+            nullptr,
+            [this]() {
+                this->onAccept();
+            });
+        !m_ev) {
+        destroy();
+        return false;
+    }
+    CHandoff::Instance().Add(host, m_listenfd);
+    {
+        std::lock_guard<std::mutex> lock(m_registry_mutex);
+        m_host = host;
+        m_registry.insert(this);
+    }
+
+    return true;
+}
+
+bool CTCPServer::listen(const std::string& host)
+{
     auto [_, hostname, port, path] = CConnection::SplitUri(host);
     struct addrinfo hints;
     struct addrinfo *result = nullptr, *rp = nullptr;
@@ -72,22 +139,7 @@ bool CTCPServer::ListenAndServe(std::string host, std::function<void(const int32
         return false;
     }
 
-    if (::listen(m_listenfd, BACKLOG_SIZE) < 0) {
-        destroy();
-        freeaddrinfo(result);
-        return false;
-    }
-
-    m_connected_callback = std::move(cb);
-    if (m_ev = CContex::MAIN_CONTEX->Register(
-            m_listenfd,
-            EV_READ | EV_PERSIST,
-            nullptr,
-            [this]() {
-                if (auto sfd = this->getAcceptFd(); sfd > 0)
-                    this->m_connected_callback(sfd);
-            });
-        !m_ev) {
+    if (::listen(m_listenfd, MYARGS.Backlog.value_or(BACKLOG_SIZE)) < 0) {
         destroy();
         freeaddrinfo(result);
         return false;
@@ -100,12 +152,74 @@ bool CTCPServer::ListenAndServe(std::string host, std::function<void(const int32
 const int32_t CTCPServer::getAcceptFd()
 {
     struct sockaddr_storage addr;
-    socklen_t addrlen = 0;
-    memset(&addr, 0, sizeof(addr));
+    socklen_t addrlen = sizeof(addr);
+#if defined(LINUX_PLATFORMOS)
+    return ::accept4(m_listenfd, (struct sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
     int32_t sfd = ::accept(m_listenfd, (struct sockaddr*)&addr, &addrlen);
-    if (evutil_make_socket_nonblocking(sfd) < 0)
+    if (sfd < 0)
         return -1;
+    if (evutil_make_socket_nonblocking(sfd) < 0 || evutil_make_socket_closeonexec(sfd) < 0) {
+        evutil_closesocket(sfd);
+        return -1;
+    }
     return sfd;
+#endif
+}
+
+// Drain up to m_accept_batch pending connections per wakeup
+void CTCPServer::onAccept()
+{
+    for (uint32_t i = 0; i < m_accept_batch; ++i) {
+        if (m_max_connections > 0 && m_stats.active >= m_max_connections) {
+            pause();
+            return;
+        }
+        auto sfd = getAcceptFd();
+        if (sfd < 0) {
+            auto err = EVUTIL_SOCKET_ERROR();
+            if (EAGAIN == err || EWOULDBLOCK == err || EINTR == err || ECONNABORTED == err)
+                return;
+            // out of fds or memory, back off instead of spinning on a readable listener
+            m_stats.rejected++;
+            SPDLOG_ERROR("CTX:{} accept fail {}", MYARGS.CTXID, evutil_socket_error_to_string(err));
+            pause();
+            return;
+        }
+        m_stats.accepted++;
+        m_stats.active++;
+        m_connected_callback(sfd);
+    }
+}
+
+void CTCPServer::pause()
+{
+    CheckConditionVoid(!m_paused && m_ev);
+    if (!m_resume_ev) {
+        m_resume_ev = CEvent::Create(-1, 0, [this]() { this->resume(); });
+        CheckConditionVoid(m_resume_ev);
+    }
+    event_del(m_ev->Event());
+    m_paused = true;
+    m_stats.paused++;
+    SPDLOG_WARN("CTX:{} listener {} paused, active {} accepted {} rejected {}",
+        MYARGS.CTXID, m_listenfd, m_stats.active.load(), m_stats.accepted.load(), m_stats.rejected.load());
+    timeval tv = { 0, ACCEPT_RESUME_INTERVAL * 1000 };
+    event_add(m_resume_ev->Event(), &tv);
+}
+
+// Connections are closed on the worker threads, so poll the active gauge from the listener's own contex
+void CTCPServer::resume()
+{
+    CheckConditionVoid(m_paused && m_ev);
+    if (m_max_connections > 0 && m_stats.active >= m_max_connections) {
+        timeval tv = { 0, ACCEPT_RESUME_INTERVAL * 1000 };
+        event_add(m_resume_ev->Event(), &tv);
+        return;
+    }
+    m_paused = false;
+    event_add(m_ev->Event(), nullptr);
+    SPDLOG_INFO("CTX:{} listener {} resumed, active {}", MYARGS.CTXID, m_listenfd, m_stats.active.load());
 }
 
 bool CTCPServer::setOption()
@@ -3,25 +3,56 @@
 #include "common.hpp"
 #include "contex.hpp"
 #include "object.hpp"
+#include "utils.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
 
 class CTCPServer : public CObject {
+public:
+    struct Stats {
+        std::atomic<uint64_t> accepted = { 0 };
+        std::atomic<uint64_t> rejected = { 0 };
+        std::atomic<uint64_t> paused = { 0 };
+        std::atomic<int64_t> active = { 0 };
+    };
+
 public:
     CTCPServer() = default;
     CTCPServer(CTCPServer&&);
     ~CTCPServer();
     bool ListenAndServe(std::string host, std::function<void(const int32_t)> cb);
+    // Thread safe, called when a connection accepted by this listener is closed
+    void OnClosed() { m_stats.active--; }
+    const Stats& GetStats() const { return m_stats; }
+    bool IsPaused() const { return m_paused; }
+    // Stop accepting, connections already accepted keep running
+    void Shutdown() { destroy(); }
+    // Counters of every listener of the process, whichever thread accepts on it
+    static void LogStats();
 
 private:
+    bool listen(const std::string& host);
     bool setOption();
     void destroy();
     const int32_t getAcceptFd();
+    void onAccept();
+    void pause();
+    void resume();
 
 private:
     evutil_socket_t m_listenfd = { -1 };
     CEvent* m_ev = { nullptr };
+    CEvent* m_resume_ev = { nullptr };
     std::function<void(const int32_t)> m_connected_callback = { nullptr };
+    uint32_t m_accept_batch = { ACCEPT_BATCH_SIZE };
+    uint32_t m_max_connections = { 0 };
+    bool m_paused = { false };
+    std::string m_host;
+    Stats m_stats;
+
+    // listening servers of every thread, read by LogStats on the main thread
+    static std::mutex m_registry_mutex;
+    static std::unordered_set<CTCPServer*> m_registry;
     // DISABLE_CLASS_COPYABLE(CTCPServer);
 };
 
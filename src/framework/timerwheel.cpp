@@ -0,0 +1,216 @@
+#include "timerwheel.hpp"
+#include "utils.hpp"
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+bool CTimerWheel::Add(const uint32_t id, const uint64_t now, const uint32_t t, const bool persist, Callback cb)
+{
+    // nothing pending, resynchronize the wheel with the caller's clock
+    if (m_ids.empty() && now > m_jiffies)
+        m_jiffies = now;
+
+    TimerNode* node = nullptr;
+    if (auto it = m_ids.find(id); it != m_ids.end()) {
+        node = it->second;
+        unlink(node);
+        node->gen++;
+    } else {
+        if (m_free.empty()) {
+            node = &m_nodes.emplace_back();
+        } else {
+            node = m_free.back();
+            m_free.pop_back();
+        }
+        node->id = id;
+        m_ids.emplace(id, node);
+    }
+    node->persist = persist;
+    node->interval = std::max<uint32_t>(t, 1);
+    node->expires = now + t;
+    node->cb = std::move(cb);
+    insert(node);
+    return true;
+}
+
+bool CTimerWheel::Del(const uint32_t id)
+{
+    auto it = m_ids.find(id);
+    CheckCondition(it != m_ids.end(), false);
+    auto node = it->second;
+    unlink(node);
+    release(node);
+    return true;
+}
+
+void CTimerWheel::Update(const uint64_t now)
+{
+    while (m_jiffies <= now) {
+        const uint32_t index = m_jiffies & TVR_MASK;
+        if (0 == index) {
+            for (uint32_t l = 0; l < TVN_LEVELS; ++l) {
+                if (0 != cascade(m_tvn[l], (m_jiffies >> (TVR_BITS + l * TVN_BITS)) & TVN_MASK))
+                    break;
+            }
+        }
+        // skip empty slots, but never past the next wrap where the upper levels cascade
+        if (auto next = nextPending(index); next != index) {
+            m_jiffies = std::min<uint64_t>(m_jiffies - index + next, now + 1);
+            continue;
+        }
+        ++m_jiffies;
+
+        TimerLink expired;
+        splice(&m_tv1[index], &expired);
+        CUtils::BitSet::Clear((unsigned char*)m_tv1_bits, index);
+        while (expired.next != &expired) {
+            auto node = static_cast<TimerNode*>(expired.next);
+            unlink(node);
+            fire(node, now);
+        }
+    }
+}
+
+std::optional<uint64_t> CTimerWheel::NextExpire() const
+{
+    CheckCondition(!m_ids.empty(), std::nullopt);
+    const uint32_t index = m_jiffies & TVR_MASK;
+    if (auto next = nextPending(index); next < TVR_SIZE)
+        return m_jiffies - index + next;
+    // Nothing in level 0 before its wrap. The wake is at the earliest of the slots behind the wrap and the upper
+    // slots cascaded next instead of at every wrap, the update that wakes up cascades them down on its way
+    const uint64_t wrap = m_jiffies - index + TVR_SIZE;
+    uint64_t next = std::numeric_limits<uint64_t>::max();
+    if (auto slot = nextPending(0); slot < TVR_SIZE)
+        next = wrap + slot;
+    for (uint32_t l = 0; l < TVN_LEVELS; ++l) {
+        const uint32_t shift = TVR_BITS + l * TVN_BITS;
+        // a slot of this level is cascaded when the clock reaches a multiple of its width with the slot's index
+        const uint64_t base = (m_jiffies + (1ULL << shift) - 1) >> shift;
+        for (uint32_t d = 0; d < TVN_SIZE && ((base + d) << shift) < next; ++d) {
+            const TimerLink& head = m_tvn[l][(base + d) & TVN_MASK];
+            if (head.next != &head) {
+                next = (base + d) << shift;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void CTimerWheel::Clear()
+{
+    for (auto& [_, node] : m_ids) {
+        unlink(node);
+        node->gen++;
+        node->cb = nullptr;
+        m_free.push_back(node);
+    }
+    m_ids.clear();
+}
+
+void CTimerWheel::insert(TimerNode* node)
+{
+    const uint64_t expires = node->expires;
+    TimerLink* head = nullptr;
+    if (expires < m_jiffies || expires - m_jiffies < TVR_SIZE) {
+        const uint32_t index = (expires < m_jiffies ? m_jiffies : expires) & TVR_MASK;
+        head = &m_tv1[index];
+        CUtils::BitSet::Set((unsigned char*)m_tv1_bits, index);
+    } else {
+        const uint64_t idx = std::min<uint64_t>(expires - m_jiffies, std::numeric_limits<uint32_t>::max());
+        const uint64_t clamped = m_jiffies + idx;
+        for (uint32_t l = 0; l < TVN_LEVELS; ++l) {
+            const uint32_t shift = TVR_BITS + l * TVN_BITS;
+            if (l + 1 == TVN_LEVELS || idx < (1ULL << (shift + TVN_BITS))) {
+                head = &m_tvn[l][(clamped >> shift) & TVN_MASK];
+                break;
+            }
+        }
+    }
+    node->head = head;
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void CTimerWheel::unlink(TimerNode* node)
+{
+    CheckConditionVoid(node->head);
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = node;
+    auto head = node->head;
+    node->head = nullptr;
+    if (head->next == head && (uintptr_t)head - (uintptr_t)m_tv1 < sizeof(m_tv1)) {
+        CUtils::BitSet::Clear((unsigned char*)m_tv1_bits, head - m_tv1);
+    }
+}
+
+void CTimerWheel::release(TimerNode* node)
+{
+    m_ids.erase(node->id);
+    node->gen++;
+    node->cb = nullptr;
+    m_free.push_back(node);
+}
+
+void CTimerWheel::fire(TimerNode* node, const uint64_t now)
+{
+    const auto gen = node->gen;
+    const auto persist = node->persist;
+    // the callback may delete or re-arm its own timer, so run it from a local copy
+    Callback cb = std::move(node->cb);
+    node->cb = nullptr;
+    if (!persist)
+        release(node);
+    if (cb)
+        cb();
+    // deleted or re-armed inside the callback
+    if (!persist || node->gen != gen)
+        return;
+    node->cb = std::move(cb);
+    node->expires += node->interval;
+    if (node->expires <= now)
+        node->expires = now + node->interval;
+    insert(node);
+}
+
+uint32_t CTimerWheel::cascade(TimerLink* tv, const uint32_t index)
+{
+    TimerLink pending;
+    splice(&tv[index], &pending);
+    while (pending.next != &pending) {
+        auto node = static_cast<TimerNode*>(pending.next);
+        unlink(node);
+        insert(node);
+    }
+    return index;
+}
+
+uint32_t CTimerWheel::nextPending(const uint32_t index) const
+{
+    for (uint32_t w = index / 64; w < TVR_SIZE / 64; ++w) {
+        uint64_t bits = m_tv1_bits[w];
+        if (w == index / 64)
+            bits &= ~0ULL << (index % 64);
+        if (bits)
+            return w * 64 + __builtin_ctzll(bits);
+    }
+    return TVR_SIZE;
+}
+
+void CTimerWheel::splice(TimerLink* from, TimerLink* to)
+{
+    CheckConditionVoid(from->next != from);
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    from->next = from->prev = from;
+    for (auto l = to->next; l != to; l = l->next) {
+        static_cast<TimerNode*>(l)->head = to;
+    }
+}
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include "common.hpp"
+#include "object.hpp"
+
+#include <deque>
+
+NAMESPACE_FRAMEWORK_BEGIN
+
+// Hierarchical timer wheel with millisecond resolution.
+// Level 0 holds 256 one-millisecond slots, the upper four levels hold 64 slots each,
+// which covers the whole uint32_t millisecond range. Add, Del and re-arm by id are O(1),
+// expired slots are cascaded down lazily when the level 0 index wraps.
+class CTimerWheel : public CObject {
+public:
+    using Callback = std::function<void()>;
+
+private:
+    static const uint32_t TVN_BITS = 6;
+    static const uint32_t TVR_BITS = 8;
+    static const uint32_t TVN_SIZE = 1 << TVN_BITS;
+    static const uint32_t TVR_SIZE = 1 << TVR_BITS;
+    static const uint32_t TVN_MASK = TVN_SIZE - 1;
+    static const uint32_t TVR_MASK = TVR_SIZE - 1;
+    static const uint32_t TVN_LEVELS = 4;
+
+    struct TimerLink {
+        TimerLink* prev = { this };
+        TimerLink* next = { this };
+    };
+    struct TimerNode : public TimerLink {
+        TimerLink* head = { nullptr };
+        uint64_t expires = { 0 };
+        uint32_t interval = { 0 };
+        uint32_t id = { 0 };
+        uint32_t gen = { 0 };
+        bool persist = { false };
+        Callback cb = { nullptr };
+    };
+
+public:
+    CTimerWheel() = default;
+    ~CTimerWheel() = default;
+    bool Add(const uint32_t id, const uint64_t now, const uint32_t t, const bool persist, Callback cb);
+    bool Del(const uint32_t id);
+    bool Has(const uint32_t id) const { return m_ids.find(id) != m_ids.end(); }
+    void Update(const uint64_t now);
+    std::optional<uint64_t> NextExpire() const;
+    size_t Size() const { return m_ids.size(); }
+    void Clear();
+
+private:
+    void insert(TimerNode* node);
+    void unlink(TimerNode* node);
+    void release(TimerNode* node);
+    void fire(TimerNode* node, const uint64_t now);
+    uint32_t cascade(TimerLink* tv, const uint32_t index);
+    uint32_t nextPending(const uint32_t index) const;
+    static void splice(TimerLink* from, TimerLink* to);
+
+private:
+    uint64_t m_jiffies = { 0 };
+    TimerLink m_tv1[TVR_SIZE];
+    TimerLink m_tvn[TVN_LEVELS][TVN_SIZE];
+    uint64_t m_tv1_bits[TVR_SIZE / 64] = { 0 };
+    std::deque<TimerNode> m_nodes;
+    std::vector<TimerNode*> m_free;
+    std::unordered_map<uint32_t, TimerNode*> m_ids;
+
+    DISABLE_CLASS_COPYABLE(CTimerWheel);
+};
+
+NAMESPACE_FRAMEWORK_END
\ No newline at end of file
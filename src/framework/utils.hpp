@@ -34,6 +34,60 @@ static const uint32_t MAX_HTTP_BODY_SIZE = 1024 * 64;
 static const uint32_t MAX_HTTP_HEAD_SIZE = 1024 * 64;
 static uint32_t MAX_WATERMARK_SIZE = 1024 * 64;
 static const uint32_t BACKLOG_SIZE = 512;
+static const uint32_t ACCEPT_BATCH_SIZE = 64;
+static const uint32_t ACCEPT_RESUME_INTERVAL = 100;
+static const uint32_t READ_IOVEC_SIZE = 16;
+static const uint32_t SEND_REFERENCE_SIZE = 1024;
+static const uint32_t HTTP_HEADER_INLINE = 16;
+static const uint32_t HTTP_HEADER_ARENA_SIZE = 1024;
+static const uint32_t HTTP_PIPELINE_DEPTH = 16;
+static const uint32_t OBJECT_POOL_MAX_CACHED = 4096;
+static const uint32_t WORKER_STATS_INTERVAL = 60;
+static const uint32_t DRAIN_TIMEOUT = 10;
+static const uint32_t DRAIN_CHECK_INTERVAL = 100;
+static const uint32_t WORKER_STATS_TIMER_ID = 0xFFFF0001;
+static const uint32_t DRAIN_TIMER_ID = 0xFFFF0002;
+static const uint32_t HTTP_DATE_TIMER_ID = 0xFFFF0003;
+static const uint32_t HTTP_DEADLINE_TIMER_ID = 0xFFFF0004;
+// http deadlines are checked at this granularity, they fire up to one tick late
+static const uint32_t HTTP_DEADLINE_TICK = 1000;
+static const uint32_t HTTP_HEADER_TIMEOUT = 10;
+static const uint32_t HTTP_HANDLER_TIMEOUT = 30;
+// http2 receive windows, the connection window starts past the 64KB of the protocol and both grow with the
+// measured bandwidth-delay product up to H2_MAX_WINDOW
+static const uint32_t H2_STREAM_WINDOW = 65535;
+static const uint32_t H2_CONNECTION_WINDOW = 1024 * 1024;
+static const uint32_t H2_MAX_WINDOW = 16 * 1024 * 1024;
+static const uint32_t H2_MAX_STREAMS = 100;
+// closed streams a session keeps for its next ones
+static const uint32_t H2_SPARE_STREAMS = 8;
+static const uint32_t H2_MAX_FRAME = 16384;
+static const uint32_t H2_MAX_FRAME_LIMIT = 16777215;
+// RST_STREAM frames a client may send per second before its connection is closed
+static const uint32_t H2_MAX_RESETS = 200;
+// grpc messages below this many bytes are sent uncompressed, and a compressed one may not inflate past this ratio
+static const uint32_t GRPC_COMPRESS_MIN = 1024;
+static const uint32_t GRPC_MAX_RATIO = 100;
+
+// what a passive http connection waits for, each with its own timeout and counter
+enum class HttpDeadline : uint8_t {
+    HEADER = 0,
+    BODY,
+    IDLE,
+    HANDLER,
+    WRITE,
+    COUNT
+};
+
+// limits an http2 peer broke, counted per worker
+enum class H2Violation : uint8_t {
+    STREAMS = 0,
+    HEADERLIST,
+    FRAMESIZE,
+    FLOWCONTROL,
+    RESETFLOOD,
+    COUNT
+};
 
 class CUtils {
 public:
@@ -101,6 +155,21 @@ public:
     {
         return (hashworkerid & 0xFFFF0000) | ((hashworkerid & 0xFF00) >> 8);
     }
+    // FNV-1a with a murmur3 finalizer, stable across processes
+    static constexpr uint64_t Hash64(std::string_view s)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (auto c : s) {
+            h ^= (uint8_t)c;
+            h *= 0x100000001b3ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
     static uint32_t Hton32(const uint32_t v)
     {
         return htonl(v);
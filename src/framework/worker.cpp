@@ -1,26 +1,42 @@
 #include "worker.hpp"
 #include "argument.hpp"
+#include "chrono.hpp"
+#include "httpserver.hpp"
+#include "objectpool.hpp"
+#include "random.hpp"
 #include "ssl.hpp"
 #include "stringtool.hpp"
 #include "xlog.hpp"
 
 #include "nlohmann/json.hpp"
 
+#if defined(LINUX_PLATFORMOS)
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+
 NAMESPACE_FRAMEWORK_BEGIN
 
 std::mutex CWorker::m_mutex;
 std::condition_variable CWorker::m_cond;
 int32_t CWorker::m_init_threads;
+std::atomic<int32_t> CWorker::m_running_threads = { 0 };
 thread_local CWorker* CWorker::LOCAL_WORKER = nullptr;
 
 bool CWorker::Loop()
 {
     LOCAL_WORKER = this;
+    m_running_threads++;
+    bindThread();
     CContex::MAIN_CONTEX.reset(CNEW CContex(event_base_new()));
     assert(nullptr != CContex::MAIN_CONTEX);
 
     if (!Init()) {
         initOk();
+        if (m_broadcast_reader)
+            m_broadcast_reader->Unsubscribe();
+        unbindThread();
+        m_running_threads--;
         return false;
     }
 
@@ -29,16 +45,123 @@ bool CWorker::Loop()
     CContex::MAIN_CONTEX->Loop();
 
     Destroy();
+    // a worker that is gone must not keep every later broadcast alive
+    if (m_broadcast_reader)
+        m_broadcast_reader->Unsubscribe();
+    CObjectPool::ClearAll();
+    unbindThread();
+    m_running_threads--;
 
     return true;
 }
 
-void CWorker::readOnLeft(bufferevent* bev, void* ctx)
+void CWorker::Drain(const uint32_t timeout)
+{
+    CheckConditionVoid(!m_draining);
+    m_draining = true;
+    m_drain_deadline = CChrono::SteadyMs() + timeout;
+    SPDLOG_INFO("CTX:{} draining {} connections", MYARGS.CTXID, ActiveConnections());
+    OnDrain();
+    drainTick();
+    CContex::MAIN_CONTEX->AddPersistEvent(DRAIN_TIMER_ID, DRAIN_CHECK_INTERVAL, [this]() { this->drainTick(); });
+}
+
+// Connections accepted while draining are handled the same way on the next tick
+void CWorker::drainTick()
+{
+    CHTTPClient::DrainAll();
+    CWebSocket::DrainAll();
+    const auto active = ActiveConnections();
+    if (active > 0 && CChrono::SteadyMs() < m_drain_deadline)
+        return;
+    if (active > 0)
+        SPDLOG_WARN("CTX:{} drain timeout, {} connections are dropped", MYARGS.CTXID, active);
+    CContex::MAIN_CONTEX->DelEvent(DRAIN_TIMER_ID);
+    OnDrained();
+    CContex::MAIN_CONTEX->Exit(0);
+}
+
+// Runs first on the worker thread, so the event base and everything the worker allocates afterwards
+// comes from the preferred numa node
+void CWorker::bindThread()
+{
+#if defined(LINUX_PLATFORMOS)
+    pthread_setname_np(pthread_self(), Name().substr(0, 15).c_str());
+    clockid_t cid;
+    if (0 == pthread_getcpuclockid(pthread_self(), &cid)) {
+        std::lock_guard<std::mutex> lk(m_cpu_mutex);
+        m_cpu_clock = cid;
+    }
+
+    CheckConditionVoid(!MYARGS.CpuAffinity.empty());
+    const int32_t cpu = MYARGS.CpuAffinity[Id() % MYARGS.CpuAffinity.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (0 != pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        SPDLOG_ERROR("CTX:{} worker {} bind cpu {} fail", MYARGS.CTXID, Name(), cpu);
+        return;
+    }
+    CheckConditionVoid(MYARGS.NumaBind.value_or(false));
+
+    std::optional<int32_t> node;
+    std::error_code ec;
+    for (auto& v : std::filesystem::directory_iterator(fmt::format("/sys/devices/system/cpu/cpu{}", cpu), ec)) {
+        auto name = v.path().filename().string();
+        if (name.size() > 4 && 0 == name.compare(0, 4, "node")) {
+            node = std::atoi(name.c_str() + 4);
+            break;
+        }
+    }
+    unsigned long mask = 0;
+    if (!node || node.value() < 0 || node.value() >= (int32_t)sizeof(mask) * 8) {
+        SPDLOG_ERROR("CTX:{} worker {} unknown numa node of cpu {}", MYARGS.CTXID, Name(), cpu);
+        return;
+    }
+    // preferred rather than bound, a full node falls back to the others instead of failing allocations
+    mask = 1UL << node.value();
+    if (0 != syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8)) {
+        SPDLOG_ERROR("CTX:{} worker {} bind numa node {} fail {}", MYARGS.CTXID, Name(), node.value(), strerror(errno));
+        return;
+    }
+    SPDLOG_INFO("CTX:{} worker {} bind cpu {} numa node {}", MYARGS.CTXID, Name(), cpu, node.value());
+#endif
+}
+
+// The clock of a thread is gone once the thread exited, it keeps what it used last
+void CWorker::unbindThread()
+{
+#if defined(LINUX_PLATFORMOS)
+    std::lock_guard<std::mutex> lk(m_cpu_mutex);
+    timespec ts;
+    if (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        m_cpu_used = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    m_cpu_clock = -1;
+#endif
+}
+
+uint64_t CWorker::CpuTimeUs() const
 {
-    CWorker* w = (CWorker*)ctx;
+#if defined(LINUX_PLATFORMOS)
+    // the thread cannot exit while its clock is read
+    std::lock_guard<std::mutex> lk(m_cpu_mutex);
+    timespec ts;
+    if (m_cpu_clock != -1 && 0 == clock_gettime(m_cpu_clock, &ts))
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    return m_cpu_used;
+#else
+    return 0;
+#endif
+}
+
+void CWorker::readOnLeft(CWorker* w)
+{
+    // a broadcast published before a direct message is handled before it
+    readOnBroadcast(w);
     auto res = w->m_main_and_work_chan.ReadL();
-    for (auto v : res) {
-        auto& [type, data] = v;
+    if (res.Corrupted() > 0)
+        SPDLOG_ERROR("CTX:{} channel dropped {} corrupt frames from main", MYARGS.CTXID, res.Corrupted());
+    for (auto& [type, data] : res) {
         if (type && data) {
             if (auto it = w->m_left_callbacks.find(type.value()); it != w->m_left_callbacks.end()) {
                 it->second(data.value());
@@ -47,12 +170,12 @@ void CWorker::readOnLeft(bufferevent* bev, void* ctx)
     }
 }
 
-void CWorker::readOnRight(bufferevent* bev, void* ctx)
+void CWorker::readOnRight(CWorker* w)
 {
-    CWorker* w = (CWorker*)ctx;
     auto res = w->m_main_and_work_chan.ReadR();
-    for (auto v : res) {
-        auto& [type, data] = v;
+    if (res.Corrupted() > 0)
+        SPDLOG_ERROR("CTX:{} channel dropped {} corrupt frames from worker {}", MYARGS.CTXID, res.Corrupted(), w->Name());
+    for (auto& [type, data] : res) {
         if (type && data) {
             if (auto it = w->m_right_callbacks.find(type.value()); it != w->m_right_callbacks.end()) {
                 it->second(data.value());
@@ -61,6 +184,22 @@ void CWorker::readOnRight(bufferevent* bev, void* ctx)
     }
 }
 
+void CWorker::readOnBroadcast(CWorker* w)
+{
+    w->m_broadcast_reader->Read([w](const uint8_t type, std::string_view data) {
+        if (auto it = w->m_left_callbacks.find(CChannel::MsgType(type)); it != w->m_left_callbacks.end() && it->second) {
+            it->second(data);
+        }
+    });
+}
+
+void CWorker::readOnMailbox(CWorker* w, const uint16_t from, const uint8_t type, std::string_view data)
+{
+    if (auto it = w->m_left_callbacks.find(CChannel::MsgType(type)); it != w->m_left_callbacks.end() && it->second) {
+        it->second(data);
+    }
+}
+
 void CWorker::OnLeftEvent(
     std::function<void(std::string_view)> textcb,
     std::function<void(std::string_view)> jsoncb,
@@ -83,10 +222,18 @@ void CWorker::OnRightEvent(
 
 bool CWorker::Init()
 {
-    if (!m_main_and_work_chan.CreateBvL(*CContex::MAIN_CONTEX, CWorker::readOnLeft, nullptr, nullptr, this)) {
+    if (!m_main_and_work_chan.CreateL(*CContex::MAIN_CONTEX, [this]() { CWorker::readOnLeft(this); })) {
         SPDLOG_ERROR("CTX:{} create channel fail", MYARGS.CTXID);
         return false;
     }
+    if (!m_broadcast_reader || !m_broadcast_reader->Register(*CContex::MAIN_CONTEX, [this]() { CWorker::readOnBroadcast(this); })) {
+        SPDLOG_ERROR("CTX:{} create broadcast reader fail", MYARGS.CTXID);
+        return false;
+    }
+    if (!m_mailbox || !m_mailbox->Register(Id(), *CContex::MAIN_CONTEX, [this](const uint16_t from, const uint8_t type, std::string_view data) { CWorker::readOnMailbox(this, from, type, data); })) {
+        SPDLOG_ERROR("CTX:{} create mailbox fail", MYARGS.CTXID);
+        return false;
+    }
     MYARGS.CTXID = Name();
     MYARGS.Tid = Id();
 
@@ -94,13 +241,72 @@ bool CWorker::Init()
         SPDLOG_ERROR("CTX:{} init ssl contex", MYARGS.CTXID);
         return false;
     }
+    if (const uint32_t interval = MYARGS.StatsInterval.value_or(WORKER_STATS_INTERVAL); interval > 0) {
+        CContex::MAIN_CONTEX->AddPersistEvent(WORKER_STATS_TIMER_ID, interval * 1000, []() { CWorker::logPools(); });
+    }
 
     return true;
 }
 
+void CWorker::logPools()
+{
+    CObjectPool::ForEach([](CObjectPool& pool) {
+        const auto st = pool.GetStats();
+        const uint64_t total = st.hits + st.misses;
+        SPDLOG_INFO("CTX:{} pool {} hit {:.1f}% of {} allocations cached {} KB",
+            MYARGS.CTXID, st.name, total > 0 ? st.hits * 100.0 / total : 0.0, total, st.cached * st.size / 1024);
+    });
+}
+
 bool CWorker::SendMsgToMain(const CChannel::MsgType type, std::string_view data)
 {
-    return m_main_and_work_chan.WriteL(type, data);
+    if (!m_main_and_work_chan.WriteL(type, data)) {
+        SPDLOG_ERROR("CTX:{} send to main fail type {} size {}", MYARGS.CTXID, (uint8_t)type, data.size());
+        return false;
+    }
+    return true;
+}
+
+bool CWorker::SendMsgToMain(const CChannel::MsgType type, std::string&& data)
+{
+    const size_t size = data.size();
+    if (!m_main_and_work_chan.WriteL(type, std::move(data))) {
+        SPDLOG_ERROR("CTX:{} send to main fail type {} size {}", MYARGS.CTXID, (uint8_t)type, size);
+        return false;
+    }
+    return true;
+}
+
+bool CWorker::SendToWorker(const uint16_t id, const CChannel::MsgType type, std::string_view data)
+{
+    CheckCondition(m_mailbox, false);
+    // the mailbox has no ring to the sender itself, its part is handled right away
+    if (id == Id()) {
+        readOnMailbox(this, id, (uint8_t)type, data);
+        return true;
+    }
+    return m_mailbox->Send(Id(), id, (uint8_t)type, data);
+}
+
+bool CWorker::MulticastToWorkers(const std::vector<uint16_t>& ids, const CChannel::MsgType type, std::string_view data)
+{
+    CheckCondition(m_mailbox, false);
+    bool ok = true;
+    for (auto id : ids) {
+        ok = SendToWorker(id, type, data) && ok;
+    }
+    return ok;
+}
+
+bool CWorker::MulticastToWorkers(const CChannel::MsgType type, std::string_view data)
+{
+    CheckCondition(m_mailbox, false);
+    bool ok = true;
+    for (uint16_t id = 0; id < m_mailbox->Size(); ++id) {
+        if (id != Id())
+            ok = m_mailbox->Send(Id(), id, (uint8_t)type, data) && ok;
+    }
+    return ok;
 }
 
 void CWorker::initOk()
@@ -124,22 +330,122 @@ CWorker* CWorkerMgr::Create(const uint64_t total)
 
     CWorker* w = m_mgr.back().get();
     w->OnRightEvent(m_textcb, m_jsoncb, m_binarycb);
+    if (MYARGS.Dispatch)
+        SetDispatchPolicy(MYARGS.Dispatch.value());
 
     if (!w->m_main_and_work_chan.Create())
         return nullptr;
 
-    if (!w->m_main_and_work_chan.CreateBvR(*CContex::MAIN_CONTEX, CWorker::readOnRight, nullptr, nullptr, w))
+    if (w->m_broadcast_reader = m_broadcast.Subscribe(); !w->m_broadcast_reader)
+        return nullptr;
+
+    // the mesh has to exist before the first worker thread starts
+    if (!m_mailbox) {
+        m_mailbox = std::make_shared<CMailbox>();
+        if (!m_mailbox->Create(total))
+            return nullptr;
+    }
+    w->m_mailbox = m_mailbox;
+
+    if (!w->m_main_and_work_chan.CreateR(*CContex::MAIN_CONTEX, [w]() { CWorker::readOnRight(w); }))
         return nullptr;
 
     return w;
 }
 
-bool CWorkerMgr::SendMsgToOneWorker(const CChannel::MsgType type, std::string_view data)
+bool CWorkerMgr::SendMsgToOneWorker(const CChannel::MsgType type, std::string_view data, std::optional<uint64_t> key)
+{
+    if (m_mgr.empty())
+        return false;
+    return sendTo(selectWorker(key), type, data);
+}
+
+bool CWorkerMgr::DispatchConnection(const CChannel::MsgType type, std::string_view data, std::optional<uint64_t> key)
 {
     if (m_mgr.empty())
         return false;
-    m_round_index = (m_round_index + 1) % m_mgr.size();
-    return m_mgr[m_round_index]->m_main_and_work_chan.WriteR(type, std::move(data));
+    const size_t idx = selectWorker(key);
+    m_mgr[idx]->IncConnection();
+    if (!sendTo(idx, type, data)) {
+        m_mgr[idx]->DecConnection();
+        return false;
+    }
+    return true;
+}
+
+bool CWorkerMgr::sendTo(const size_t idx, const CChannel::MsgType type, std::string_view data)
+{
+    // broadcasts posted earlier are published first, the worker reads them before its channel
+    flushPosted();
+    auto& w = m_mgr[idx];
+    if (!w->m_main_and_work_chan.WriteR(type, data)) {
+        SPDLOG_ERROR("CTX:{} send to worker {} fail type {} size {}", MYARGS.CTXID, w->Name(), (uint8_t)type, data.size());
+        return false;
+    }
+    return true;
+}
+
+void CWorkerMgr::SetDispatchPolicy(const std::string& name)
+{
+    static const std::unordered_map<std::string, DispatchPolicy> policies = {
+        { "roundrobin", DispatchPolicy::RoundRobin },
+        { "leastconn", DispatchPolicy::LeastConn },
+        { "p2c", DispatchPolicy::PowerOfTwo },
+        { "hash", DispatchPolicy::ConsistentHash },
+    };
+    if (auto it = policies.find(CStringTool::ToLower(name)); it != policies.end()) {
+        m_policy = it->second;
+    } else {
+        SPDLOG_ERROR("CTX:{} unknown dispatch policy {}", MYARGS.CTXID, name);
+    }
+}
+
+size_t CWorkerMgr::selectWorker(std::optional<uint64_t> key)
+{
+    const size_t n = m_mgr.size();
+    m_round_index = (m_round_index + 1) % n;
+    switch (m_policy) {
+    case DispatchPolicy::LeastConn: {
+        // start from the rotating index so ties do not all land on the first worker
+        size_t best = m_round_index;
+        for (size_t i = 1; i < n; ++i) {
+            size_t idx = (m_round_index + i) % n;
+            if (m_mgr[idx]->ActiveConnections() < m_mgr[best]->ActiveConnections())
+                best = idx;
+        }
+        return best;
+    }
+    case DispatchPolicy::PowerOfTwo: {
+        CheckCondition(n > 1, 0);
+        size_t a = RANDOM.Rand(0, n - 1);
+        size_t b = RANDOM.Rand(0, n - 2);
+        if (b >= a)
+            ++b;
+        return m_mgr[b]->ActiveConnections() < m_mgr[a]->ActiveConnections() ? b : a;
+    }
+    case DispatchPolicy::ConsistentHash: {
+        CheckCondition(key.has_value(), m_round_index);
+        if (m_hash_ring.size() != n * HASH_RING_VNODES)
+            buildHashRing();
+        auto it = std::lower_bound(m_hash_ring.begin(), m_hash_ring.end(), std::make_pair(key.value(), (uint16_t)0));
+        return it == m_hash_ring.end() ? m_hash_ring.front().second : it->second;
+    }
+    default:
+        return m_round_index;
+    }
+}
+
+// Virtual nodes are keyed by worker name, so the ring is the same on every restart
+void CWorkerMgr::buildHashRing()
+{
+    m_hash_ring.clear();
+    m_hash_ring.reserve(m_mgr.size() * HASH_RING_VNODES);
+    for (size_t i = 0; i < m_mgr.size(); ++i) {
+        for (uint32_t v = 0; v < HASH_RING_VNODES; ++v) {
+            m_hash_ring.emplace_back(CUtils::Hash64(m_mgr[i]->Name() + "#" + std::to_string(v)), (uint16_t)i);
+        }
+    }
+    std::sort(m_hash_ring.begin(), m_hash_ring.end());
 }
 
 void CWorker::WaitForAllWorkers(const int32_t total)
@@ -165,12 +471,62 @@ bool CWorkerMgr::Register(
     return true;
 }
 
+CWorkerMgr::~CWorkerMgr()
+{
+    if (m_post_ev) {
+        CDEL(m_post_ev);
+    }
+}
+
 bool CWorkerMgr::SendMsgToAllWorkers(const CChannel::MsgType type, std::string_view data)
 {
-    for (auto& w : m_mgr) {
-        w->m_main_and_work_chan.WriteR(type, std::move(data));
+    CheckCondition(!m_mgr.empty(), false);
+    flushPosted();
+    return m_broadcast.Publish((uint8_t)type, data);
+}
+
+bool CWorkerMgr::PostMsgToAllWorkers(const CChannel::MsgType type, std::string_view data)
+{
+    CheckCondition(!m_mgr.empty(), false);
+    if (!m_post_ev) {
+        m_post_ev = CEvent::Create(-1, 0, [this]() { this->flushPosted(); });
+        CheckCondition(m_post_ev, SendMsgToAllWorkers(type, data));
     }
+    if (m_posted.empty())
+        event_active(m_post_ev->Event(), EV_TIMEOUT, 1);
+    m_posted.push_back(CBroadcastLog::Message { (uint8_t)type, std::string(data) });
     return true;
 }
 
+void CWorkerMgr::LogStats()
+{
+    const uint64_t now = CChrono::SteadyMs();
+    const uint64_t elapsed = now > m_last_stats_ms ? now - m_last_stats_ms : 0;
+    m_last_stats_ms = now;
+    m_last_cpu_us.resize(m_mgr.size(), 0);
+    for (size_t i = 0; i < m_mgr.size(); ++i) {
+        const uint64_t cpu = m_mgr[i]->CpuTimeUs();
+        const uint64_t delta = cpu > m_last_cpu_us[i] ? cpu - m_last_cpu_us[i] : 0;
+        m_last_cpu_us[i] = cpu;
+        SPDLOG_INFO("CTX:{} worker {} cpu {} ms usage {:.1f}% connections {} timeouts header {} body {} idle {} handler {} write {} "
+                    "h2 violations streams {} headerlist {} framesize {} flowcontrol {} resetflood {} "
+                    "grpc compression saved {} bytes",
+            MYARGS.CTXID, m_mgr[i]->Name(), cpu / 1000, elapsed > 0 ? delta / 10.0 / elapsed : 0.0, m_mgr[i]->ActiveConnections(),
+            m_mgr[i]->HttpTimeouts(HttpDeadline::HEADER), m_mgr[i]->HttpTimeouts(HttpDeadline::BODY),
+            m_mgr[i]->HttpTimeouts(HttpDeadline::IDLE), m_mgr[i]->HttpTimeouts(HttpDeadline::HANDLER),
+            m_mgr[i]->HttpTimeouts(HttpDeadline::WRITE),
+            m_mgr[i]->H2Violations(H2Violation::STREAMS), m_mgr[i]->H2Violations(H2Violation::HEADERLIST),
+            m_mgr[i]->H2Violations(H2Violation::FRAMESIZE), m_mgr[i]->H2Violations(H2Violation::FLOWCONTROL),
+            m_mgr[i]->H2Violations(H2Violation::RESETFLOOD), m_mgr[i]->GrpcSaved());
+    }
+    CTCPServer::LogStats();
+}
+
+void CWorkerMgr::flushPosted()
+{
+    CheckConditionVoid(!m_posted.empty());
+    m_broadcast.Publish(std::move(m_posted));
+    m_posted.clear();
+}
+
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
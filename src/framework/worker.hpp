@@ -1,9 +1,12 @@
 #pragma once
+#include "broadcast.hpp"
 #include "channel.hpp"
 #include "common.hpp"
 #include "contex.hpp"
+#include "mailbox.hpp"
 #include "object.hpp"
 #include "singleton.hpp"
+#include "utils.hpp"
 
 NAMESPACE_FRAMEWORK_BEGIN
 
@@ -21,12 +24,43 @@ public:
 
     CChannel& Channel() { return m_main_and_work_chan; }
     bool SendMsgToMain(const CChannel::MsgType type, std::string_view data);
+    bool SendMsgToMain(const CChannel::MsgType type, std::string&& data);
+    // Worker to worker messages skip the main thread, they are handled by the receiver's left callbacks, at once
+    // when the receiver is the sender
+    bool SendToWorker(const uint16_t id, const CChannel::MsgType type, std::string_view data);
+    bool MulticastToWorkers(const std::vector<uint16_t>& ids, const CChannel::MsgType type, std::string_view data);
+    // Every other worker, the sender handles its own part directly
+    bool MulticastToWorkers(const CChannel::MsgType type, std::string_view data);
+    // Connection gauge published to the dispatcher on the main thread
+    void IncConnection() { m_active_conns.fetch_add(1, std::memory_order_relaxed); }
+    void DecConnection() { m_active_conns.fetch_sub(1, std::memory_order_relaxed); }
+    int64_t ActiveConnections() const { return m_active_conns.load(std::memory_order_relaxed); }
+    // Http connections closed by one of their deadlines, by what they were waiting for
+    void IncHttpTimeout(const HttpDeadline d) { m_http_timeouts[(size_t)d].fetch_add(1, std::memory_order_relaxed); }
+    uint64_t HttpTimeouts(const HttpDeadline d) const { return m_http_timeouts[(size_t)d].load(std::memory_order_relaxed); }
+    void IncH2Violation(const H2Violation v) { m_h2_violations[(size_t)v].fetch_add(1, std::memory_order_relaxed); }
+    uint64_t H2Violations(const H2Violation v) const { return m_h2_violations[(size_t)v].load(std::memory_order_relaxed); }
+    // Bytes grpc message compression kept off the wire
+    void AddGrpcSaved(const uint64_t n) { m_grpc_saved.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t GrpcSaved() const { return m_grpc_saved.load(std::memory_order_relaxed); }
+    // Cpu time consumed by the worker thread, readable from any thread
+    uint64_t CpuTimeUs() const;
 
     static void WaitForAllWorkers(const int32_t total);
+    static int32_t RunningWorkers() { return m_running_threads.load(); }
+
+    // Close idle connections, GOAWAY http2 sessions and websockets, then exit once every connection
+    // is gone or the timeout is reached
+    void Drain(const uint32_t timeout);
+    bool IsDraining() const { return m_draining; }
 
 protected:
     virtual bool Init();
     virtual void Destroy() { }
+    // stop accepting
+    virtual void OnDrain() { }
+    // last chance to flush queues before the loop exits
+    virtual void OnDrained() { }
     void OnLeftEvent(
         std::function<void(std::string_view)> textcb,
         std::function<void(std::string_view)> jsoncb,
@@ -37,25 +71,56 @@ protected:
         std::function<void(std::string_view)> binarycb);
 
 private:
-    static void readOnLeft(bufferevent* bev, void* ctx);
-    static void readOnRight(bufferevent* bev, void* ctx);
+    static void readOnLeft(CWorker* w);
+    static void readOnRight(CWorker* w);
+    static void readOnBroadcast(CWorker* w);
+    static void readOnMailbox(CWorker* w, const uint16_t from, const uint8_t type, std::string_view data);
     static void initOk();
+    // hit rate and footprint of the object pools of the calling thread
+    static void logPools();
+    void bindThread();
+    void unbindThread();
+    void drainTick();
 
     static std::mutex m_mutex;
     static std::condition_variable m_cond;
     static int32_t m_init_threads;
+    static std::atomic<int32_t> m_running_threads;
 
     // L(Woker)<=========>R(Main)
     CChannel m_main_and_work_chan;
+    // Main=========>All Workers
+    std::shared_ptr<CBroadcastLog::Reader> m_broadcast_reader;
+    // Worker<=========>Worker
+    std::shared_ptr<CMailbox> m_mailbox;
+    std::atomic<int64_t> m_active_conns = { 0 };
+    std::atomic<uint64_t> m_http_timeouts[(size_t)HttpDeadline::COUNT] = {};
+    std::atomic<uint64_t> m_h2_violations[(size_t)H2Violation::COUNT] = {};
+    std::atomic<uint64_t> m_grpc_saved = { 0 };
+    bool m_draining = { false };
+    int64_t m_drain_deadline = { 0 };
+#if defined(LINUX_PLATFORMOS)
+    mutable std::mutex m_cpu_mutex;
+    clockid_t m_cpu_clock = { -1 };
+    uint64_t m_cpu_used = { 0 };
+#endif
 
     DISABLE_CLASS_COPYABLE(CWorker);
 };
 
 class CWorkerMgr : public CObject, public CTLSingleton<CWorkerMgr> {
+public:
+    enum class DispatchPolicy : std::uint8_t {
+        RoundRobin = 0,
+        LeastConn = 1,
+        PowerOfTwo = 2,
+        ConsistentHash = 3,
+    };
+
 public:
     friend class CTLSingleton<CWorkerMgr>;
     CWorkerMgr() = default;
-    ~CWorkerMgr() = default;
+    ~CWorkerMgr();
     bool Register(
         std::function<CWorker*()> createcb,
         std::function<void(std::string_view)> textcb,
@@ -64,16 +129,43 @@ public:
 
     CWorker* Create(const uint64_t total);
     bool SendMsgToAllWorkers(const CChannel::MsgType type, std::string_view data);
-    bool SendMsgToOneWorker(const CChannel::MsgType type, std::string_view data);
+    // Queued and published as one batch at the end of the loop iteration. Broadcasts keep their order, and one sent
+    // or posted before a message to one worker reaches that worker first, the order against messages the worker
+    // gets afterwards is not kept
+    bool PostMsgToAllWorkers(const CChannel::MsgType type, std::string_view data);
+    // key is only used by the consistent hash policy, e.g. a peer ip or uid hash
+    bool SendMsgToOneWorker(const CChannel::MsgType type, std::string_view data, std::optional<uint64_t> key = std::nullopt);
+    // Hands an accepted connection to one worker and counts it there at once, so a burst of accepts is spread
+    // before the workers got to any of them. The worker takes it back on close or when it cannot serve it.
+    bool DispatchConnection(const CChannel::MsgType type, std::string_view data, std::optional<uint64_t> key = std::nullopt);
+    void SetDispatchPolicy(const std::string& name);
+    DispatchPolicy GetDispatchPolicy() const { return m_policy; }
+    // cpu usage of every worker since the previous call
+    void LogStats();
+
+private:
+    size_t selectWorker(std::optional<uint64_t> key);
+    bool sendTo(const size_t idx, const CChannel::MsgType type, std::string_view data);
+    void buildHashRing();
+    void flushPosted();
 
 private:
     using WT = std::vector<std::unique_ptr<CWorker>>;
+    static const uint32_t HASH_RING_VNODES = 160;
     WT m_mgr;
+    DispatchPolicy m_policy = { DispatchPolicy::RoundRobin };
+    std::vector<std::pair<uint64_t, uint16_t>> m_hash_ring;
+    CBroadcastLog m_broadcast;
+    std::shared_ptr<CMailbox> m_mailbox;
+    CBroadcastLog::Messages m_posted;
+    CEvent* m_post_ev = { nullptr };
     std::function<CWorker*()> m_create_func = { nullptr };
     std::function<void(std::string_view)> m_textcb = { nullptr };
     std::function<void(std::string_view)> m_jsoncb = { nullptr };
     std::function<void(std::string_view)> m_binarycb = { nullptr };
     uint16_t m_round_index = { 0 };
+    std::vector<uint64_t> m_last_cpu_us;
+    uint64_t m_last_stats_ms = { 0 };
 
     DISABLE_CLASS_COPYABLE(CWorkerMgr);
 };
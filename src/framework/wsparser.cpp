@@ -294,6 +294,24 @@ int CWSParser::Process(const char* data, const unsigned int dlen)
     return size;
 }
 
+unsigned long long CWSParser::FrameSize(const char* data, const unsigned int dlen)
+{
+    CheckCondition(sizeof(WSFrame) <= dlen, 0);
+    const WSFrame* fr = (const WSFrame*)data;
+    const unsigned int mask = getmask(fr->mask_payloadlen) ? sizeof(unsigned int) : 0;
+    unsigned long long payload_len = get_payload_len(fr->mask_payloadlen);
+    if (payload_len == 126) {
+        CheckCondition(sizeof(WSFrame) + sizeof(WSFrame16NoMask) <= dlen, 0);
+        payload_len = CUtils::Ntoh16(((const WSFrame16NoMask*)fr->data)->payload_len);
+        return sizeof(WSFrame) + sizeof(WSFrame16NoMask) + mask + payload_len;
+    } else if (payload_len == 127) {
+        CheckCondition(sizeof(WSFrame) + sizeof(WSFrame64NoMask) <= dlen, 0);
+        payload_len = ntoh64(((const WSFrame64NoMask*)fr->data)->payload_len);
+        return sizeof(WSFrame) + sizeof(WSFrame64NoMask) + mask + payload_len;
+    }
+    return sizeof(WSFrame) + mask + payload_len;
+}
+
 std::optional<std::vector<std::string_view>> CWSParser::Frame(const char* data, const unsigned long long dlen, const unsigned char opcode, const unsigned int mask_key)
 {
     if (m_status != WS_CONNECTED)
@@ -52,11 +52,17 @@ public:
         WS_OPCODE_PING = 0x9,
         WS_OPCODE_PONG = 0xA,
     };
+    // close status codes
+    static const uint16_t WS_CLOSE_GOING_AWAY = 1001;
+    // fixed header, 64 bits extended length and masking key
+    static const uint32_t WS_MAX_HEADER_SIZE = sizeof(WSFrame) + sizeof(WSFrame64Mask);
 
 public:
     CWSParser();
     ~CWSParser();
     int Process(const char* data, const unsigned int dlen);
+    // Size of the frame starting at data header included, 0 while its header is incomplete
+    static unsigned long long FrameSize(const char* data, const unsigned int dlen);
     constexpr char* Rcvbuf() { return m_rcv_buffer; }
     std::optional<std::vector<std::string_view>> Frame(const char* data, const unsigned long long dlen, const unsigned char opcode, const unsigned int mask_key);
     constexpr bool IsFin() { return m_is_fin; }
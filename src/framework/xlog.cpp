@@ -59,6 +59,12 @@ bool XLOG::LogInit()
     return true;
 }
 
+void XLOG::Flush()
+{
+    if (logger)
+        logger->flush();
+}
+
 bool XLOG::Reload()
 {
     logger->set_level(static_cast<spdlog::level::level_enum>(logStrToLogLevel(MYARGS.LogLevel.value_or("INFO"))));
@@ -24,6 +24,7 @@ public:
 
     static bool LogInit();
     static bool Reload();
+    static void Flush();
     static std::shared_ptr<spdlog::logger> logger;
 };
 NAMESPACE_FRAMEWORK_END
\ No newline at end of file
@@ -41,6 +41,7 @@ class CApp {
 public:
     class AppWorker final : public CWorker {
         std::map<std::string, CommandSyncFunc> m_command_sync_cbs;
+        std::vector<CTCPServer*> m_tcp_server;
 
     public:
         void CallByCommand(const std::string cmd, const nlohmann::json& j)
@@ -77,9 +78,11 @@ public:
             CheckCondition(LoadLuaFiles(), false);
 
             OnLeftEvent(
-                [](std::string_view data) {
+                [this](std::string_view data) {
                     if (data == "stop") {
                         CContex::MAIN_CONTEX->Exit(0);
+                    } else if (data == "drain") {
+                        this->Drain(MYARGS.DrainTimeout.value_or(DRAIN_TIMEOUT) * 1000);
                     }
                 },
                 [this](std::string_view data) {
@@ -91,9 +94,13 @@ public:
                             auto fd = j["fd"].get<int32_t>();
                             auto server = j["server"].get<uintptr_t>();
                             if (schema == "http" || schema == "https") {
-                                ((CHTTPServer*)server)->OnConnected(host, fd);
-                            } else if (schema == "tcp") {
-                                // CApp::TcpRegister("", nullptr);
+                                ((CHTTPServer*)server)->OnConnected(host, fd, true);
+                            } else {
+                                // counted by the dispatcher but not served
+                                DecConnection();
+                                if (schema == "tcp") {
+                                    // CApp::TcpRegister("", nullptr);
+                                }
                             }
                         } else if (j["cmd"].is_string() && j["cmd"].get_ref<const std::string&>() == "reload") {
                             if (j.contains("ssl") && j["ssl"].is_array()) {
@@ -123,6 +130,36 @@ public:
                                 MYARGS.TokenExpire = j["tokenexpire"].get<uint32_t>();
                             if (j.contains("httptimeout") && j["httptimeout"].is_number_unsigned())
                                 MYARGS.HttpTimeout = j["httptimeout"].get<uint32_t>();
+                            if (j.contains("maxbodysize") && j["maxbodysize"].is_number_unsigned())
+                                MYARGS.MaxBodySize = j["maxbodysize"].get<uint64_t>();
+                            if (j.contains("headertimeout") && j["headertimeout"].is_number_unsigned())
+                                MYARGS.HeaderTimeout = j["headertimeout"].get<uint32_t>();
+                            if (j.contains("bodytimeout") && j["bodytimeout"].is_number_unsigned())
+                                MYARGS.BodyTimeout = j["bodytimeout"].get<uint32_t>();
+                            if (j.contains("keepalivetimeout") && j["keepalivetimeout"].is_number_unsigned())
+                                MYARGS.KeepAliveTimeout = j["keepalivetimeout"].get<uint32_t>();
+                            if (j.contains("handlertimeout") && j["handlertimeout"].is_number_unsigned())
+                                MYARGS.HandlerTimeout = j["handlertimeout"].get<uint32_t>();
+                            if (j.contains("writetimeout") && j["writetimeout"].is_number_unsigned())
+                                MYARGS.WriteTimeout = j["writetimeout"].get<uint32_t>();
+                            if (j.contains("h2streamwindow") && j["h2streamwindow"].is_number_unsigned())
+                                MYARGS.H2StreamWindow = j["h2streamwindow"].get<uint32_t>();
+                            if (j.contains("h2connwindow") && j["h2connwindow"].is_number_unsigned())
+                                MYARGS.H2ConnWindow = j["h2connwindow"].get<uint32_t>();
+                            if (j.contains("h2maxwindow") && j["h2maxwindow"].is_number_unsigned())
+                                MYARGS.H2MaxWindow = j["h2maxwindow"].get<uint32_t>();
+                            if (j.contains("h2maxstreams") && j["h2maxstreams"].is_number_unsigned())
+                                MYARGS.H2MaxStreams = j["h2maxstreams"].get<uint32_t>();
+                            if (j.contains("h2maxheaderlist") && j["h2maxheaderlist"].is_number_unsigned())
+                                MYARGS.H2MaxHeaderList = j["h2maxheaderlist"].get<uint32_t>();
+                            if (j.contains("h2maxframesize") && j["h2maxframesize"].is_number_unsigned())
+                                MYARGS.H2MaxFrameSize = j["h2maxframesize"].get<uint32_t>();
+                            if (j.contains("h2maxresets") && j["h2maxresets"].is_number_unsigned())
+                                MYARGS.H2MaxResets = j["h2maxresets"].get<uint32_t>();
+                            if (j.contains("grpccompressmin") && j["grpccompressmin"].is_number_unsigned())
+                                MYARGS.GrpcCompressMin = j["grpccompressmin"].get<uint32_t>();
+                            if (j.contains("grpcmaxratio") && j["grpcmaxratio"].is_number_unsigned())
+                                MYARGS.GrpcMaxRatio = j["grpcmaxratio"].get<uint32_t>();
                             if (j.contains("redisttl") && j["redisttl"].is_number_unsigned())
                                 MYARGS.RedisTTL = j["redisttl"].get<uint64_t>();
                             if (j.contains("http2able") && j["http2able"].is_boolean())
@@ -154,9 +191,50 @@ public:
                 SPDLOG_ERROR("CTX:{} CClickHouseMgr::Init fail", MYARGS.CTXID);
                 return false;
             }
+            if (MYARGS.ReusePort.value_or(false) && !Listen()) {
+                SPDLOG_ERROR("CTX:{} Listen fail", MYARGS.CTXID);
+                return false;
+            }
 
             return true;
         }
+
+        // SO_REUSEPORT mode, accept on the worker's own contex
+        bool Listen()
+        {
+            for (auto& v : MYARGS.Workers.back().Host) {
+                std::string schema, host, port, path;
+                std::tie(schema, host, port, path) = CConnection::SplitUri(v);
+                if (schema != "http" && schema != "https")
+                    continue;
+                m_tcp_server.push_back(CNEW CHTTPServer());
+                CHTTPServer* ref = (CHTTPServer*)m_tcp_server.back();
+                CApp::WebRegister(ref);
+                CheckCondition(ref->ListenAndServe(v, [ref, v](const int32_t fd) { ref->OnConnected(v, fd); }), false);
+            }
+            return true;
+        }
+
+        virtual void Destroy() final
+        {
+            for (auto v : m_tcp_server) {
+                CDEL(v);
+            }
+            m_tcp_server.clear();
+        }
+
+        // the servers stay alive, accepted connections still report to them
+        virtual void OnDrain() final
+        {
+            for (auto v : m_tcp_server) {
+                v->Shutdown();
+            }
+        }
+
+        virtual void OnDrained() final
+        {
+            CClickHouseMgr::Instance().Consume();
+        }
     };
 
     class AppService final : public CService {
@@ -172,31 +250,39 @@ public:
                 },
                 nullptr,
                 [](std::string_view data) {
-                    CWorkerMgr::Instance().SendMsgToAllWorkers(CChannel::MsgType::Json, data);
+                    CWorkerMgr::Instance().PostMsgToAllWorkers(CChannel::MsgType::Json, data);
                 },
                 nullptr);
 
             CheckCondition(CMongo::Instance().Init(MYARGS.MongoUrl.value()), false);
 
-            for (auto& v : MYARGS.Workers.back().Host) {
-                std::string schema, host, port, path;
-                std::tie(schema, host, port, path) = CConnection::SplitUri(v);
-                m_tcp_server.push_back(CNEW CHTTPServer());
-                CHTTPServer* ref = (CHTTPServer*)m_tcp_server.back();
-                ref->ListenAndServe(v, [schema, ref, v](const int32_t fd) {
-                    nlohmann::json j;
-                    j["cmd"] = "newconn";
-                    j["schema"] = schema;
-                    j["host"] = v;
-                    j["fd"] = fd;
-                    j["server"] = (uintptr_t)ref;
-                    CWorkerMgr::Instance().SendMsgToOneWorker(CChannel::MsgType::Json, j.dump());
-                });
-
-                if (schema == "http" || schema == "https") {
-                    CApp::WebRegister(ref);
-                } else if (schema == "tcp") {
-                    // CApp::TcpRegister(v, ref);
+            // in reuseport mode the workers listen and accept by themselves
+            if (!MYARGS.ReusePort.value_or(false)) {
+                for (auto& v : MYARGS.Workers.back().Host) {
+                    std::string schema, host, port, path;
+                    std::tie(schema, host, port, path) = CConnection::SplitUri(v);
+                    m_tcp_server.push_back(CNEW CHTTPServer());
+                    CHTTPServer* ref = (CHTTPServer*)m_tcp_server.back();
+                    ref->ListenAndServe(v, [schema, ref, v](const int32_t fd) {
+                        nlohmann::json j;
+                        j["cmd"] = "newconn";
+                        j["schema"] = schema;
+                        j["host"] = v;
+                        j["fd"] = fd;
+                        j["server"] = (uintptr_t)ref;
+                        std::optional<uint64_t> key;
+                        if (CWorkerMgr::Instance().GetDispatchPolicy() == CWorkerMgr::DispatchPolicy::ConsistentHash) {
+                            if (auto ip = CConnection::PeerIpByFd(fd); ip)
+                                key = CUtils::Hash64(ip.value());
+                        }
+                        CWorkerMgr::Instance().DispatchConnection(CChannel::MsgType::Json, j.dump(), key);
+                    });
+
+                    if (schema == "http" || schema == "https") {
+                        CApp::WebRegister(ref);
+                    } else if (schema == "tcp") {
+                        // CApp::TcpRegister(v, ref);
+                    }
                 }
             }
 #ifdef PLATFORMOS
@@ -207,6 +293,13 @@ public:
         virtual void Start() final
         {
         }
+        virtual void Drain() final
+        {
+            for (auto v : m_tcp_server) {
+                v->Shutdown();
+            }
+            CService::Drain();
+        }
     };
 
     static bool Start(int argc, char** argv)
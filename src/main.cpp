@@ -95,13 +95,13 @@ void CApp::WebRegister(CHTTPServer* srv)
                     req->Conn()->GetConnection()->GetPeerIp());
                 return std::nullopt;
             }
-            auto auth = req->GetHeaderByKey("authorization");
+            auto auth = req->GetHeaderByKey(ghttp::HEADER_AUTHORIZATION);
             if (auth.empty())
                 return std::optional<std::pair<ghttp::HttpStatusCode, std::string>>({ ghttp::HttpStatusCode::UNAUTHORIZED, "" });
             try {
                 auto res = CStringTool::Split(auth, " ");
                 if (2 == res.size()) {
-                    const auto decoded = jwt::decode<jwt::traits::nlohmann_json>(res[1].data());
+                    const auto decoded = jwt::decode<jwt::traits::nlohmann_json>(std::string(res[1]));
                     auto verifier = jwt::verify<jwt::traits::nlohmann_json>()
                                         .allow_algorithm(jwt::algorithm::hs256 { MYARGS.ApiKey.value_or("") });
                     verifier.verify(decoded);
@@ -256,10 +256,12 @@ void CApp::WebRegister(CHTTPServer* srv)
             }
 
             // CRedisMgr::Instance().Handle(0)->del(std::to_string(req->GetUid().value()));
+            // this worker's copy goes at once, a read right after the write does not see the old value
+            CLocalStorage<int64_t>::Instance().Remove("user", req->GetUid().value());
             nlohmann::json j;
             j["cmd"] = "UpdateUser";
             j["uid"] = req->GetUid().value();
-            CWorker::LOCAL_WORKER->SendMsgToMain(CChannel::MsgType::Json, j.dump());
+            CWorker::LOCAL_WORKER->MulticastToWorkers(CChannel::MsgType::Json, j.dump());
             nlohmann::json js;
             return rsp->Response({ ghttp::HttpStatusCode::OK, js.dump() });
         });
@@ -433,7 +435,9 @@ void CApp::WebRegister(CHTTPServer* srv)
 
             nlohmann::json js;
             return rsp->Response({ ghttp::HttpStatusCode::OK, js.dump() });
-        });
+        },
+        // batches of events are larger than a usual api body
+        nullptr, 1024 * 1024);
     srv->Register(
         "/game/v1/statistic",
         ghttp::HttpMethod::POST,
@@ -468,7 +472,7 @@ void CApp::WebRegister(CHTTPServer* srv)
         "/game/debug/rpc",
         ghttp::HttpMethod::POST,
         [](ghttp::CRequest* req, ghttp::CResponse* rsp) {
-            auto auth = req->GetHeaderByKey("authorization");
+            std::string auth(req->GetHeaderByKey(ghttp::HEADER_AUTHORIZATION));
             ghttp::CResponse* r = rsp->Clone();
             CHTTPClient::Emit(MYARGS.ConfMap["test_rpcurl"],
                 [r](ghttp::CResponse* response) {
@@ -516,6 +520,9 @@ void CApp::WebRegister(CHTTPServer* srv)
             return rsp->Response({ ghttp::HttpStatusCode::OK, res });
         });
 
+    // unknown apis are answered without a lookup in the web root
+    srv->ServeNotFound("/game/*");
+
     srv->Register(
         "/game/debug/echo",
         ghttp::HttpMethod::GETPOST,
@@ -540,7 +547,7 @@ void CApp::WebRegister(CHTTPServer* srv)
         "/game/debug/grpc",
         ghttp::HttpMethod::POST,
         [](ghttp::CRequest* req, ghttp::CResponse* rsp) {
-            auto auth = req->GetHeaderByKey("authorization");
+            std::string auth(req->GetHeaderByKey(ghttp::HEADER_AUTHORIZATION));
             ghttp::CResponse* r = rsp->Clone();
             helloworld::HelloRequest hello;
             hello.set_name("Submits GOAWAY frame with the last stream ID last_stream_id and the error code error_code.\
@@ -0,0 +1,127 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/channel.hpp"
+#include "framework/contex.hpp"
+#include "framework/ringbuffer.hpp"
+
+USE_NAMESPACE_FRAMEWORK
+
+TEST_CASE("4: Channel passes large messages in order", "[multi-file:4]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    CChannel chan;
+    REQUIRE(chan.Create());
+    REQUIRE(chan.CreateL(*CContex::MAIN_CONTEX, []() {}));
+    REQUIRE(chan.CreateR(*CContex::MAIN_CONTEX, []() {}));
+
+    std::vector<std::string> sent;
+    for (size_t size : { 0, 10, 16 * 1024, 16 * 1024 + 1, 64 * 1024, 1024 * 1024 + 7, 3 }) {
+        sent.push_back(std::string(size, 'a' + sent.size()));
+    }
+    for (size_t i = 0; i < sent.size(); ++i) {
+        if (i % 2)
+            REQUIRE(chan.WriteR(CChannel::MsgType::Binary, std::string(sent[i])));
+        else
+            REQUIRE(chan.WriteR(CChannel::MsgType::Binary, std::string_view(sent[i])));
+    }
+    REQUIRE_FALSE(chan.WriteR(CChannel::MsgType::Binary, std::string(CChannel::CHANNEL_MAX_MESSAGE_LENGTH, 'x')));
+
+    auto res = chan.ReadL();
+    REQUIRE(res.Corrupted() == 0);
+    REQUIRE(res.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); ++i) {
+        auto& [type, data] = res[i];
+        REQUIRE(type.value() == CChannel::MsgType::Binary);
+        REQUIRE(data.value() == sent[i]);
+    }
+    REQUIRE(chan.ReadL().empty());
+
+    // a newer batch destroyed first does not hand back the records the older one still points into
+    REQUIRE(chan.WriteR(CChannel::MsgType::Binary, std::string_view(sent[1])));
+    REQUIRE(chan.ReadL().size() == 1);
+    for (size_t i = 0; i < 128; ++i) {
+        REQUIRE(chan.WriteR(CChannel::MsgType::Binary, std::string(8 * 1024, 'z')));
+    }
+    for (size_t i = 0; i < sent.size(); ++i) {
+        REQUIRE(std::get<1>(res[i]).value() == sent[i]);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+TEST_CASE("27: Ring fills, wraps around and passes records between two threads", "[multi-file:27]")
+{
+    CRingBuffer ring;
+    REQUIRE_FALSE(ring.Create(100));
+    REQUIRE(ring.Create(256));
+    bool wakeup = false;
+    auto read = [&ring]() {
+        std::vector<std::string> got;
+        ring.Release(ring.Peek([&got](const uint8_t type, std::string_view v) { got.emplace_back(v); }));
+        return got;
+    };
+
+    // 5 bytes of header and 27 of data fill 32, eight of them the whole ring
+    for (int32_t i = 0; i < 8; ++i) {
+        REQUIRE(ring.Push(1, std::string(27, 'a' + i), wakeup));
+        // only the first record after the consumer caught up rings the doorbell
+        REQUIRE(wakeup == (0 == i));
+    }
+    REQUIRE_FALSE(ring.Push(1, "x", wakeup));
+    REQUIRE_FALSE(ring.Push(1, std::string(ring.Capacity(), 'x'), wakeup));
+    auto got = read();
+    REQUIRE(got.size() == 8);
+    REQUIRE(got[7] == std::string(27, 'h'));
+    REQUIRE(read().empty());
+
+    // the third record does not fit before the end, it starts over at the front once there is room
+    REQUIRE(ring.Push(2, std::string(100, '1'), wakeup));
+    REQUIRE(wakeup);
+    REQUIRE(ring.Push(2, std::string(100, '2'), wakeup));
+    REQUIRE_FALSE(ring.Push(2, std::string(100, '3'), wakeup));
+    REQUIRE(read() == std::vector<std::string> { std::string(100, '1'), std::string(100, '2') });
+    REQUIRE(ring.Push(2, std::string(100, '3'), wakeup));
+    REQUIRE(ring.Push(2, std::string(100, '4'), wakeup));
+    // views stay valid until released
+    std::vector<std::string_view> views;
+    const auto pos = ring.Peek([&views](const uint8_t type, std::string_view v) { views.push_back(v); });
+    REQUIRE(views.size() == 2);
+    REQUIRE_FALSE(ring.Push(2, std::string(100, '5'), wakeup));
+    REQUIRE(views[0] == std::string(100, '3'));
+    REQUIRE(views[1] == std::string(100, '4'));
+    ring.Release(pos);
+    REQUIRE(read().empty());
+
+    // released out of order, the older peek still holds the ring
+    REQUIRE(ring.Push(3, std::string(100, '6'), wakeup));
+    const auto older = ring.Peek([](const uint8_t type, std::string_view v) {});
+    REQUIRE(ring.Push(3, std::string(100, '7'), wakeup));
+    const auto newer = ring.Peek([](const uint8_t type, std::string_view v) {});
+    ring.Release(newer);
+    REQUIRE_FALSE(ring.Push(3, std::string(100, '8'), wakeup));
+    ring.Release(older);
+    REQUIRE(ring.Push(3, std::string(100, '8'), wakeup));
+    REQUIRE(read() == std::vector<std::string> { std::string(100, '8') });
+
+    // producer and consumer on their own threads, every record arrives once and in order
+    CRingBuffer shared;
+    REQUIRE(shared.Create(4096));
+    const uint32_t total = 200000;
+    uint32_t received = 0, mismatched = 0;
+    std::thread consumer([&]() {
+        while (received < total) {
+            shared.Release(shared.Peek([&](const uint8_t type, std::string_view v) {
+                const auto expect = std::to_string(received) + std::string(received % 300, (char)type);
+                if (type != received % 7 || v != expect)
+                    ++mismatched;
+                ++received;
+            }));
+        }
+    });
+    for (uint32_t i = 0; i < total; ++i) {
+        const auto data = std::to_string(i) + std::string(i % 300, (char)(i % 7));
+        while (!shared.Push(i % 7, data, wakeup))
+            std::this_thread::yield();
+    }
+    consumer.join();
+    REQUIRE(received == total);
+    REQUIRE(mismatched == 0);
+}
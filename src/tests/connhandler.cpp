@@ -0,0 +1,126 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/connhandler.hpp"
+
+USE_NAMESPACE_FRAMEWORK
+
+static const size_t UPLOAD_SIZE = 1024 * 1024;
+static const size_t SEGMENT_SIZE = 1460;
+
+TEST_CASE("5: Connection handler consumes input chain by chain", "[multi-file:5]")
+{
+    auto input = evbuffer_new();
+    std::string sent;
+    for (size_t i = 0; i < 8; ++i) {
+        std::string seg(SEGMENT_SIZE, 'a' + i);
+        evbuffer_add(input, seg.data(), seg.size());
+        sent += seg;
+    }
+
+    // everything offered is consumed
+    std::string got;
+    auto all = [&got](std::string_view data) -> int32_t {
+        got.append(data);
+        return data.size();
+    };
+    REQUIRE(CConnectionHandler::Consume(input, all) == (int64_t)sent.size());
+    REQUIRE(got == sent);
+    REQUIRE(evbuffer_get_length(input) == 0);
+
+    // a partial read stops the loop and only the consumed bytes are drained
+    evbuffer_add(input, sent.data(), sent.size());
+    size_t calls = 0;
+    auto partial = [&calls](std::string_view data) -> int32_t {
+        ++calls;
+        return std::min<size_t>(data.size(), 10);
+    };
+    const int64_t consumed = CConnectionHandler::Consume(input, partial);
+    REQUIRE(consumed == 10);
+    REQUIRE(calls == 1);
+    REQUIRE(evbuffer_get_length(input) == sent.size() - consumed);
+    REQUIRE(CConnectionHandler::Consume(input, [](std::string_view) -> int32_t { return 0; }) == 0);
+    REQUIRE(CConnectionHandler::Consume(input, [](std::string_view) -> int32_t { return -1; }) == -1);
+    REQUIRE(evbuffer_get_length(input) == sent.size() - consumed);
+    evbuffer_free(input);
+}
+
+TEST_CASE("6: 256KB to 4MB uploads in 1460 byte segments", "[multi-file:6][!benchmark]")
+{
+    const std::string segment(SEGMENT_SIZE, 'x');
+    // feeds size bytes ending in a newline as they would arrive from the socket, read is called after every segment
+    auto upload = [&segment](const std::string& head, const size_t size, auto&& read) {
+        auto input = evbuffer_new();
+        evbuffer_add(input, head.data(), head.size());
+        size_t got = 0;
+        for (size_t sent = 0; sent < size; sent += SEGMENT_SIZE) {
+            const size_t len = std::min(SEGMENT_SIZE, size - sent);
+            evbuffer_add(input, segment.data(), sent + len < size ? len : len - 1);
+            if (sent + len == size)
+                evbuffer_add(input, "\n", 1);
+            got += read(input);
+        }
+        evbuffer_free(input);
+        return got;
+    };
+
+    // one message ended by a newline
+    auto line = [&](const size_t size, const bool whole) {
+        if (whole) {
+            // the read path before: the whole input is linearized on every read and a reader that keeps no state
+            // scans it again from the start, leaving the partial message in the input until it is complete
+            return upload("", size, [](evbuffer* input) -> size_t {
+                const size_t len = evbuffer_get_length(input);
+                auto data = (const char*)evbuffer_pullup(input, -1);
+                auto end = (const char*)memchr(data, '\n', len);
+                if (!end)
+                    return 0;
+                evbuffer_drain(input, end - data + 1);
+                return end - data + 1;
+            });
+        }
+        // the reader only scans the chains it has not seen
+        size_t got = 0;
+        CReadCBFunc cb = [&got](std::string_view data) -> int32_t {
+            auto end = data.find('\n');
+            got += std::string_view::npos == end ? data.size() : end + 1;
+            return data.size();
+        };
+        upload("", size, [&cb](evbuffer* input) -> size_t { return std::max<int64_t>(CConnectionHandler::Consume(input, cb), 0); });
+        return got;
+    };
+
+    // one message behind a 4 byte length: the websocket reader learns the size from the header and pulls the
+    // message up once it is all there
+    auto message = [&](const size_t size) {
+        const std::string head = { (char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size };
+        return upload(head, size, [](evbuffer* input) -> size_t {
+            auto data = (const uint8_t*)evbuffer_pullup(input, 4);
+            const size_t size = ((size_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+            if (evbuffer_get_length(input) < 4 + size)
+                return 0;
+            evbuffer_pullup(input, 4 + size);
+            evbuffer_drain(input, 4 + size);
+            return size;
+        });
+    };
+
+    for (const size_t size : { UPLOAD_SIZE / 4, UPLOAD_SIZE, UPLOAD_SIZE * 4 }) {
+        REQUIRE(line(size, true) == size);
+        REQUIRE(line(size, false) == size);
+        REQUIRE(message(size) == size);
+        const auto kb = std::to_string(size / 1024) + "KB";
+        BENCHMARK("pullup and scan the whole input again " + kb)
+        {
+            return line(size, true);
+        };
+        BENCHMARK("pullup the message once complete " + kb)
+        {
+            return message(size);
+        };
+        BENCHMARK("consume chain by chain " + kb)
+        {
+            return line(size, false);
+        };
+    }
+}
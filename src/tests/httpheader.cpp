@@ -0,0 +1,50 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/httpheader.hpp"
+
+USE_NAMESPACE_FRAMEWORK
+
+TEST_CASE("9: Header table parses piecewise and looks up case insensitively", "[multi-file:9]")
+{
+    ghttp::CHttpHeaders headers;
+    headers.AppendKey("Content-");
+    headers.AppendKey("Type");
+    headers.AppendValue("application/");
+    headers.AppendValue("json");
+    headers.AppendKey("Connection");
+    headers.AppendValue("keep-alive");
+    headers.AppendKey("x-empty");
+    headers.AppendValue("");
+    headers.AppendKey("Authorization");
+    headers.AppendValue("Bearer abc");
+
+    REQUIRE(4 == headers.Size());
+    REQUIRE(headers.Get(ghttp::HEADER_CONTENT_TYPE) == "application/json");
+    REQUIRE(headers.Get("CONTENT-TYPE") == "application/json");
+    REQUIRE(headers.Get(ghttp::HEADER_CONNECTION) == "keep-alive");
+    REQUIRE(headers.Get(ghttp::HEADER_AUTHORIZATION) == "Bearer abc");
+    REQUIRE(headers.Has("x-empty"));
+    REQUIRE(headers.Get("x-empty").empty());
+    REQUIRE_FALSE(headers.Has(ghttp::HEADER_UPGRADE));
+
+    headers.Set("Connection", "close");
+    REQUIRE(4 == headers.Size());
+    REQUIRE(headers.Get(ghttp::HEADER_CONNECTION) == "close");
+
+    // spills past the inline entries
+    for (uint32_t i = 0; i < HTTP_HEADER_INLINE * 2; ++i)
+        headers.Set("x-header-" + std::to_string(i), std::to_string(i));
+    REQUIRE(4 + HTTP_HEADER_INLINE * 2 == headers.Size());
+    REQUIRE(headers.Get("X-Header-31") == "31");
+    REQUIRE(headers.Get(ghttp::HEADER_CONTENT_TYPE) == "application/json");
+
+    std::vector<std::string_view> keys;
+    for (auto [k, v] : headers)
+        keys.push_back(k);
+    REQUIRE(keys.front() == "content-type");
+    REQUIRE(keys.back() == "x-header-31");
+
+    headers.Clear();
+    REQUIRE(headers.Empty());
+    REQUIRE_FALSE(headers.Has(ghttp::HEADER_CONTENT_TYPE));
+}
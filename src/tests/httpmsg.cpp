@@ -0,0 +1,67 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/contex.hpp"
+#include "framework/httpserver.hpp"
+
+#include "fmt/chrono.h"
+
+USE_NAMESPACE_FRAMEWORK
+
+TEST_CASE("8: Http/1.1 response head with cached fragments", "[multi-file:8][!benchmark]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    CConnection conn;
+    conn.SetBufferEvent(pair[0]);
+    CHTTPClient client;
+    client.Init(&conn, nullptr);
+    auto req = client.GetStream(-1).value()->GetRequest();
+    auto rsp = client.GetStream(-1).value()->GetResponse();
+    req->SetMajor(1);
+    req->SetMinor(1);
+    rsp->AddHeader("x-request-id", "1234567890");
+    // a bufferevent pair freezes the start of its output, the test reads it in place of the peer
+    auto output = bufferevent_get_output(pair[0]);
+    evbuffer_unfreeze(output, 1);
+    const std::string body = R"({"code":0,"msg":"ok","data":{"uid":10001,"token":"0123456789abcdef"}})";
+
+    REQUIRE(rsp->Response({ ghttp::HttpStatusCode::OK, body }));
+    std::string sent(evbuffer_get_length(output), '\0');
+    evbuffer_remove(output, sent.data(), sent.size());
+    REQUIRE(sent.find("HTTP/1.1 200 OK\r\n") == 0);
+    REQUIRE(sent.find(fmt::format("date: {}\r\n", ghttp::GetHttpDate())) != std::string::npos);
+    REQUIRE(sent.find(fmt::format("content-length: {}\r\n\r\n{}", body.size(), body)) != std::string::npos);
+
+    BENCHMARK("Response with cached fragments")
+    {
+        rsp->Response({ ghttp::HttpStatusCode::OK, body });
+        return evbuffer_drain(output, evbuffer_get_length(output));
+    };
+
+    // head built the way Response did before the fragments were cached
+    BENCHMARK("Response formatting every line")
+    {
+        std::string httprsp = fmt::format("HTTP/1.1 {} {}\r\n", (int32_t)ghttp::HttpStatusCode::OK, ghttp::HttpReason(ghttp::HttpStatusCode::OK).value_or(""));
+        httprsp += fmt::format("{}: {}\r\n", "x-request-id", "1234567890");
+        struct tm t;
+        const time_t now = time(nullptr);
+        gmtime_r(&now, &t);
+        httprsp += fmt::format("date: {}\r\n", fmt::format("{:%a, %d %b %Y %H:%M:%S GMT}", t));
+        httprsp += fmt::format("server: {}\r\n", fmt::format("PICO-v{}.{}", MAJOR, MINOR));
+        httprsp += fmt::format("connection: {}\r\n", req->GetConnectionHeader());
+        httprsp += fmt::format("content-type: {}\r\n", "application/json; charset=utf-8");
+        httprsp += fmt::format("content-length: {}\r\n", body.size());
+        httprsp += fmt::format("\r\n");
+        httprsp.append(body);
+        rsp->SetBody(body);
+        conn.SendCmd(httprsp.data(), httprsp.size());
+        return evbuffer_drain(output, evbuffer_get_length(output));
+    };
+
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/httpmsg.hpp"
+#include "framework/httprouter.hpp"
+
+#include "fmt/core.h"
+
+USE_NAMESPACE_FRAMEWORK
+
+TEST_CASE("10: Router matches static, parameter and wildcard routes", "[multi-file:10]")
+{
+    const uint32_t GET = (uint32_t)ghttp::HttpMethod::GET;
+    const uint32_t POST = (uint32_t)ghttp::HttpMethod::POST;
+    ghttp::CHttpRouter<int32_t> router;
+    REQUIRE(router.Add("/game/v1/login", POST, 1));
+    REQUIRE(router.Add("/game/v1/logevent", POST, 2));
+    REQUIRE(router.Add("/game/v1/user/:uid", GET, 3));
+    REQUIRE(router.Add("/game/v1/user/:uid", POST, 4));
+    REQUIRE(router.Add("/game/v1/user/:uid/items/:item", GET, 5));
+    REQUIRE(router.Add("/game/v1/user/self", GET, 6));
+    REQUIRE(router.Add("/static/*file", GET, 7));
+    REQUIRE(router.Add("/game/*", GET | POST, 8));
+    // conflicting parameter name, method already taken, malformed patterns
+    REQUIRE_FALSE(router.Add("/game/v1/user/:id", GET, 0));
+    REQUIRE_FALSE(router.Add("/game/v1/login", POST, 0));
+    REQUIRE_FALSE(router.Add("game", GET, 0));
+    REQUIRE_FALSE(router.Add("/a/:/b", GET, 0));
+    REQUIRE(router.Size() == 8);
+
+    ghttp::CHttpParams params;
+    auto m = router.Find(POST, "/game/v1/login", params);
+    REQUIRE((m.value && *m.value == 1 && !m.badmethod));
+    m = router.Find(POST, "/game/v1/logevent", params);
+    REQUIRE((m.value && *m.value == 2));
+
+    const std::string path = "/game/v1/user/10001/items/sword";
+    m = router.Find(GET, path, params);
+    REQUIRE((m.value && *m.value == 5));
+    REQUIRE(params.size() == 2);
+    REQUIRE(params[0].name == "uid");
+    REQUIRE(path.substr(params[0].off, params[0].len) == "10001");
+    REQUIRE(params[1].name == "item");
+    REQUIRE(path.substr(params[1].off, params[1].len) == "sword");
+
+    m = router.Find(POST, "/game/v1/user/10001", params);
+    REQUIRE((m.value && *m.value == 4 && params.size() == 1));
+    // static segments win over parameters
+    m = router.Find(GET, "/game/v1/user/self", params);
+    REQUIRE((m.value && *m.value == 6 && params.empty()));
+    // a route without the method is reported as such
+    m = router.Find(GET, "/game/v1/login", params);
+    REQUIRE((m.value && *m.value == 1 && m.badmethod));
+
+    m = router.Find(GET, "/static/css/main.css", params);
+    REQUIRE((m.value && *m.value == 7 && params.size() == 1));
+    REQUIRE(params[0].name == "file");
+    REQUIRE(std::string_view("/static/css/main.css").substr(params[0].off, params[0].len) == "css/main.css");
+    // backtracking from a failed parameter branch into the wildcard
+    m = router.Find(GET, "/game/v1/user/10001/unknown", params);
+    REQUIRE((m.value && *m.value == 8 && params.size() == 1));
+    REQUIRE(std::string_view("/game/v1/user/10001/unknown").substr(params[0].off, params[0].len) == "v1/user/10001/unknown");
+    m = router.Find(GET, "/index.html", params);
+    REQUIRE(nullptr == m.value);
+
+    // the request strips its query and answers its parameters from its own path
+    ghttp::CRequest req(nullptr);
+    req.SetTarget("/game/v1/user/42?x=1&y=2");
+    REQUIRE(req.GetPath() == "/game/v1/user/42");
+    REQUIRE(req.GetQuery() == "x=1&y=2");
+    m = router.Find(GET, req.GetPath(), req.GetParams());
+    REQUIRE((m.value && *m.value == 3));
+    REQUIRE(req.GetParam("uid") == "42");
+    REQUIRE(req.GetParam("item").empty());
+}
+
+TEST_CASE("11: Router against exact match lookup with 500 routes", "[multi-file:11][!benchmark]")
+{
+    const uint32_t GET = (uint32_t)ghttp::HttpMethod::GET;
+    ghttp::CHttpRouter<int32_t> router;
+    std::unordered_map<std::string, int32_t> exact;
+    for (int32_t i = 0; i < 100; ++i) {
+        for (auto& [pattern, path] : std::vector<std::pair<std::string, std::string>> {
+                 { fmt::format("/game/v1/module{}/list", i), fmt::format("/game/v1/module{}/list", i) },
+                 { fmt::format("/game/v1/module{}/detail", i), fmt::format("/game/v1/module{}/detail", i) },
+                 { fmt::format("/game/v2/module{}/update", i), fmt::format("/game/v2/module{}/update", i) },
+                 { fmt::format("/game/v1/module{}/:uid", i), fmt::format("/game/v1/module{}/10001", i) },
+                 { fmt::format("/game/v1/module{}/:uid/items/:item", i), fmt::format("/game/v1/module{}/10001/items/sword", i) },
+             }) {
+            REQUIRE(router.Add(pattern, GET, i));
+            exact[path] = i;
+        }
+    }
+    REQUIRE(router.Size() == 500);
+
+    std::vector<std::string> paths;
+    for (int32_t i = 0; i < 100; i += 7) {
+        paths.push_back(fmt::format("/game/v1/module{}/list", i));
+        paths.push_back(fmt::format("/game/v2/module{}/update", i));
+        paths.push_back(fmt::format("/game/v1/module{}/10001/items/sword", i));
+    }
+    ghttp::CHttpParams params;
+    for (auto& v : paths) {
+        auto m = router.Find(GET, v, params);
+        REQUIRE((m.value && *m.value == exact[v]));
+    }
+
+    BENCHMARK("radix router")
+    {
+        int32_t sum = 0;
+        for (auto& v : paths) {
+            if (auto m = router.Find(GET, v, params); m.value)
+                sum += *m.value;
+        }
+        return sum;
+    };
+
+    // the lookup the server did before, which cannot capture parameters
+    BENCHMARK("unordered_map on the full path")
+    {
+        int32_t sum = 0;
+        for (auto& v : paths) {
+            if (auto it = exact.find(v); it != exact.end())
+                sum += it->second;
+        }
+        return sum;
+    };
+}
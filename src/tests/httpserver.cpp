@@ -0,0 +1,1281 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/contex.hpp"
+#include "framework/httpserver.hpp"
+#include "framework/protocol.hpp"
+#include "framework/chrono.hpp"
+#include "framework/encoder.hpp"
+#include "framework/worker.hpp"
+
+#include "fmt/core.h"
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+USE_NAMESPACE_FRAMEWORK
+
+// an accepted connection, an http2 session on it takes the server role
+class CPassiveConnection : public CConnection {
+public:
+    CPassiveConnection() { m_peer_port = 1; }
+};
+
+// an http2 client driven by hand, it grants window only when asked to
+struct CH2Peer {
+    nghttp2_session* session = { nullptr };
+    std::string out;
+    std::map<int32_t, std::string> bodies;
+    std::map<int32_t, std::string> status;
+    // response headers and trailers of each stream
+    std::map<int32_t, std::map<std::string, std::string>> fields;
+    // sent with every request
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::set<int32_t> closed;
+    size_t maxframe = { 0 };
+    size_t frames = { 0 };
+    std::optional<uint32_t> goaway;
+
+    CH2Peer()
+    {
+        nghttp2_session_callbacks* cbs;
+        nghttp2_session_callbacks_new(&cbs);
+        nghttp2_session_callbacks_set_send_callback(cbs, [](nghttp2_session*, const uint8_t* data, size_t len, int, void* arg) {
+            ((CH2Peer*)arg)->out.append((const char*)data, len);
+            return (ssize_t)len;
+        });
+        nghttp2_session_callbacks_set_on_data_chunk_recv_callback(cbs, [](nghttp2_session*, uint8_t, int32_t id, const uint8_t* data, size_t len, void* arg) {
+            ((CH2Peer*)arg)->bodies[id].append((const char*)data, len);
+            return 0;
+        });
+        nghttp2_session_callbacks_set_on_header_callback(cbs, [](nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, size_t namelen, const uint8_t* value, size_t valuelen, uint8_t, void* arg) {
+            auto self = (CH2Peer*)arg;
+            if (std::string_view((const char*)name, namelen) == ":status")
+                self->status[frame->hd.stream_id] = std::string((const char*)value, valuelen);
+            self->fields[frame->hd.stream_id][std::string((const char*)name, namelen)] = std::string((const char*)value, valuelen);
+            return 0;
+        });
+        nghttp2_session_callbacks_set_on_frame_recv_callback(cbs, [](nghttp2_session*, const nghttp2_frame* frame, void* arg) {
+            auto self = (CH2Peer*)arg;
+            if (frame->hd.type == NGHTTP2_DATA) {
+                self->maxframe = std::max(self->maxframe, frame->hd.length);
+                ++self->frames;
+            }
+            if (frame->hd.type == NGHTTP2_GOAWAY)
+                self->goaway = frame->goaway.error_code;
+            return 0;
+        });
+        nghttp2_session_callbacks_set_on_stream_close_callback(cbs, [](nghttp2_session*, int32_t id, uint32_t, void* arg) {
+            ((CH2Peer*)arg)->closed.insert(id);
+            return 0;
+        });
+        nghttp2_option* opt;
+        nghttp2_option_new(&opt);
+        nghttp2_option_set_no_auto_window_update(opt, 1);
+        nghttp2_session_client_new2(&session, cbs, this, opt);
+        nghttp2_option_del(opt);
+        nghttp2_session_callbacks_del(cbs);
+        nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, nullptr, 0);
+    }
+    ~CH2Peer() { nghttp2_session_del(session); }
+
+    // extra goes out as one more header, body as the body of a POST
+    int32_t Get(const std::string& path, const std::string& extra = "", const std::string* body = nullptr)
+    {
+        if (body) {
+            upload = *body;
+            uploadoff = 0;
+            uploadend = true;
+        }
+        return submit(path, extra, body);
+    }
+
+    // a POST whose body follows piecewise with Send
+    int32_t Open(const std::string& path)
+    {
+        upload.clear();
+        uploadoff = 0;
+        uploadend = false;
+        return submit(path, "", &upload);
+    }
+
+    void Send(const int32_t id, std::string_view data, const bool end)
+    {
+        upload.append(data);
+        uploadend = end;
+        nghttp2_session_resume_data(session, id);
+    }
+
+    // hands back the window of what the stream received so far
+    void Consume(const int32_t id)
+    {
+        const size_t n = bodies[id].size() - consumed[id];
+        consumed[id] = bodies[id].size();
+        nghttp2_submit_window_update(session, NGHTTP2_FLAG_NONE, id, n);
+        nghttp2_submit_window_update(session, NGHTTP2_FLAG_NONE, 0, n);
+    }
+
+private:
+    int32_t submit(const std::string& path, const std::string& extra, const std::string* body)
+    {
+        const std::string m = ":method", method = body ? "POST" : "GET", s = ":scheme", https = "https", a = ":authority", host = "localhost", p = ":path", x = "x-extra";
+        std::vector<nghttp2_nv> nva = {
+            { (uint8_t*)m.data(), (uint8_t*)method.data(), m.size(), method.size(), NGHTTP2_NV_FLAG_NONE },
+            { (uint8_t*)s.data(), (uint8_t*)https.data(), s.size(), https.size(), NGHTTP2_NV_FLAG_NONE },
+            { (uint8_t*)a.data(), (uint8_t*)host.data(), a.size(), host.size(), NGHTTP2_NV_FLAG_NONE },
+            { (uint8_t*)p.data(), (uint8_t*)path.data(), p.size(), path.size(), NGHTTP2_NV_FLAG_NONE },
+        };
+        if (!extra.empty())
+            nva.push_back({ (uint8_t*)x.data(), (uint8_t*)extra.data(), x.size(), extra.size(), NGHTTP2_NV_FLAG_NONE });
+        for (auto& [k, v] : headers)
+            nva.push_back({ (uint8_t*)k.data(), (uint8_t*)v.data(), k.size(), v.size(), NGHTTP2_NV_FLAG_NONE });
+        if (!body)
+            return nghttp2_submit_request(session, nullptr, nva.data(), nva.size(), nullptr, nullptr);
+        nghttp2_data_provider prd;
+        prd.source.ptr = this;
+        prd.read_callback = [](nghttp2_session*, int32_t, uint8_t* buf, size_t length, uint32_t* flags, nghttp2_data_source* source, void*) {
+            auto self = (CH2Peer*)source->ptr;
+            const size_t n = std::min(length, self->upload.size() - self->uploadoff);
+            memcpy(buf, self->upload.data() + self->uploadoff, n);
+            self->uploadoff += n;
+            if (self->uploadoff < self->upload.size())
+                return (ssize_t)n;
+            if (self->uploadend)
+                *flags |= NGHTTP2_DATA_FLAG_EOF;
+            else if (0 == n)
+                return (ssize_t)NGHTTP2_ERR_DEFERRED;
+            return (ssize_t)n;
+        };
+        return nghttp2_submit_request(session, nullptr, nva.data(), nva.size(), &prd, nullptr);
+    }
+
+private:
+    std::map<int32_t, size_t> consumed;
+    // body of the request being sent, one at a time
+    std::string upload;
+    size_t uploadoff = { 0 };
+    bool uploadend = { true };
+};
+
+TEST_CASE("12: Request bodies stream to their route within its limit", "[multi-file:12]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    // responses are moved to the peer as they are written
+    bufferevent_enable(pair[1], EV_READ);
+    auto peer = bufferevent_get_input(pair[1]);
+    auto received = [&peer]() {
+        std::string v(evbuffer_get_length(peer), '\0');
+        evbuffer_remove(peer, v.data(), v.size());
+        return v;
+    };
+    CConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    CHTTPServer srv;
+    std::string chunks;
+    bool pause = false;
+    srv.Register(
+        "/upload/:name",
+        ghttp::HttpMethod::POST,
+        [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+            return rsp->Response({ ghttp::HttpStatusCode::OK, std::to_string(chunks.size()) });
+        },
+        [&](ghttp::CRequest* req, std::string_view chunk) {
+            chunks.append(chunk);
+            if (pause)
+                req->Conn()->PauseBody();
+            return req->GetParam("name") != "refused";
+        },
+        16);
+    srv.Register("/small", ghttp::HttpMethod::POST, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, req->GetBody() });
+    });
+
+    auto client = std::make_unique<CHTTPClient>();
+    client->Init(&conn, &srv);
+    auto parse = [&client](std::string_view data) { return client->GetParser().ParseHttpMsg(client.get(), data); };
+
+    // chunks reach the callback instead of the request, the handler runs once the body is complete
+    std::string in = "POST /upload/a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(chunks == "hello world");
+    auto out = received();
+    REQUIRE(out.find("HTTP/1.1 200") == 0);
+    REQUIRE(out.substr(out.size() - 2) == "11");
+
+    // the callback falling behind stops the parser right behind its chunk
+    chunks.clear();
+    pause = true;
+    in = "POST /upload/a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n3\r\ndef\r\n0\r\n\r\n";
+    auto consumed = parse(in);
+    REQUIRE(client->BodyPaused());
+    REQUIRE(chunks == "abc");
+    REQUIRE(0 == parse(in.substr(consumed)));
+    pause = false;
+    client->ResumeBody();
+    REQUIRE(parse(in.substr(consumed)) == (int32_t)(in.size() - consumed));
+    REQUIRE(chunks == "abcdef");
+    REQUIRE(received().find("HTTP/1.1 200") == 0);
+
+    // bodies without a route limit fall back to the server default
+    in = "POST /small HTTP/1.1\r\nContent-Length: 4\r\n\r\nping";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    out = received();
+    REQUIRE(out.substr(out.size() - 4) == "ping");
+
+    // a declared length over the limit is answered before the body arrives and the rest is dropped
+    in = "POST /upload/a HTTP/1.1\r\nContent-Length: 17\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client->IsRefused());
+    out = received();
+    REQUIRE(out.find("HTTP/1.1 413") == 0);
+    REQUIRE(out.find("connection: close") != std::string::npos);
+    REQUIRE(parse("01234567890123456") == 17);
+
+    // a chunked body is refused once it grows over the limit
+    client = std::make_unique<CHTTPClient>();
+    client->Init(&conn, &srv);
+    chunks.clear();
+    in = "POST /upload/a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n10\r\n0123456789abcdef\r\n1\r\nx\r\n0\r\n\r\n";
+    REQUIRE(parse(in) > 0);
+    REQUIRE(chunks == "0123456789abcdef");
+    REQUIRE(received().find("HTTP/1.1 413") == 0);
+
+    // the callback refuses the request
+    client = std::make_unique<CHTTPClient>();
+    client->Init(&conn, &srv);
+    in = "POST /upload/refused HTTP/1.1\r\nContent-Length: 2\r\n\r\nno";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(received().find("HTTP/1.1 400") == 0);
+
+    // a method the routes of the path do not accept runs none of them
+    client = std::make_unique<CHTTPClient>();
+    client->Init(&conn, &srv);
+    chunks.clear();
+    in = "GET /small HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(received().find("HTTP/1.1 405") == 0);
+
+    client.reset();
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+
+    // the same over http2
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    peer = bufferevent_get_input(pair[1]);
+    CPassiveConnection h2conn;
+    h2conn.SetBufferEvent(pair[0]);
+    client = std::make_unique<CHTTPClient>();
+    client->Init(&h2conn, &srv);
+    REQUIRE(client->InitNghttp2SessionData());
+    CH2Peer h2peer;
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(h2peer.session));
+            if (!h2peer.out.empty()) {
+                std::string v;
+                v.swap(h2peer.out);
+                REQUIRE(client->GetParser().ParseHttpMsg(client.get(), v) == (int32_t)v.size());
+            }
+            auto got = received();
+            if (got.empty() && h2peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(h2peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+    auto id = h2peer.Get("/small");
+    pump();
+    REQUIRE(h2peer.status[id] == "405");
+    id = h2peer.Get("/upload/a");
+    pump();
+    REQUIRE(h2peer.status[id] == "405");
+    REQUIRE(chunks.empty());
+    const std::string body = "pong";
+    id = h2peer.Get("/small", "", &body);
+    pump();
+    REQUIRE(h2peer.status[id] == "200");
+    REQUIRE(h2peer.bodies[id] == "pong");
+
+    client.reset();
+    h2conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("13: Streamed responses are chunked and keep their pipeline order", "[multi-file:13]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peer = bufferevent_get_input(pair[1]);
+    auto received = [peer]() {
+        std::string v(evbuffer_get_length(peer), '\0');
+        evbuffer_remove(peer, v.data(), v.size());
+        return v;
+    };
+    CConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    CHTTPServer srv;
+    ghttp::CResponse* feed = nullptr;
+    int32_t rows = 0;
+    srv.Register("/feed", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        feed = rsp;
+        return rsp->Begin(ghttp::HttpStatusCode::OK);
+    });
+    srv.Register("/rows", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        // one row per drain of the output, as a large export would do
+        rsp->OnDrain([&rows](ghttp::CResponse* rsp) {
+            rsp->Write(fmt::format("row{}", rows));
+            if (++rows == 3)
+                rsp->End();
+        });
+        return rsp->Begin(ghttp::HttpStatusCode::OK);
+    });
+    srv.Register("/plain", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, "plain" });
+    });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    auto parse = [&client](std::string_view data) { return client.GetParser().ParseHttpMsg(&client, data); };
+
+    // the head goes out at once without a length, every write is a chunk
+    std::string in = "GET /feed HTTP/1.1\r\n\r\nGET /plain HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    auto out = received();
+    REQUIRE(out.find("HTTP/1.1 200") == 0);
+    REQUIRE(out.find("transfer-encoding: chunked\r\n\r\n") != std::string::npos);
+    REQUIRE(out.find("content-length") == std::string::npos);
+    REQUIRE(feed->Write("hello"));
+    REQUIRE(feed->Write(std::string(20, 'x')));
+    REQUIRE(received() == "5\r\nhello\r\n14\r\n" + std::string(20, 'x') + "\r\n");
+    // the pipelined response waits behind the stream
+    REQUIRE(feed->End());
+    REQUIRE_FALSE(feed->Write("late"));
+    out = received();
+    REQUIRE(out.find("0\r\n\r\nHTTP/1.1 200") == 0);
+    REQUIRE(out.substr(out.size() - 5) == "plain");
+
+    // a stream that starts behind an earlier response is buffered until its turn
+    ghttp::CResponse* waiting = nullptr;
+    srv.Register("/wait", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        waiting = rsp;
+        return true;
+    });
+    in = "GET /wait HTTP/1.1\r\n\r\nGET /feed HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE_FALSE(feed->Writable());
+    REQUIRE(feed->Write("early"));
+    REQUIRE(received().empty());
+    REQUIRE(waiting->Response({ ghttp::HttpStatusCode::OK, "first" }));
+    REQUIRE(feed->Writable());
+    out = received();
+    REQUIRE(out.find("first") < out.find("5\r\nearly\r\n"));
+    REQUIRE(feed->Write("later"));
+    REQUIRE(feed->End());
+    REQUIRE(received() == "5\r\nlater\r\n0\r\n\r\n");
+
+    // the drain callback produces the body while the output keeps draining
+    in = "GET /rows HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    for (int32_t i = 0; i < 5; ++i)
+        CHTTPClient::OnWrite(&client);
+    REQUIRE(rows == 3);
+    out = received();
+    REQUIRE(out.substr(out.find("\r\n\r\n") + 4) == "4\r\nrow0\r\n4\r\nrow1\r\n4\r\nrow2\r\n0\r\n\r\n");
+
+    // http/1.0 has no chunks, the body is sized at the end
+    in = "GET /feed HTTP/1.0\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(received().empty());
+    REQUIRE(feed->Write("one"));
+    REQUIRE(feed->Write("two"));
+    REQUIRE(feed->End());
+    out = received();
+    REQUIRE(out.find("content-length: 6\r\n") != std::string::npos);
+    REQUIRE(out.substr(out.size() - 6) == "onetwo");
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+
+    // and a drain callback producing it runs from the loop although nothing goes out before the end
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    peer = bufferevent_get_input(pair[1]);
+    CConnection conn10;
+    conn10.SetBufferEvent(pair[0]);
+    CHTTPClient client10;
+    client10.Init(&conn10, &srv);
+    bufferevent_setcb(pair[0], nullptr, [](bufferevent*, void* arg) { CHTTPClient::OnWrite((CHTTPClient*)arg); }, nullptr, &client10);
+    rows = 0;
+    in = "GET /rows HTTP/1.0\r\n\r\n";
+    REQUIRE(client10.GetParser().ParseHttpMsg(&client10, in) == (int32_t)in.size());
+    for (int32_t i = 0; i < 5 && rows < 3; ++i)
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+    REQUIRE(rows == 3);
+    std::string all(evbuffer_get_length(peer), '\0');
+    evbuffer_remove(peer, all.data(), all.size());
+    REQUIRE(all.find("content-length: 12\r\n") != std::string::npos);
+    REQUIRE(all.substr(all.size() - 12) == "row0row1row2");
+
+    conn10.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("14: Connection deadlines follow what the connection waits for", "[multi-file:14]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    CConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    CHTTPServer srv;
+    ghttp::CResponse* later = nullptr;
+    srv.Register("/later", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        later = rsp;
+        return true;
+    });
+    srv.Register("/now", ghttp::HttpMethod::POST, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, "" });
+    });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    auto parse = [&client](std::string_view data) { return client.GetParser().ParseHttpMsg(&client, data); };
+    // one coarse tick drives the deadlines of every connection of the worker
+    REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+    REQUIRE(CContex::MAIN_CONTEX->HasEvent(HTTP_DEADLINE_TIMER_ID));
+
+    std::string in = "POST /now HTTP/1.1\r\nContent-";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client.GetDeadline() == HttpDeadline::HEADER);
+    in = "Length: 4\r\n\r\nab";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client.GetDeadline() == HttpDeadline::BODY);
+    in = "cd";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+
+    // an async handler is bounded, the next request is not
+    in = "GET /later HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client.GetDeadline() == HttpDeadline::HANDLER);
+    REQUIRE(later->Response({ ghttp::HttpStatusCode::OK, "" }));
+    REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+
+    // a streamed response is not
+    in = "GET /later HTTP/1.1\r\n\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(later->Begin(ghttp::HttpStatusCode::OK));
+    REQUIRE_FALSE(client.GetDeadline());
+    REQUIRE(later->End());
+    REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+
+    // a silent header expires
+    in = "GET /later HTTP/1.1\r\n";
+    REQUIRE(parse(in) == (int32_t)in.size());
+    REQUIRE(client.GetDeadline() == HttpDeadline::HEADER);
+    CHTTPClient::UpdateDeadlines(CChrono::SteadyMs() + (HTTP_HEADER_TIMEOUT - 1) * 1000);
+    REQUIRE(client.GetDeadline() == HttpDeadline::HEADER);
+    CHTTPClient::UpdateDeadlines(CChrono::SteadyMs() + HTTP_HEADER_TIMEOUT * 1000 + HTTP_DEADLINE_TICK);
+    REQUIRE_FALSE(client.GetDeadline());
+    REQUIRE_FALSE(CContex::MAIN_CONTEX->HasEvent(HTTP_DEADLINE_TIMER_ID));
+
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("15: HTTP/2 bodies leave frame by frame within the peer's window", "[multi-file:15]")
+{
+    // SETTINGS_MAX_FRAME_SIZE nobody raised
+    const size_t MAX_FRAME = 16384;
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peerin = bufferevent_get_input(pair[1]);
+    CPassiveConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    std::string big(300000, '\0');
+    for (size_t i = 0; i < big.size(); ++i)
+        big[i] = 'a' + i % 26;
+    auto root = std::filesystem::temp_directory_path() / "pico-test-15";
+    std::filesystem::create_directories(root);
+    {
+        std::ofstream f(root / "big.txt", std::ios::binary);
+        f << big;
+    }
+    auto webroot = MYARGS.WebRootDir;
+    MYARGS.WebRootDir = root.string();
+
+    CHTTPServer srv;
+    srv.Register("/big", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, big });
+    });
+    ghttp::CResponse* streamed = nullptr;
+    srv.Register("/stream", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        streamed = rsp;
+        return rsp->Begin(ghttp::HttpStatusCode::OK);
+    });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    REQUIRE(client.InitNghttp2SessionData());
+    CH2Peer peer;
+    // moves frames both ways until neither side has anything to say
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(peer.session));
+            if (!peer.out.empty()) {
+                std::string in;
+                in.swap(peer.out);
+                REQUIRE(client.GetParser().ParseHttpMsg(&client, in) == (int32_t)in.size());
+            }
+            std::string got(evbuffer_get_length(peerin), '\0');
+            evbuffer_remove(peerin, got.data(), got.size());
+            if (got.empty() && peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+
+    // a body from memory stops at the initial window and goes on as the peer consumes it
+    auto id = peer.Get("/big");
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.bodies[id].size() == NGHTTP2_INITIAL_WINDOW_SIZE);
+    REQUIRE(peer.maxframe <= MAX_FRAME);
+    while (!peer.closed.count(id)) {
+        const auto before = peer.bodies[id].size();
+        peer.Consume(id);
+        pump();
+        REQUIRE(peer.bodies[id].size() > before);
+    }
+    REQUIRE(peer.bodies[id] == big);
+    REQUIRE(peer.frames >= big.size() / MAX_FRAME);
+
+    // a file goes the same way from its segment
+    peer.maxframe = 0;
+    id = peer.Get("/big.txt");
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.bodies[id].size() <= NGHTTP2_INITIAL_WINDOW_SIZE);
+    while (!peer.closed.count(id)) {
+        peer.Consume(id);
+        pump();
+    }
+    REQUIRE(peer.bodies[id] == big);
+    REQUIRE(peer.maxframe <= MAX_FRAME);
+
+    // a streamed response waits for its handler and resumes with every write
+    id = peer.Get("/stream");
+    pump();
+    REQUIRE(streamed);
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.bodies[id].empty());
+    REQUIRE(streamed->Write("first "));
+    pump();
+    REQUIRE(peer.bodies[id] == "first ");
+    REQUIRE(streamed->Write(big));
+    REQUIRE(streamed->End());
+    while (!peer.closed.count(id)) {
+        peer.Consume(id);
+        pump();
+    }
+    REQUIRE(peer.bodies[id] == "first " + big);
+
+    MYARGS.WebRootDir = webroot;
+    std::filesystem::remove_all(root);
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("16: HTTP/2 settings follow the configuration and peers over the limits are counted", "[multi-file:16]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peerin = bufferevent_get_input(pair[1]);
+    CPassiveConnection conn;
+    conn.SetBufferEvent(pair[0]);
+    CWorker worker;
+    CWorker::LOCAL_WORKER = &worker;
+    auto args = std::make_tuple(MYARGS.H2MaxStreams, MYARGS.H2MaxHeaderList, MYARGS.H2MaxResets);
+    MYARGS.H2MaxStreams = 2;
+    MYARGS.H2MaxHeaderList = 4096;
+    MYARGS.H2MaxResets = 5;
+
+    CHTTPServer srv;
+    std::vector<ghttp::CResponse*> held;
+    srv.Register("/hold", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        held.push_back(rsp);
+        return rsp->Begin(ghttp::HttpStatusCode::OK);
+    });
+    size_t uploaded = 0;
+    srv.Register(
+        "/upload", ghttp::HttpMethod::POST, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+            uploaded = req->GetBody().size();
+            return rsp->Response({ ghttp::HttpStatusCode::OK, "done" });
+        },
+        nullptr, 1024 * 1024);
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    REQUIRE(client.InitNghttp2SessionData());
+    CH2Peer peer;
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(peer.session));
+            if (!peer.out.empty()) {
+                std::string in;
+                in.swap(peer.out);
+                client.GetParser().ParseHttpMsg(&client, in);
+            }
+            std::string got(evbuffer_get_length(peerin), '\0');
+            evbuffer_remove(peerin, got.data(), got.size());
+            if (got.empty() && peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+
+    // the third stream arrives before the peer saw the limit and is refused
+    const int32_t ids[] = { peer.Get("/hold"), peer.Get("/hold"), peer.Get("/hold") };
+    pump();
+    REQUIRE(nghttp2_session_get_remote_settings(peer.session, NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS) == 2);
+    REQUIRE(nghttp2_session_get_remote_settings(peer.session, NGHTTP2_SETTINGS_MAX_HEADER_LIST_SIZE) == 4096);
+    REQUIRE(nghttp2_session_get_remote_settings(peer.session, NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE) == H2_STREAM_WINDOW);
+    REQUIRE(nghttp2_session_get_remote_settings(peer.session, NGHTTP2_SETTINGS_MAX_FRAME_SIZE) == H2_MAX_FRAME);
+    REQUIRE(nghttp2_session_get_remote_window_size(peer.session) == (int32_t)H2_CONNECTION_WINDOW);
+    REQUIRE(held.size() == 2);
+    REQUIRE(peer.closed.count(ids[2]));
+    REQUIRE_FALSE(peer.closed.count(ids[0]));
+    REQUIRE(worker.H2Violations(H2Violation::STREAMS) == 1);
+    for (auto rsp : held)
+        REQUIRE(rsp->End());
+    held.clear();
+    pump();
+    REQUIRE((peer.closed.count(ids[0]) && peer.closed.count(ids[1])));
+
+    // a header block over the limit resets its stream only
+    auto id = peer.Get("/hold", std::string(5000, 'x'));
+    pump();
+    REQUIRE(peer.closed.count(id));
+    REQUIRE(peer.status[id].empty());
+    REQUIRE(held.empty());
+    REQUIRE(worker.H2Violations(H2Violation::HEADERLIST) == 1);
+
+    // a body that fills the stream window within a round trip doubles it
+    const std::string body(200000, 'b');
+    id = peer.Get("/upload", "", &body);
+    for (int32_t i = 0; i < 10 && !peer.closed.count(id); ++i)
+        pump();
+    REQUIRE(uploaded == body.size());
+    REQUIRE(peer.bodies[id] == "done");
+    REQUIRE(nghttp2_session_get_remote_settings(peer.session, NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE) > H2_STREAM_WINDOW);
+
+    // streams opened and cancelled faster than the limit close the connection
+    for (int32_t i = 0; i < 12 && !peer.goaway; ++i) {
+        id = peer.Get("/hold");
+        pump();
+        nghttp2_submit_rst_stream(peer.session, NGHTTP2_FLAG_NONE, id, NGHTTP2_CANCEL);
+        pump();
+    }
+    REQUIRE(peer.goaway == NGHTTP2_ENHANCE_YOUR_CALM);
+    REQUIRE(worker.H2Violations(H2Violation::RESETFLOOD) == 1);
+    REQUIRE(worker.H2Violations(H2Violation::FLOWCONTROL) == 0);
+
+    std::tie(MYARGS.H2MaxStreams, MYARGS.H2MaxHeaderList, MYARGS.H2MaxResets) = args;
+    CWorker::LOCAL_WORKER = nullptr;
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("17: HTTP/2 response headers from static fields, gRPC unary calls", "[multi-file:17][!benchmark]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peerin = bufferevent_get_input(pair[1]);
+    CPassiveConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    CHTTPServer srv;
+    srv.Register("/json", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, "{\"ok\":true}" });
+    });
+    srv.Register("/missing", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::NOTFOUND, "" });
+    });
+    srv.Register("/pico.Echo/Say", ghttp::HttpMethod::POST, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, std::string(req->GetBody()) });
+    });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    REQUIRE(client.InitNghttp2SessionData());
+    CH2Peer peer;
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(peer.session));
+            if (!peer.out.empty()) {
+                std::string in;
+                in.swap(peer.out);
+                REQUIRE(client.GetParser().ParseHttpMsg(&client, in) == (int32_t)in.size());
+            }
+            std::string got(evbuffer_get_length(peerin), '\0');
+            evbuffer_remove(peerin, got.data(), got.size());
+            if (got.empty() && peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+
+    auto id = peer.Get("/json");
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.fields[id]["content-type"] == "application/json; charset=utf-8");
+    REQUIRE(peer.fields[id]["content-length"] == "11");
+    REQUIRE(peer.fields[id]["date"] == ghttp::GetHttpDate());
+    REQUIRE(peer.fields[id]["server"] == ghttp::GetHttpServer());
+    REQUIRE(peer.bodies[id] == "{\"ok\":true}");
+    id = peer.Get("/missing");
+    pump();
+    REQUIRE(peer.status[id] == "404");
+    REQUIRE_FALSE(peer.fields[id].count("content-length"));
+
+    // a length prefixed message answered with the same message and an ok status in the trailers
+    const std::string message = "hello pico";
+    std::string request(GRPC_MESSAGE_HEADER_LENGTH, '\0');
+    request[4] = (char)message.size();
+    request += message;
+    peer.headers = { { "content-type", "application/grpc" }, { "te", "trailers" } };
+    id = peer.Get("/pico.Echo/Say", "", &request);
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.fields[id]["content-type"] == "application/grpc");
+    REQUIRE(peer.fields[id]["grpc-accept-encoding"] == "identity,deflate,gzip");
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+    REQUIRE(peer.bodies[id] == request);
+
+    BENCHMARK("gRPC unary call over a hand-driven peer")
+    {
+        auto id = peer.Get("/pico.Echo/Say", "", &request);
+        pump();
+        const size_t n = peer.bodies[id].size();
+        peer.bodies.erase(id);
+        peer.status.erase(id);
+        peer.fields.erase(id);
+        peer.closed.erase(id);
+        return n;
+    };
+
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("18: gRPC calls stream messages both ways and end with their status", "[multi-file:18]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peerin = bufferevent_get_input(pair[1]);
+    CPassiveConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    auto frame = [](std::string_view msg) {
+        std::string s(GRPC_MESSAGE_HEADER_LENGTH, '\0');
+        CEncoder<GRPCMessageHeader>::EncodeHeader(s.data(), 0, msg.size());
+        return s.append(msg);
+    };
+    auto messages = [](std::string_view body) {
+        std::vector<std::string> v;
+        CDecoder<GRPCMessageHeader> dec;
+        dec.Feed(body, UINT32_MAX, [&](const uint8_t, std::string_view msg) {
+            v.emplace_back(msg);
+            return true;
+        });
+        return v;
+    };
+
+    CHTTPServer srv;
+    srv.RegisterGrpc("/pico.Echo/Say", { .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) {
+        return call->Send(msg) && call->Finish(ghttp::GrpcStatus::OK);
+    } });
+    srv.RegisterGrpc("/pico.Echo/Repeat", { .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) {
+        for (int32_t i = 0; i < 3; ++i)
+            REQUIRE(call->Send(fmt::format("{}{}", msg, i)));
+        return call->Finish(ghttp::GrpcStatus::OK);
+    } });
+    std::map<ghttp::CGrpcCall*, std::string> sums;
+    srv.RegisterGrpc("/pico.Echo/Sum", {
+                                           .onmessage = [&](ghttp::CGrpcCall* call, std::string_view msg) {
+                                               sums[call].append(msg);
+                                               return true;
+                                           },
+                                           .onhalfclose = [&](ghttp::CGrpcCall* call) {
+                                               auto sum = sums[call];
+                                               sums.erase(call);
+                                               return call->Send(sum) && call->Finish(ghttp::GrpcStatus::OK);
+                                           },
+                                       });
+    srv.RegisterGrpc("/pico.Echo/Chat", {
+                                            .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) { return call->Send(msg); },
+                                            .onhalfclose = [](ghttp::CGrpcCall* call) { return call->Finish(ghttp::GrpcStatus::OK); },
+                                        });
+    srv.RegisterGrpc("/pico.Echo/Fail", { .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) {
+        return call->Finish(ghttp::GrpcStatus::INVALID_ARGUMENT, "bad name \xc3\xbc 100%");
+    } });
+    srv.RegisterGrpc("/pico.Echo/Small", { .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) { return call->Send(msg); }, .maxmessage = 16 });
+    size_t cancelled = 0;
+    srv.RegisterGrpc("/pico.Echo/Slow", {
+                                            .onmessage = [](ghttp::CGrpcCall* call, std::string_view msg) { return true; },
+                                            .oncancel = [&](ghttp::CGrpcCall* call) { ++cancelled; },
+                                        });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    REQUIRE(client.InitNghttp2SessionData());
+    CH2Peer peer;
+    peer.headers = { { "content-type", "application/grpc" }, { "te", "trailers" } };
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(peer.session));
+            if (!peer.out.empty()) {
+                std::string in;
+                in.swap(peer.out);
+                REQUIRE(client.GetParser().ParseHttpMsg(&client, in) == (int32_t)in.size());
+            }
+            std::string got(evbuffer_get_length(peerin), '\0');
+            evbuffer_remove(peerin, got.data(), got.size());
+            if (got.empty() && peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+
+    // unary
+    auto request = frame("hello");
+    auto id = peer.Get("/pico.Echo/Say", "", &request);
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.fields[id]["content-type"] == "application/grpc");
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+    REQUIRE(messages(peer.bodies[id]) == std::vector<std::string> { "hello" });
+    REQUIRE(peer.closed.count(id));
+
+    // server streaming
+    id = peer.Get("/pico.Echo/Repeat", "", &request);
+    pump();
+    REQUIRE(messages(peer.bodies[id]) == std::vector<std::string> { "hello0", "hello1", "hello2" });
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+
+    // client streaming, three messages in one DATA frame and one split across two
+    id = peer.Open("/pico.Echo/Sum");
+    peer.Send(id, frame("a") + frame("bb") + frame("ccc"), false);
+    pump();
+    REQUIRE(peer.bodies[id].empty());
+    const auto split = frame("dddd");
+    peer.Send(id, split.substr(0, 3), false);
+    pump();
+    peer.Send(id, split.substr(3), true);
+    pump();
+    REQUIRE(messages(peer.bodies[id]) == std::vector<std::string> { "abbcccdddd" });
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+    REQUIRE(sums.empty());
+
+    // bidi streaming, every message answered before the client is done
+    id = peer.Open("/pico.Echo/Chat");
+    peer.Send(id, frame("ping"), false);
+    pump();
+    REQUIRE(messages(peer.bodies[id]) == std::vector<std::string> { "ping" });
+    REQUIRE_FALSE(peer.fields[id].count("grpc-status"));
+    peer.Send(id, frame("pong"), true);
+    pump();
+    REQUIRE(messages(peer.bodies[id]) == std::vector<std::string> { "ping", "pong" });
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+
+    // errors come as status and percent-encoded message in the trailers of a 200
+    id = peer.Get("/pico.Echo/Fail", "", &request);
+    pump();
+    REQUIRE(peer.status[id] == "200");
+    REQUIRE(peer.fields[id]["grpc-status"] == "3");
+    REQUIRE(peer.fields[id]["grpc-message"] == "bad name %C3%BC 100%25");
+    REQUIRE(peer.bodies[id].empty());
+    const auto big = frame(std::string(32, 'x'));
+    id = peer.Get("/pico.Echo/Small", "", &big);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "8");
+    id = peer.Get("/pico.Echo/Unknown", "", &request);
+    pump();
+    REQUIRE(peer.status[id] == "404");
+
+    // a call past its grpc-timeout is finished for the client and cancelled for the service
+    REQUIRE(ghttp::CGrpcCall::ParseTimeout("50m") == 50);
+    REQUIRE(ghttp::CGrpcCall::ParseTimeout("2S") == 2000);
+    REQUIRE(ghttp::CGrpcCall::ParseTimeout("1500u") == 2);
+    REQUIRE_FALSE(ghttp::CGrpcCall::ParseTimeout("123456789S"));
+    REQUIRE_FALSE(ghttp::CGrpcCall::ParseTimeout("5x"));
+    peer.headers.push_back({ "grpc-timeout", "50m" });
+    id = peer.Get("/pico.Echo/Slow", "", &request);
+    pump();
+    peer.headers.pop_back();
+    REQUIRE(peer.status[id] == "");
+    // past the deadlines test 14 left the per thread wheel at too
+    CHTTPClient::UpdateDeadlines(CChrono::SteadyMs() + HTTP_HEADER_TIMEOUT * 2000);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "4");
+    REQUIRE(cancelled == 1);
+
+    // and so is one the client resets
+    id = peer.Open("/pico.Echo/Slow");
+    peer.Send(id, frame("wait"), false);
+    pump();
+    nghttp2_submit_rst_stream(peer.session, NGHTTP2_FLAG_NONE, id, NGHTTP2_CANCEL);
+    pump();
+    REQUIRE(cancelled == 2);
+
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("19: gRPC messages are compressed by negotiation and inflated within bounds", "[multi-file:19]")
+{
+    // codec on its own, streams reused across messages
+    REQUIRE(ghttp::CGrpcCodec::Parse("") == ghttp::GrpcEncoding::IDENTITY);
+    REQUIRE(ghttp::CGrpcCodec::Parse("gzip") == ghttp::GrpcEncoding::GZIP);
+    REQUIRE_FALSE(ghttp::CGrpcCodec::Parse("br"));
+    REQUIRE(ghttp::CGrpcCodec::Choose("identity, deflate, gzip") == ghttp::GrpcEncoding::GZIP);
+    REQUIRE(ghttp::CGrpcCodec::Choose("br,deflate") == ghttp::GrpcEncoding::DEFLATE);
+    REQUIRE(ghttp::CGrpcCodec::Choose("identity") == ghttp::GrpcEncoding::IDENTITY);
+    std::string text;
+    for (int32_t i = 0; i < 200; ++i)
+        text += fmt::format("{{\"rank\":{},\"name\":\"player{}\",\"score\":{}}}", i, i, 10000 - i);
+    std::string packed, unpacked;
+    for (auto enc : { ghttp::GrpcEncoding::GZIP, ghttp::GrpcEncoding::DEFLATE, ghttp::GrpcEncoding::GZIP }) {
+        REQUIRE(ghttp::CGrpcCodec::Compress(enc, text, packed));
+        REQUIRE(packed.size() < text.size() / 4);
+        REQUIRE(ghttp::CGrpcCodec::Inflate(enc, packed, text.size(), unpacked) == ghttp::GrpcStatus::OK);
+        REQUIRE(unpacked == text);
+        REQUIRE(ghttp::CGrpcCodec::Inflate(enc, packed, text.size() - 1, unpacked) == ghttp::GrpcStatus::RESOURCE_EXHAUSTED);
+    }
+    REQUIRE(ghttp::CGrpcCodec::Inflate(ghttp::GrpcEncoding::GZIP, packed.substr(0, packed.size() / 2), text.size(), unpacked) == ghttp::GrpcStatus::INTERNAL);
+    REQUIRE(ghttp::CGrpcCodec::Inflate(ghttp::GrpcEncoding::DEFLATE, "not zlib", text.size(), unpacked) == ghttp::GrpcStatus::INTERNAL);
+    // a megabyte of zeros packs a thousand times, past the default ratio
+    std::string bomb;
+    REQUIRE(ghttp::CGrpcCodec::Compress(ghttp::GrpcEncoding::GZIP, std::string(1024 * 1024, '\0'), bomb));
+    REQUIRE(ghttp::CGrpcCodec::InflateLimit(bomb.size(), UINT32_MAX) == bomb.size() * GRPC_MAX_RATIO);
+    REQUIRE(ghttp::CGrpcCodec::Inflate(ghttp::GrpcEncoding::GZIP, bomb, ghttp::CGrpcCodec::InflateLimit(bomb.size(), UINT32_MAX), unpacked) == ghttp::GrpcStatus::RESOURCE_EXHAUSTED);
+
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    bufferevent* pair[2] = { nullptr };
+    REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+    bufferevent_enable(pair[1], EV_READ);
+    auto peerin = bufferevent_get_input(pair[1]);
+    CPassiveConnection conn;
+    conn.SetBufferEvent(pair[0]);
+
+    auto frame = [](std::string_view msg, const uint8_t flags) {
+        std::string s(GRPC_MESSAGE_HEADER_LENGTH, '\0');
+        CEncoder<GRPCMessageHeader>::EncodeHeader(s.data(), flags, msg.size());
+        return s.append(msg);
+    };
+    auto messages = [](std::string_view body) {
+        std::vector<std::pair<uint8_t, std::string>> v;
+        CDecoder<GRPCMessageHeader> dec;
+        dec.Feed(body, UINT32_MAX, [&](const uint8_t flags, std::string_view msg) {
+            v.emplace_back(flags, msg);
+            return true;
+        });
+        return v;
+    };
+
+    CHTTPServer srv;
+    std::vector<std::string> received;
+    srv.RegisterGrpc("/pico.Rank/Top", { .onmessage = [&](ghttp::CGrpcCall* call, std::string_view msg) {
+        received.emplace_back(msg);
+        return call->Send(msg) && call->Finish(ghttp::GrpcStatus::OK);
+    } });
+
+    CHTTPClient client;
+    client.Init(&conn, &srv);
+    REQUIRE(client.InitNghttp2SessionData());
+    CH2Peer peer;
+    peer.headers = { { "content-type", "application/grpc" }, { "te", "trailers" }, { "grpc-encoding", "gzip" }, { "grpc-accept-encoding", "gzip" } };
+    auto pump = [&]() {
+        for (;;) {
+            REQUIRE(0 == nghttp2_session_send(peer.session));
+            if (!peer.out.empty()) {
+                std::string in;
+                in.swap(peer.out);
+                REQUIRE(client.GetParser().ParseHttpMsg(&client, in) == (int32_t)in.size());
+            }
+            std::string got(evbuffer_get_length(peerin), '\0');
+            evbuffer_remove(peerin, got.data(), got.size());
+            if (got.empty() && peer.out.empty())
+                break;
+            REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+        }
+    };
+
+    // a compressed request reaches the service inflated, the answer comes back compressed
+    REQUIRE(ghttp::CGrpcCodec::Compress(ghttp::GrpcEncoding::GZIP, text, packed));
+    auto request = frame(packed, 1);
+    auto id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "0");
+    REQUIRE(peer.fields[id]["grpc-encoding"] == "gzip");
+    REQUIRE(peer.fields[id]["grpc-accept-encoding"] == "identity,deflate,gzip");
+    REQUIRE(received.back() == text);
+    auto got = messages(peer.bodies[id]);
+    REQUIRE(got.size() == 1);
+    REQUIRE(got[0].first == 1);
+    REQUIRE(got[0].second.size() < text.size() / 4);
+    REQUIRE(ghttp::CGrpcCodec::Inflate(ghttp::GrpcEncoding::GZIP, got[0].second, text.size(), unpacked) == ghttp::GrpcStatus::OK);
+    REQUIRE(unpacked == text);
+
+    // messages under the threshold go uncompressed, flagged as such
+    request = frame("small", 0);
+    id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    got = messages(peer.bodies[id]);
+    REQUIRE(got.size() == 1);
+    REQUIRE((got[0].first == 0 && got[0].second == "small"));
+
+    // a bomb stops at the ratio, an encoding we lack or a corrupt message fails the call
+    request = frame(bomb, 1);
+    id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "8");
+    request = frame(packed.substr(0, packed.size() / 2), 1);
+    id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "13");
+    peer.headers = { { "content-type", "application/grpc" }, { "te", "trailers" }, { "grpc-encoding", "br" } };
+    request = frame(packed, 1);
+    id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    REQUIRE(peer.fields[id]["grpc-status"] == "12");
+    // without gzip or deflate accepted the answer stays uncompressed
+    request = frame(text, 0);
+    id = peer.Get("/pico.Rank/Top", "", &request);
+    pump();
+    REQUIRE_FALSE(peer.fields[id].count("grpc-encoding"));
+    got = messages(peer.bodies[id]);
+    REQUIRE((got.size() == 1 && got[0].first == 0 && got[0].second == text));
+    REQUIRE(received.size() == 3);
+
+    conn.SetBufferEvent(nullptr);
+    bufferevent_free(pair[0]);
+    bufferevent_free(pair[1]);
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("24: Draining closes every websocket with going away", "[multi-file:24]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    CHTTPServer srv;
+    srv.Register("/ws", ghttp::HttpMethod::GET, [](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return CWebSocket::Upgrade(rsp, [](CWebSocket*, std::string_view) { return true; }) != nullptr;
+    });
+
+    const size_t before = CWebSocket::Alive();
+    bufferevent* pair[3][2] = {};
+    CConnection conn[3];
+    std::unique_ptr<CHTTPClient> client[3];
+    for (int32_t i = 0; i < 3; ++i) {
+        REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair[i]));
+        bufferevent_enable(pair[i][1], EV_READ);
+        conn[i].SetBufferEvent(pair[i][0]);
+        bufferevent_enable(pair[i][0], EV_READ | EV_WRITE);
+        client[i].reset(CNEW CHTTPClient());
+        client[i]->Init(&conn[i], &srv);
+        const std::string in = "GET /ws HTTP/1.1\r\n\r\n";
+        REQUIRE(client[i]->GetParser().ParseHttpMsg(client[i].get(), in) == (int32_t)in.size());
+    }
+    REQUIRE(CWebSocket::Alive() == before + 3);
+
+    // each peer is told the server goes away, the websockets live until the peer answers
+    CWebSocket::DrainAll();
+    for (int32_t i = 0; i < 3; ++i) {
+        auto peer = bufferevent_get_input(pair[i][1]);
+        std::string out(evbuffer_get_length(peer), '\0');
+        evbuffer_remove(peer, out.data(), out.size());
+        REQUIRE(out.size() >= 4);
+        REQUIRE((uint8_t)out[0] == 0x88);
+        REQUIRE(out.substr(out.size() - 2) == "\x03\xe9");
+    }
+    REQUIRE(CWebSocket::Alive() == before + 3);
+    // draining twice sends nothing more
+    CWebSocket::DrainAll();
+    REQUIRE(evbuffer_get_length(bufferevent_get_input(pair[0][1])) == 0);
+
+    // the close handshake completes, a masked close frame from every peer
+    const char answer[] = { (char)0x88, (char)0x82, 0, 0, 0, 0, 0x03, (char)0xe9 };
+    for (int32_t i = 0; i < 3; ++i)
+        bufferevent_write(pair[i][1], answer, sizeof(answer));
+    for (int32_t i = 0; i < 5; ++i)
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+    REQUIRE(CWebSocket::Alive() == before);
+
+    for (int32_t i = 0; i < 3; ++i) {
+        client[i].reset();
+        conn[i].SetBufferEvent(nullptr);
+        bufferevent_free(pair[i][0]);
+        bufferevent_free(pair[i][1]);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("31: Slow responses and silent http2 streams are bounded by their progress", "[multi-file:31]")
+{
+    auto writetimeout = MYARGS.WriteTimeout;
+    auto bodytimeout = MYARGS.BodyTimeout;
+    MYARGS.WriteTimeout = 5;
+    MYARGS.BodyTimeout = 5;
+    const uint64_t period = 5000 + HTTP_DEADLINE_TICK;
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    CHTTPServer srv;
+    const std::string big(100000, 'x');
+    srv.Register("/big", ghttp::HttpMethod::GET, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        return rsp->Response({ ghttp::HttpStatusCode::OK, big });
+    });
+    ghttp::CResponse* later = nullptr;
+    srv.Register("/later", ghttp::HttpMethod::POST, [&](ghttp::CRequest* req, ghttp::CResponse* rsp) {
+        later = rsp;
+        return true;
+    });
+    uint64_t now = CHTTPClient::DeadlineNow();
+
+    {
+        // the peer reads nothing until told to
+        bufferevent* pair[2] = { nullptr };
+        REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+        auto peerin = bufferevent_get_input(pair[1]);
+        CConnection conn;
+        conn.SetBufferEvent(pair[0]);
+        CHTTPClient client;
+        client.Init(&conn, &srv);
+        auto parse = [&client](std::string_view data) { return client.GetParser().ParseHttpMsg(&client, data); };
+
+        // a connection is not idle before its response left
+        std::string in = "GET /big HTTP/1.1\r\n\r\n";
+        REQUIRE(parse(in) == (int32_t)in.size());
+        REQUIRE(client.GetDeadline() == HttpDeadline::WRITE);
+        bufferevent_setwatermark(pair[1], EV_READ, 0, 1000);
+        bufferevent_enable(pair[1], EV_READ);
+        REQUIRE(evbuffer_get_length(peerin) == 1000);
+        CHTTPClient::UpdateDeadlines(now += period);
+        REQUIRE(client.GetDeadline() == HttpDeadline::WRITE);
+
+        // it goes idle once the output drained
+        bufferevent_disable(pair[1], EV_READ);
+        bufferevent_setwatermark(pair[1], EV_READ, 0, 0);
+        bufferevent_enable(pair[1], EV_READ);
+        REQUIRE(0 == evbuffer_get_length(bufferevent_get_output(pair[0])));
+        CHTTPClient::OnWrite(&client);
+        REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+
+        // a peer that stopped reading is closed after one period without progress
+        bufferevent_disable(pair[1], EV_READ);
+        REQUIRE(parse(in) == (int32_t)in.size());
+        REQUIRE(client.GetDeadline() == HttpDeadline::WRITE);
+        CHTTPClient::UpdateDeadlines(now += period);
+        REQUIRE_FALSE(client.GetDeadline());
+
+        conn.SetBufferEvent(nullptr);
+        bufferevent_free(pair[0]);
+        bufferevent_free(pair[1]);
+    }
+
+    {
+        bufferevent* pair[2] = { nullptr };
+        REQUIRE(0 == bufferevent_pair_new(CContex::MAIN_CONTEX->Base(), 0, pair));
+        bufferevent_enable(pair[1], EV_READ);
+        auto peerin = bufferevent_get_input(pair[1]);
+        CPassiveConnection conn;
+        conn.SetBufferEvent(pair[0]);
+        CHTTPClient client;
+        client.Init(&conn, &srv);
+        REQUIRE(client.InitNghttp2SessionData());
+        CH2Peer peer;
+        auto pump = [&]() {
+            for (;;) {
+                REQUIRE(0 == nghttp2_session_send(peer.session));
+                if (!peer.out.empty()) {
+                    std::string in;
+                    in.swap(peer.out);
+                    REQUIRE(client.GetParser().ParseHttpMsg(&client, in) == (int32_t)in.size());
+                }
+                std::string got(evbuffer_get_length(peerin), '\0');
+                evbuffer_remove(peerin, got.data(), got.size());
+                if (got.empty() && peer.out.empty())
+                    break;
+                REQUIRE(nghttp2_session_mem_recv(peer.session, (const uint8_t*)got.data(), got.size()) == (ssize_t)got.size());
+            }
+        };
+
+        // every frame of a stream re-arms the connection deadline with what it waits for next
+        auto id = peer.Open("/later");
+        pump();
+        REQUIRE(client.GetDeadline() == HttpDeadline::BODY);
+        CHTTPClient::UpdateDeadlines(now += 4000);
+        peer.Send(id, "ab", false);
+        pump();
+        CHTTPClient::UpdateDeadlines(now += 4000);
+        REQUIRE(client.GetDeadline() == HttpDeadline::BODY);
+        peer.Send(id, "cd", true);
+        pump();
+        REQUIRE(later);
+        REQUIRE(client.GetDeadline() == HttpDeadline::HANDLER);
+        REQUIRE(later->Response({ ghttp::HttpStatusCode::OK, "done" }));
+        REQUIRE(client.GetDeadline() == HttpDeadline::WRITE);
+        // sent on the next write event
+        CHTTPClient::OnWrite(&client);
+        pump();
+        REQUIRE(peer.status[id] == "200");
+        REQUIRE(peer.bodies[id] == "done");
+        REQUIRE(peer.closed.count(id));
+        REQUIRE(client.GetDeadline() == HttpDeadline::IDLE);
+
+        // a stream that went silent does not hold the connection
+        peer.Open("/later");
+        pump();
+        REQUIRE(client.GetDeadline() == HttpDeadline::BODY);
+        CHTTPClient::UpdateDeadlines(now += period);
+        REQUIRE_FALSE(client.GetDeadline());
+
+        conn.SetBufferEvent(nullptr);
+        bufferevent_free(pair[0]);
+        bufferevent_free(pair[1]);
+    }
+    MYARGS.WriteTimeout = writetimeout;
+    MYARGS.BodyTimeout = bodytimeout;
+    CContex::MAIN_CONTEX = nullptr;
+}
@@ -0,0 +1,128 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/contex.hpp"
+#include "framework/httpserver.hpp"
+#include "framework/objectpool.hpp"
+
+#include <cstdlib>
+#include <new>
+
+USE_NAMESPACE_FRAMEWORK
+
+// every allocation of the test binary is counted per thread
+namespace {
+thread_local uint64_t ALLOCATIONS = 0;
+}
+
+void* operator new(std::size_t n)
+{
+    ++ALLOCATIONS;
+    if (auto p = std::malloc(n ? n : 1); p)
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+struct PooledNode : public CPooled<PooledNode> {
+    std::string name;
+    uint64_t value = { 0 };
+};
+struct DerivedNode : public PooledNode {
+    char padding[64];
+};
+}
+
+TEST_CASE("7: Object pool reuses released blocks", "[multi-file:7]")
+{
+    auto& pool = PooledNode::Pool();
+    pool.Clear();
+    const auto before = pool.GetStats();
+
+    std::vector<PooledNode*> nodes;
+    for (int i = 0; i < 8; ++i)
+        nodes.push_back(CNEW PooledNode());
+    std::unordered_set<PooledNode*> released(nodes.begin(), nodes.end());
+    for (auto n : nodes) {
+        CDEL(n);
+    }
+    REQUIRE(pool.GetStats().cached == 8);
+    REQUIRE(pool.GetStats().misses - before.misses == 8);
+
+    for (int i = 0; i < 8; ++i) {
+        auto n = CNEW PooledNode();
+        REQUIRE(n->value == 0);
+        REQUIRE(released.count(n) == 1);
+        nodes[i] = n;
+    }
+    REQUIRE(pool.GetStats().hits - before.hits == 8);
+    REQUIRE(pool.GetStats().cached == 0);
+
+    // other sizes bypass the pool
+    auto d = CNEW DerivedNode();
+    PooledNode* base = d;
+    REQUIRE(released.count(base) == 0);
+    CDEL(d);
+    REQUIRE(pool.GetStats().cached == 0);
+
+    for (auto n : nodes) {
+        CDEL(n);
+    }
+    pool.Clear();
+    REQUIRE(pool.GetStats().cached == 0);
+}
+TEST_CASE("26: A closed http2 stream is reused without allocating", "[multi-file:26]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        CHTTPServer srv;
+        CHTTPClient client;
+        client.Init(nullptr, &srv);
+        // longer than any small string buffer
+        auto fill = [](ghttp::CStream* stream) {
+            auto req = stream->GetRequest();
+            req->SetMethod(ghttp::HttpMethod::POST);
+            req->SetTarget("/pico.Rank/Top?season=2026&region=eu-west-1");
+            req->AddHeader("content-type", "application/grpc+proto");
+            req->AddHeader("user-agent", "grpc-c++/1.50.0 grpc-c/28.0.0 (linux; chttp2)");
+            req->AppendBody("a request body that does not fit in place");
+            auto rsp = stream->GetResponse();
+            rsp->AddHeader("content-type", "application/grpc+proto");
+            rsp->AddTrailer("grpc-message", "every stream of the session ends the same way");
+        };
+        // one stream stays open, the session does not go idle in between
+        fill(client.CreateStream(1));
+        int32_t id = 3;
+        auto round = [&client, &fill, &id]() {
+            const uint64_t before = ALLOCATIONS;
+            for (int32_t i = 0; i < 4; ++i)
+                fill(client.CreateStream(id + i * 2));
+            for (int32_t i = 0; i < 4; ++i)
+                client.DelStream(id + i * 2);
+            id += 8;
+            return ALLOCATIONS - before;
+        };
+        // the first streams allocate, the ones after them take their place
+        REQUIRE(round() > 0);
+        REQUIRE(round() == 0);
+        REQUIRE(round() == 0);
+
+        // a new stream allocates its request, response and their fields
+        const uint64_t before = ALLOCATIONS;
+        std::unique_ptr<ghttp::CStream> fresh(CNEW ghttp::CStream(id, &client));
+        fill(fresh.get());
+        REQUIRE(ALLOCATIONS - before >= 4);
+        fresh.reset();
+        client.DelStream(1);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
@@ -0,0 +1,216 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/argument.hpp"
+#include "framework/contex.hpp"
+#include "framework/handoff.hpp"
+#include "framework/tcpserver.hpp"
+
+#include "fmt/core.h"
+
+#include <arpa/inet.h>
+
+USE_NAMESPACE_FRAMEWORK
+
+namespace {
+// a port nobody listens on right now
+uint16_t freePort()
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ::bind(fd, (sockaddr*)&addr, len);
+    ::getsockname(fd, (sockaddr*)&addr, &len);
+    evutil_closesocket(fd);
+    return ntohs(addr.sin_port);
+}
+
+// blocking connect, completed by the kernel from the listen backlog
+int32_t dial(const uint16_t port)
+{
+    auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        evutil_closesocket(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void pump()
+{
+    for (int32_t i = 0; i < 5; ++i)
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+}
+} // namespace
+
+TEST_CASE("22: Every worker listens on the same port and the kernel spreads the accepts", "[multi-file:22]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        const auto port = freePort();
+        const auto host = fmt::format("tcp://127.0.0.1:{}", port);
+        CTCPServer servers[2];
+        uint32_t accepted[2] = {};
+        for (int32_t i = 0; i < 2; ++i) {
+            // SO_REUSEPORT is set on every listener, binding the port twice succeeds
+            REQUIRE(servers[i].ListenAndServe(host, [&servers, &accepted, i](const int32_t fd) {
+                accepted[i]++;
+                evutil_closesocket(fd);
+                servers[i].OnClosed();
+            }));
+        }
+
+        std::vector<int32_t> clients;
+        for (int32_t i = 0; i < 64; ++i) {
+            auto fd = dial(port);
+            REQUIRE(fd >= 0);
+            clients.push_back(fd);
+        }
+        pump();
+        REQUIRE(accepted[0] + accepted[1] == 64);
+        for (int32_t i = 0; i < 2; ++i) {
+            REQUIRE(servers[i].GetStats().accepted == accepted[i]);
+            REQUIRE(servers[i].GetStats().active == 0);
+        }
+        for (auto fd : clients)
+            evutil_closesocket(fd);
+
+        // a listener shut down leaves the port to the other one
+        servers[0].Shutdown();
+        auto fd = dial(port);
+        REQUIRE(fd >= 0);
+        pump();
+        REQUIRE(accepted[0] + accepted[1] == 65);
+        REQUIRE(servers[1].GetStats().accepted == accepted[1]);
+        evutil_closesocket(fd);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("23: A listener accepts in batches and pauses at the connection limit", "[multi-file:23]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    auto args = std::make_tuple(MYARGS.AcceptBatch, MYARGS.MaxConnections);
+    MYARGS.AcceptBatch = 2;
+    MYARGS.MaxConnections = 3;
+    {
+        const auto port = freePort();
+        CTCPServer server;
+        std::vector<int32_t> fds;
+        REQUIRE(server.ListenAndServe(fmt::format("tcp://127.0.0.1:{}", port), [&fds](const int32_t fd) { fds.push_back(fd); }));
+        std::vector<int32_t> clients;
+        for (int32_t i = 0; i < 5; ++i) {
+            clients.push_back(dial(port));
+            REQUIRE(clients.back() >= 0);
+        }
+
+        // one wakeup takes no more than a batch
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE | EVLOOP_NONBLOCK);
+        REQUIRE(fds.size() == 2);
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE | EVLOOP_NONBLOCK);
+        REQUIRE(fds.size() == 3);
+        REQUIRE(server.IsPaused());
+        REQUIRE(server.GetStats().paused == 1);
+        REQUIRE(server.GetStats().active == 3);
+
+        // still full when the resume timer fires, the listener stays off
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE);
+        REQUIRE(server.IsPaused());
+        REQUIRE(fds.size() == 3);
+
+        // a closed connection makes room for exactly one more
+        evutil_closesocket(fds.front());
+        server.OnClosed();
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE);
+        REQUIRE_FALSE(server.IsPaused());
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+        REQUIRE(fds.size() == 4);
+        REQUIRE(server.IsPaused());
+        REQUIRE(server.GetStats().paused == 2);
+
+        // the pending one is taken once everything closed
+        for (size_t i = 1; i < fds.size(); ++i) {
+            evutil_closesocket(fds[i]);
+            server.OnClosed();
+        }
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE);
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+        REQUIRE(fds.size() == 5);
+        REQUIRE_FALSE(server.IsPaused());
+        REQUIRE(server.GetStats().accepted == 5);
+        REQUIRE(server.GetStats().rejected == 0);
+        CTCPServer::LogStats();
+
+        evutil_closesocket(fds.back());
+        for (auto fd : clients)
+            evutil_closesocket(fd);
+    }
+    std::tie(MYARGS.AcceptBatch, MYARGS.MaxConnections) = args;
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("25: Listeners opened by worker threads are handed to the next process", "[multi-file:25]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        const auto port = freePort();
+        const auto host = fmt::format("tcp://127.0.0.1:{}", port);
+        const auto path = fmt::format("/tmp/pico-handoff-test-{}.sock", getpid());
+
+        // reuseport workers listen on their own contex
+        std::shared_ptr<CContex> contex[2] = { std::make_shared<CContex>(event_base_new()), std::make_shared<CContex>(event_base_new()) };
+        CTCPServer* servers[2] = {};
+        bool listening[2] = {};
+        std::thread workers[2];
+        for (int32_t i = 0; i < 2; ++i) {
+            workers[i] = std::thread([&contex, &servers, &listening, &host, i]() {
+                CContex::MAIN_CONTEX = contex[i];
+                servers[i] = CNEW CTCPServer();
+                listening[i] = servers[i]->ListenAndServe(host, [](const int32_t fd) { evutil_closesocket(fd); });
+                CContex::MAIN_CONTEX = nullptr;
+            });
+        }
+        for (auto& v : workers)
+            v.join();
+        REQUIRE((listening[0] && listening[1]));
+
+        // the main thread serves every one of them, the new process takes one per worker
+        bool handed = false;
+        REQUIRE(CHandoff::Instance().Serve(path, [&handed]() { handed = true; }));
+        bool received = false;
+        std::thread next([&received, &path]() { received = CHandoff::Instance().Receive(path); });
+        for (int32_t i = 0; i < 100 && !handed; ++i)
+            event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_ONCE);
+        next.join();
+        REQUIRE(handed);
+        REQUIRE(received);
+        std::vector<int32_t> fds;
+        while (auto fd = CHandoff::Instance().Take(host))
+            fds.push_back(fd.value());
+        REQUIRE(fds.size() == 2);
+        for (auto fd : fds) {
+            sockaddr_in addr = {};
+            socklen_t len = sizeof(addr);
+            REQUIRE(0 == ::getsockname(fd, (sockaddr*)&addr, &len));
+            REQUIRE(ntohs(addr.sin_port) == port);
+            evutil_closesocket(fd);
+        }
+        CHandoff::Instance().Destroy();
+
+        // a worker tears its listener down on its own contex
+        for (int32_t i = 0; i < 2; ++i) {
+            workers[i] = std::thread([&contex, &servers, i]() {
+                CContex::MAIN_CONTEX = contex[i];
+                CDEL(servers[i]);
+                CContex::MAIN_CONTEX = nullptr;
+            });
+            workers[i].join();
+        }
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
@@ -0,0 +1,111 @@
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/contex.hpp"
+#include "framework/timerwheel.hpp"
+
+USE_NAMESPACE_FRAMEWORK
+
+TEST_CASE("2: Timer wheel fires, cancels and re-arms timers", "[multi-file:2]")
+{
+    CTimerWheel wheel;
+    std::vector<uint32_t> fired;
+    const uint64_t now = 1000;
+
+    REQUIRE(wheel.Add(1, now, 10, false, [&fired]() { fired.push_back(1); }));
+    REQUIRE(wheel.Add(2, now, 5, false, [&fired]() { fired.push_back(2); }));
+    REQUIRE(wheel.Add(3, now, 70000, false, [&fired]() { fired.push_back(3); }));
+    REQUIRE(wheel.Add(4, now, 20, false, [&fired]() { fired.push_back(4); }));
+    REQUIRE(wheel.Del(4));
+    REQUIRE_FALSE(wheel.Del(4));
+    REQUIRE(wheel.Size() == 3);
+    REQUIRE(wheel.NextExpire().value() <= now + 5);
+
+    wheel.Update(now + 4);
+    REQUIRE(fired.empty());
+    wheel.Update(now + 10);
+    REQUIRE(fired == std::vector<uint32_t> { 2, 1 });
+    REQUIRE_FALSE(wheel.Has(1));
+    REQUIRE(wheel.Has(3));
+    // only an upper level holds timers, the wake is where its slot cascades and not at the next wrap
+    REQUIRE(wheel.NextExpire().value() > now + 10 + 256);
+    REQUIRE(wheel.NextExpire().value() <= now + 70000);
+
+    wheel.Update(now + 69999);
+    REQUIRE(fired.size() == 2);
+    REQUIRE(wheel.NextExpire().value() == now + 70000);
+    wheel.Update(now + 70000);
+    REQUIRE(fired.back() == 3);
+    REQUIRE(wheel.Size() == 0);
+
+    uint32_t ticks = 0;
+    wheel.Add(5, now + 70000, 100, true, [&]() {
+        if (++ticks == 3)
+            wheel.Del(5);
+    });
+    wheel.Update(now + 70100);
+    wheel.Update(now + 70200);
+    REQUIRE(ticks == 2);
+    // a late update fires a persist timer once and reschedules it from now
+    wheel.Update(now + 70450);
+    REQUIRE(ticks == 3);
+    wheel.Update(now + 71000);
+    REQUIRE(ticks == 3);
+    REQUIRE_FALSE(wheel.Has(5));
+    REQUIRE_FALSE(wheel.NextExpire().has_value());
+
+    // woken up at each expected wake, every timer fires on time whatever level it waited on
+    uint64_t clock = now + 71000;
+    std::map<uint32_t, uint64_t> due;
+    for (uint32_t i = 0; i < 200; ++i) {
+        const uint32_t t = (i * 7919) % 100000 + 1;
+        due[i + 10] = clock + t;
+        wheel.Add(i + 10, clock, t, false, [&, id = i + 10]() {
+            REQUIRE(due[id] == clock);
+            due.erase(id);
+        });
+    }
+    uint32_t wakes = 0;
+    while (auto next = wheel.NextExpire()) {
+        REQUIRE(next.value() <= std::min_element(due.begin(), due.end(), [](auto& a, auto& b) { return a.second < b.second; })->second);
+        clock = std::max(clock, next.value());
+        wheel.Update(clock);
+        ++wakes;
+    }
+    REQUIRE(due.empty());
+    REQUIRE(wakes < 400);
+}
+
+TEST_CASE("3: Timer wheel against per-timer libevent events", "[multi-file:3][!benchmark]")
+{
+    static const uint32_t TIMERS = 1000000;
+    auto base = event_base_new();
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(base);
+
+    BENCHMARK("timer wheel add/cancel 1M")
+    {
+        CTimerWheel wheel;
+        for (uint32_t i = 0; i < TIMERS; ++i)
+            wheel.Add(i, 0, 1000 + i % 60000, false, []() {});
+        for (uint32_t i = 0; i < TIMERS; ++i)
+            wheel.Del(i);
+        return wheel.Size();
+    };
+
+    BENCHMARK("libevent event add/cancel 1M")
+    {
+        std::map<const uint32_t, CEvent*> em;
+        for (uint32_t i = 0; i < TIMERS; ++i) {
+            const uint32_t t = 1000 + i % 60000;
+            timeval tv;
+            tv.tv_sec = t / 1000;
+            tv.tv_usec = (t - tv.tv_sec * 1000) * 1000;
+            em[i] = CContex::MAIN_CONTEX->Register(-1, 0, &tv, []() {});
+        }
+        for (auto& v : em)
+            CContex::MAIN_CONTEX->UnRegister(v.second);
+        return em.size();
+    };
+
+    CContex::MAIN_CONTEX = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "catch2/catch_test_macros.hpp"
+
+#include "framework/broadcast.hpp"
+#include "framework/contex.hpp"
+#include "framework/mailbox.hpp"
+#include "framework/worker.hpp"
+
+#include "fmt/core.h"
+
+USE_NAMESPACE_FRAMEWORK
+
+namespace {
+// a worker driven on the test thread, what reaches its left callbacks is recorded
+class CTestWorker : public CWorker {
+public:
+    bool Start(const uint16_t id, std::vector<std::string>* got)
+    {
+        SetId(id);
+        SetName(fmt::format("worker{}", id));
+        OnLeftEvent([got](std::string_view v) { got->emplace_back(v); }, nullptr, nullptr);
+        return Init();
+    }
+};
+
+// burns 30ms of cpu on its own thread and leaves, its loop never runs
+class CBusyWorker : public CWorker {
+protected:
+    bool Init() override
+    {
+        timespec ts = {};
+        while (0 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) && ts.tv_sec * 1000 + ts.tv_nsec / 1000000 < 30) { }
+        return false;
+    }
+};
+
+void pump()
+{
+    for (int32_t i = 0; i < 5; ++i)
+        event_base_loop(CContex::MAIN_CONTEX->Base(), EVLOOP_NONBLOCK);
+}
+} // namespace
+
+TEST_CASE("20: Broadcasts reach every worker in order and are freed once read", "[multi-file:20]")
+{
+    // entries stay until the slowest reader passed them
+    CBroadcastLog log;
+    auto fast = log.Subscribe();
+    auto slow = log.Subscribe();
+    REQUIRE(log.Retained() == 1);
+    for (int32_t i = 0; i < 3; ++i)
+        REQUIRE(log.Publish(1, fmt::format("m{}", i)));
+    REQUIRE(log.Retained() == 4);
+    std::vector<std::string> a, b;
+    REQUIRE(fast->Read([&a](const uint8_t, std::string_view v) { a.emplace_back(v); }) == 3);
+    REQUIRE(log.Retained() == 4);
+    REQUIRE(slow->Read([&b](const uint8_t, std::string_view v) { b.emplace_back(v); }) == 3);
+    REQUIRE(a == std::vector<std::string> { "m0", "m1", "m2" });
+    REQUIRE(a == b);
+    REQUIRE(log.Retained() == 1);
+    REQUIRE(fast->Read([](const uint8_t, std::string_view) {}) == 0);
+
+    // a reader that is gone no longer holds what it did not read
+    for (int32_t i = 0; i < 3; ++i)
+        REQUIRE(log.Publish(1, fmt::format("m{}", i)));
+    REQUIRE(fast->Read([](const uint8_t, std::string_view) {}) == 3);
+    REQUIRE(log.Retained() == 4);
+    slow->Unsubscribe();
+    REQUIRE(log.Retained() == 1);
+    REQUIRE(log.Publish(1, "m3"));
+    REQUIRE(slow.use_count() == 1);
+    REQUIRE(slow->Read([](const uint8_t, std::string_view) {}) == 0);
+    REQUIRE(fast->Read([](const uint8_t, std::string_view) {}) == 1);
+    REQUIRE(log.Retained() == 1);
+
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        CWorkerMgr mgr;
+        mgr.Register([]() { return CNEW CTestWorker(); }, nullptr, nullptr, nullptr);
+        std::vector<std::string> got[2];
+        for (uint16_t i = 0; i < 2; ++i) {
+            auto w = dynamic_cast<CTestWorker*>(mgr.Create(2));
+            REQUIRE(w);
+            REQUIRE(w->Start(i, &got[i]));
+        }
+
+        // identical posts are separate messages, none is dropped
+        REQUIRE(mgr.PostMsgToAllWorkers(CChannel::MsgType::Text, "kick"));
+        REQUIRE(mgr.PostMsgToAllWorkers(CChannel::MsgType::Text, "kick"));
+        REQUIRE(mgr.SendMsgToAllWorkers(CChannel::MsgType::Text, "counter+1"));
+        // a direct message sent after them in the same tick comes after them, whichever event fires first
+        REQUIRE(mgr.SendMsgToOneWorker(CChannel::MsgType::Text, "direct"));
+        pump();
+        const std::vector<std::string> all = { "kick", "kick", "counter+1" };
+        auto direct = all;
+        direct.push_back("direct");
+        REQUIRE(((got[0] == all && got[1] == direct) || (got[0] == direct && got[1] == all)));
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("21: A burst of accepted connections is spread before any worker took one", "[multi-file:21]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        CWorkerMgr mgr;
+        mgr.Register([]() { return CNEW CTestWorker(); }, nullptr, nullptr, nullptr);
+        std::vector<std::string> got[4];
+        std::vector<CWorker*> workers;
+        for (uint16_t i = 0; i < 4; ++i) {
+            auto w = dynamic_cast<CTestWorker*>(mgr.Create(4));
+            REQUIRE(w);
+            REQUIRE(w->Start(i, &got[i]));
+            workers.push_back(w);
+        }
+        auto spread = [&workers]() {
+            auto [lo, hi] = std::minmax_element(workers.begin(), workers.end(),
+                [](CWorker* a, CWorker* b) { return a->ActiveConnections() < b->ActiveConnections(); });
+            return (*hi)->ActiveConnections() - (*lo)->ActiveConnections();
+        };
+
+        // the gauges move on the dispatching side, the workers read nothing in between
+        mgr.SetDispatchPolicy("leastconn");
+        for (int32_t i = 0; i < 100; ++i)
+            REQUIRE(mgr.DispatchConnection(CChannel::MsgType::Text, "newconn"));
+        for (auto w : workers)
+            REQUIRE(w->ActiveConnections() == 25);
+        mgr.SetDispatchPolicy("p2c");
+        for (int32_t i = 0; i < 100; ++i)
+            REQUIRE(mgr.DispatchConnection(CChannel::MsgType::Text, "newconn"));
+        REQUIRE(spread() <= 4);
+
+        // connections closing on one worker make it the choice of the next ones
+        pump();
+        for (int32_t i = 0; i < 20; ++i)
+            workers[2]->DecConnection();
+        mgr.SetDispatchPolicy("leastconn");
+        const int64_t before = workers[2]->ActiveConnections();
+        for (int32_t i = 0; i < 10; ++i)
+            REQUIRE(mgr.DispatchConnection(CChannel::MsgType::Text, "newconn"));
+        REQUIRE(workers[2]->ActiveConnections() == before + 10);
+        size_t received = 0;
+        for (auto& v : got)
+            received += v.size();
+        REQUIRE(received == 200);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("28: A worker multicasts to the others and not to itself", "[multi-file:28]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        CWorkerMgr mgr;
+        mgr.Register([]() { return CNEW CTestWorker(); }, nullptr, nullptr, nullptr);
+        std::vector<std::string> got[3];
+        std::vector<CWorker*> workers;
+        for (uint16_t i = 0; i < 3; ++i) {
+            auto w = dynamic_cast<CTestWorker*>(mgr.Create(3));
+            REQUIRE(w);
+            REQUIRE(w->Start(i, &got[i]));
+            workers.push_back(w);
+        }
+
+        REQUIRE(workers[1]->MulticastToWorkers(CChannel::MsgType::Text, "evict"));
+        pump();
+        REQUIRE(got[0] == std::vector<std::string> { "evict" });
+        REQUIRE(got[1].empty());
+        REQUIRE(got[2] == std::vector<std::string> { "evict" });
+
+        // an explicit list is taken as it is
+        REQUIRE(workers[1]->MulticastToWorkers({ 1, 2 }, CChannel::MsgType::Text, "listed"));
+        pump();
+        REQUIRE(got[0].size() == 1);
+        REQUIRE(got[1] == std::vector<std::string> { "listed" });
+        REQUIRE(got[2] == std::vector<std::string> { "evict", "listed" });
+
+        // there is no ring from a worker to itself, its own part does not wait for the loop
+        REQUIRE(workers[0]->SendToWorker(0, CChannel::MsgType::Text, "self"));
+        REQUIRE(got[0] == std::vector<std::string> { "evict", "self" });
+        CMailbox box;
+        REQUIRE(box.Create(3));
+        std::vector<std::string> mails;
+        for (uint16_t i = 0; i < 3; ++i) {
+            REQUIRE(box.Register(i, *CContex::MAIN_CONTEX, [&mails, i](const uint16_t from, const uint8_t, std::string_view v) {
+                mails.push_back(fmt::format("{}>{} {}", from, i, v));
+            }));
+        }
+        for (uint16_t from = 0; from < 3; ++from) {
+            for (uint16_t to = 0; to < 3; ++to)
+                REQUIRE(box.Send(from, to, 1, "m") == (from != to));
+        }
+        pump();
+        std::sort(mails.begin(), mails.end());
+        REQUIRE(mails == std::vector<std::string> { "0>1 m", "0>2 m", "1>0 m", "1>2 m", "2>0 m", "2>1 m" });
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}
+
+TEST_CASE("29: Worker cpu time is read while the thread runs and kept once it exited", "[multi-file:29]")
+{
+    CContex::MAIN_CONTEX = std::make_shared<CContex>(event_base_new());
+    {
+        CWorkerMgr mgr;
+        mgr.Register([]() { return CNEW CBusyWorker(); }, nullptr, nullptr, nullptr);
+        auto w = mgr.Create(1);
+        REQUIRE(w);
+        w->SetId(0);
+        w->SetName("busy");
+        REQUIRE(w->CpuTimeUs() == 0);
+
+        std::atomic<bool> exited = { false };
+        std::thread t([w, &exited]() {
+            w->Loop();
+            exited = true;
+        });
+        // samples taken while the thread comes and goes never go back
+        uint64_t last = 0;
+        bool monotonic = true;
+        while (!exited) {
+            const uint64_t v = w->CpuTimeUs();
+            monotonic = monotonic && v >= last;
+            last = v;
+            std::this_thread::yield();
+        }
+        t.join();
+        REQUIRE(monotonic);
+        const uint64_t used = w->CpuTimeUs();
+        REQUIRE(used >= 30000);
+        REQUIRE(used >= last);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE(w->CpuTimeUs() == used);
+    }
+    CContex::MAIN_CONTEX = nullptr;
+}